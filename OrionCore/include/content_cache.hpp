@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct stat;
+
+namespace orion {
+
+// A file as it was when its contents were read. Any write changes the mtime
+// and a replaced file gets a new inode, so facts stored under a key stay true
+// for as long as a stat returns it.
+struct ContentKey {
+  uint64_t device = 0;
+  uint64_t inode = 0;
+  uint64_t size = 0;
+  int64_t mtime_ns = 0;
+
+  static ContentKey of(const struct stat &st);
+};
+
+// What reading a file's contents found. `flags` says which fields are set.
+struct ContentFacts {
+  enum : uint32_t {
+    kEdgeHash = 1,
+    kFullHash = 2,
+    // A NUL byte near the start: content searches skip the file.
+    kBinary = 4,
+  };
+
+  uint32_t flags = 0;
+  // DuplicateFinder's hashes of the first and last blocks and of the whole
+  // file.
+  uint64_t edge_hash = 0;
+  uint64_t full_hash = 0;
+};
+
+// Facts about file contents kept across sessions, so unchanged files are
+// never read twice. The file is an append-only log of fixed-size records,
+// one per change; open() folds it into a table of the latest facts per
+// device and inode and, if that leaves stale or damaged records behind,
+// rewrites the log with only the live ones. Any number of threads may look
+// up and store at once, and processes sharing the file append under an
+// flock. The log is only ever a cache: when it cannot be read or written,
+// facts are kept for the session alone.
+class ContentCache {
+public:
+  static constexpr const char *kFileName = "content-cache";
+  // Compaction keeps the most recently stored files beyond this many.
+  static constexpr size_t kMaxEntries = 1 << 20;
+
+  ~ContentCache();
+
+  ContentCache(const ContentCache &) = delete;
+  ContentCache &operator=(const ContentCache &) = delete;
+
+  // Loads and compacts the log at `path`, creating it and its directory if
+  // needed. Never fails.
+  static std::shared_ptr<ContentCache> open(const std::string &path);
+
+  // False unless `key` matches the file's last stored size and mtime.
+  bool lookup(const ContentKey &key, ContentFacts &facts) const;
+  // Adds `facts` to what is known about the file; facts stored under an
+  // older size or mtime are dropped. New facts are appended to the log in
+  // batches and when the cache is flushed or destroyed.
+  void store(const ContentKey &key, const ContentFacts &facts);
+  // Appends the facts stored since the last flush.
+  void flush();
+
+  size_t size() const;
+
+private:
+  struct Record;
+  struct Entry {
+    uint64_t size;
+    int64_t mtime_ns;
+    ContentFacts facts;
+    // Order of the last store, for compaction to keep the newest entries.
+    uint64_t sequence;
+  };
+  struct FileId {
+    uint64_t device;
+    uint64_t inode;
+    bool operator==(const FileId &other) const {
+      return device == other.device && inode == other.inode;
+    }
+  };
+  struct FileIdHash {
+    size_t operator()(const FileId &id) const {
+      return static_cast<size_t>((id.inode * 0x9E3779B97F4A7C15ULL) ^ id.device);
+    }
+  };
+  // Entries are spread over shards by file id so workers rarely contend.
+  struct Shard {
+    mutable std::mutex mutex;
+    std::unordered_map<FileId, Entry, FileIdHash> entries;
+  };
+  static constexpr size_t kShards = 16;
+
+  explicit ContentCache(std::string path);
+
+  Shard &shard_of(const FileId &id) {
+    return shards[FileIdHash()(id) % kShards];
+  }
+  const Shard &shard_of(const FileId &id) const {
+    return shards[FileIdHash()(id) % kShards];
+  }
+  // Merges one record into the table; returns the merged record if it
+  // changed anything.
+  bool merge(const Record &record, uint64_t sequence, Record *merged);
+  void load_and_compact();
+  // The log, opened and locked, or -1. Reopens it if another process
+  // compacted it into a new file after it was opened.
+  int lock_log(int fd);
+  void append(const std::vector<Record> &records);
+
+  std::string path;
+  Shard shards[kShards];
+
+  std::mutex log_mutex;
+  int log_fd = -1;
+  std::vector<Record> pending;
+  std::atomic<uint64_t> next_sequence{0};
+};
+
+} // namespace orion
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace orion {
+
+class ContentCache;
+class Regex;
+
+// Counts occurrences of a literal in file contents, case-sensitively like
+// grep -F, or with `regex` the lines matching a pattern like grep -cE. Files
+// are read with pread into a per-worker buffer, large ones in chunks with
+// sequential readahead; a regex only sees the first 4 MiB of longer lines.
+// Files with a NUL byte near the start are taken to be binary and skipped;
+// with a `cache` they are remembered, and later scans skip them without
+// reading.
+class ContentScanner {
+public:
+  // A `regex` that does not compile matches nothing.
+  explicit ContentScanner(std::string needle, bool regex = false,
+                          std::shared_ptr<ContentCache> cache = nullptr);
+  ~ContentScanner();
+
+  // Occurrences in the regular file `name` below `dir_fd`; 0 for binary,
+  // empty or unreadable files. `buffer` is reused between calls. The bytes
+  // actually read are added to `bytes_read`, and files the cache knew to
+  // be binary to `cache_hits`.
+  uint32_t scan(int dir_fd, const char *name, std::vector<char> &buffer,
+                uint64_t *bytes_read = nullptr, uint64_t *cache_hits = nullptr) const;
+
+  // Non-overlapping occurrences of `needle` in `haystack`, found with an
+  // SSE2/AVX2 first/last-byte filter.
+  static uint32_t count(std::string_view haystack, std::string_view needle);
+
+  const std::string &pattern() const { return needle; }
+
+private:
+  std::string needle;
+  bool regex_mode;
+  std::unique_ptr<Regex> regex;
+  std::shared_ptr<ContentCache> cache;
+
+  uint32_t count_in(std::string_view contents) const;
+};
+
+} // namespace orion
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "walker.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+
+namespace orion {
+
+// Owns a directory descriptor that child directories are opened relative to.
+struct DirFd {
+  int fd;
+  explicit DirFd(int fd) : fd(fd) {}
+  ~DirFd() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  DirFd(const DirFd &) = delete;
+  DirFd &operator=(const DirFd &) = delete;
+};
+
+inline EntryType type_from_mode(mode_t mode) {
+  if (S_ISREG(mode)) return EntryType::File;
+  if (S_ISDIR(mode)) return EntryType::Directory;
+  if (S_ISLNK(mode)) return EntryType::Symlink;
+  return EntryType::Other;
+}
+
+inline EntryType type_from_dtype(unsigned char d_type) {
+  switch (d_type) {
+  case DT_REG: return EntryType::File;
+  case DT_DIR: return EntryType::Directory;
+  case DT_LNK: return EntryType::Symlink;
+  case DT_UNKNOWN: return EntryType::Unknown;
+  default: return EntryType::Other;
+  }
+}
+
+inline int64_t mtime_of(const struct stat &st) {
+#if defined(__APPLE__)
+  return int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+  return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+// Stats `name` below `dir_fd` without following symlinks. With no
+// `metadata` only the type is requested, which statx can answer from cached
+// attributes instead of asking a network filesystem's server.
+inline bool stat_entry(int dir_fd, const char *name, EntryType &type,
+                       EntryMetadata *metadata = nullptr) {
+#if defined(__linux__) && defined(STATX_TYPE)
+  unsigned mask = metadata ? STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO : STATX_TYPE;
+  int flags = AT_SYMLINK_NOFOLLOW | (metadata ? AT_STATX_SYNC_AS_STAT : AT_STATX_DONT_SYNC);
+  struct statx stx;
+  if (statx(dir_fd, name, flags, mask, &stx) == 0) {
+    type = type_from_mode(stx.stx_mode);
+    if (metadata) {
+      metadata->size = stx.stx_size;
+      metadata->mtime_ns = int64_t(stx.stx_mtime.tv_sec) * 1000000000 + stx.stx_mtime.tv_nsec;
+      metadata->device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+      metadata->inode = stx.stx_ino;
+    }
+    return true;
+  }
+  if (errno != ENOSYS) return false;
+#endif
+  struct stat st;
+  if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return false;
+  type = type_from_mode(st.st_mode);
+  if (metadata) {
+    metadata->size = static_cast<uint64_t>(st.st_size);
+    metadata->mtime_ns = mtime_of(st);
+    metadata->device = static_cast<uint64_t>(st.st_dev);
+    metadata->inode = static_cast<uint64_t>(st.st_ino);
+  }
+  return true;
+}
+
+// Opens `name` below `parent` without following symlinks, or `path` itself
+// when there is no parent. Falls back to the full path if descriptors run out.
+inline int open_directory(const DirFd *parent, const char *name, const char *path) {
+  constexpr int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+  if (!parent) {
+    return open(path, flags);
+  }
+  int fd = openat(parent->fd, name, flags | O_NOFOLLOW);
+  if (fd >= 0 || errno != EMFILE) return fd;
+  return open(path, flags | O_NOFOLLOW);
+}
+
+// Calls `fn(name, length, type)` for every entry of the open directory `fd`
+// except "." and "..". The type is Unknown when the filesystem does not
+// report one. Stops early, between reads, once `cancel` is set. Time spent in
+// the directory reads themselves, not in `fn`, is added to `read_ns`.
+template <typename Fn>
+void read_entries(int fd, std::vector<char> &buffer, const std::atomic<bool> *cancel,
+                  uint64_t *read_ns, Fn &&fn) {
+  using Clock = std::chrono::steady_clock;
+  auto timed = [read_ns](auto &&read) {
+    if (!read_ns) return read();
+    auto begin = Clock::now();
+    auto result = read();
+    *read_ns += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+    return result;
+  };
+
+  auto is_dot_or_dotdot = [](const char *name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+  };
+
+#if defined(__linux__)
+  struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+  };
+
+  buffer.resize(64 * 1024);
+  for (;;) {
+    long bytes = timed([&] { return syscall(SYS_getdents64, fd, buffer.data(), buffer.size()); });
+    if (bytes <= 0) break;
+    for (long offset = 0; offset < bytes;) {
+      auto *entry = reinterpret_cast<linux_dirent64 *>(buffer.data() + offset);
+      offset += entry->d_reclen;
+      if (is_dot_or_dotdot(entry->d_name)) continue;
+      fn(entry->d_name, strlen(entry->d_name), type_from_dtype(entry->d_type));
+    }
+    if (cancel && cancel->load(std::memory_order_relaxed)) break;
+  }
+#else
+  (void)buffer;
+  int stream_fd = dup(fd);
+  if (stream_fd < 0) return;
+  DIR *stream = fdopendir(stream_fd);
+  if (!stream) {
+    close(stream_fd);
+    return;
+  }
+  while (struct dirent *entry = timed([&] { return readdir(stream); })) {
+    if (is_dot_or_dotdot(entry->d_name)) continue;
+    fn(entry->d_name, strlen(entry->d_name), type_from_dtype(entry->d_type));
+    if (cancel && cancel->load(std::memory_order_relaxed)) break;
+  }
+  closedir(stream);
+#endif
+}
+
+template <typename Fn>
+void read_entries(int fd, std::vector<char> &buffer, const std::atomic<bool> *cancel, Fn &&fn) {
+  read_entries(fd, buffer, cancel, nullptr, std::forward<Fn>(fn));
+}
+
+} // namespace orion
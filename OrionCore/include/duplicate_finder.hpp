@@ -0,0 +1,75 @@
+#pragma once
+
+#include "search_engine.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace orion {
+
+// Files with identical contents, paths sorted.
+struct DuplicateGroup {
+  uint64_t size = 0;
+  std::vector<std::string> paths;
+
+  // What deleting all but one copy would free.
+  uint64_t reclaimable() const { return paths.empty() ? 0 : size * (paths.size() - 1); }
+};
+
+// 64-bit xxHash (XXH64) of a byte stream fed in pieces of any size.
+class ContentHash {
+public:
+  explicit ContentHash(uint64_t seed = 0);
+
+  void update(const void *data, size_t size);
+  uint64_t digest() const;
+
+  static uint64_t of(std::string_view data, uint64_t seed = 0) {
+    ContentHash hash(seed);
+    hash.update(data.data(), data.size());
+    return hash.digest();
+  }
+
+private:
+  uint64_t lanes[4];
+  uint64_t seed;
+  uint64_t total = 0;
+  unsigned char pending[32];
+  size_t pending_size = 0;
+};
+
+// Finds files with identical contents in stages, each only reading files
+// that are still candidates after the last:
+//   1. the walk, with one stat per file that passes the query, buckets files
+//      by size; sizes seen once are dropped without reading anything,
+//   2. files sharing a size are keyed by a hash of their first and last
+//      kEdgeBlock bytes, which is the whole file for small ones,
+//   3. files still sharing a key are hashed in full with ContentHash.
+// Stages 2 and 3 spread the files over all workers, largest first, and
+// with the query's ContentCache skip files hashed by an earlier search and
+// unchanged since. Hard links to one file count once since they take no
+// extra space, and empty files are never reported.
+class DuplicateFinder {
+public:
+  static constexpr size_t kEdgeBlock = 4096;
+
+  explicit DuplicateFinder(unsigned thread_count = 0);
+
+  // The query's text, terms and ignore settings pick the files compared;
+  // its content, fuzzy and limit settings are not used. Groups come back
+  // with the most reclaimable bytes first. `live`, if given, counts files
+  // as the walk sees them and duplicates as they are confirmed; the walk
+  // makes up the first half of its estimate and hashing the second. A
+  // cancelled search returns no groups.
+  std::vector<DuplicateGroup> find(const SearchQuery &query, const std::string &directory,
+                                   uint64_t min_size = 1, const std::atomic<bool> *cancel = nullptr,
+                                   SearchProgress *live = nullptr);
+
+private:
+  unsigned threads;
+};
+
+} // namespace orion
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "search_engine.hpp"
+#include "trigram_index.hpp"
+#include "walker.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace orion {
+
+class Matcher;
+class ProgressReporter;
+class ResultBatcher;
+
+// A snapshot of a directory tree that can be saved to disk and memory-mapped
+// back. Nodes are stored breadth-first, so every parent precedes its children
+// and the children of a directory are contiguous and sorted by name.
+class FileIndex {
+public:
+  static constexpr uint32_t kNoNode = UINT32_MAX;
+
+  struct Node {
+    uint32_t parent;
+    uint32_t name_offset;
+    uint32_t first_child;
+    uint32_t child_count;
+    int64_t mtime_ns;
+    uint64_t size;
+    uint16_t name_length;
+    uint8_t type;
+    uint8_t reserved[5];
+  };
+
+  // Changes reported by filesystem notifications. When a plan is passed to
+  // build(), directories outside it are copied from the previous index
+  // without touching the filesystem.
+  struct UpdatePlan {
+    // Directories whose entries were created, deleted or renamed.
+    std::unordered_set<std::string> dirty;
+    // New path of a renamed directory -> its node in the previous index.
+    std::unordered_map<std::string, uint32_t> moved;
+    // Subtrees that are not watched or lost events; re-checked by mtime.
+    std::unordered_set<std::string> verify;
+
+    bool empty() const { return dirty.empty() && moved.empty() && verify.empty(); }
+  };
+
+  struct RefreshStats {
+    uint64_t directories_scanned = 0;
+    uint64_t directories_reused = 0;
+  };
+
+  ~FileIndex();
+
+  FileIndex(const FileIndex &) = delete;
+  FileIndex &operator=(const FileIndex &) = delete;
+
+  // Memory-maps an index written by save(). Returns null if the file is
+  // missing, truncated or was written by an incompatible version.
+  static std::unique_ptr<FileIndex> load(const std::string &file);
+
+  // Scans `root`. When `previous` indexes the same root, directories whose
+  // mtime is unchanged are copied from it instead of being read again.
+  // Returns null if the root cannot be opened or the scan was cancelled.
+  static std::unique_ptr<FileIndex> build(const std::string &root, const FileIndex *previous,
+                                          unsigned thread_count, const std::atomic<bool> *cancel,
+                                          RefreshStats *stats = nullptr,
+                                          const UpdatePlan *plan = nullptr);
+
+  // Writes the index next to `file` and renames it into place.
+  bool save(const std::string &file) const;
+
+  // Name of the index file for `root` inside `index_dir`.
+  static std::string file_for_root(const std::string &index_dir, const std::string &root);
+
+  const std::string &root() const { return root_path; }
+  size_t size() const { return node_count; }
+  const Node &node(uint32_t id) const { return nodes[id]; }
+  std::string_view name(uint32_t id) const {
+    return std::string_view(names + nodes[id].name_offset, nodes[id].name_length);
+  }
+  std::string path_of(uint32_t id) const;
+  // Node of the entry at `path`, or kNoNode if it is not in the index.
+  uint32_t find(std::string_view path) const;
+
+  // Built on first use; IndexStore builds it before publishing a snapshot.
+  const TrigramIndex &trigrams() const;
+  // Bytes of node and name data plus the trigram table, if it was built.
+  size_t memory_bytes() const;
+
+  // Same matching rules as SearchEngine::search, without walking the
+  // filesystem. Queries of three or more characters only verify the nodes
+  // the trigram index returns. A content literal is checked by reading just
+  // the files whose names passed.
+  void search(const SearchQuery &query, const SearchEngine::ResultCallback &on_results,
+              const SearchEngine::ProgressCallback &progress, unsigned thread_count,
+              const std::atomic<bool> *cancel, SearchProgress *live = nullptr) const;
+
+private:
+  FileIndex() = default;
+
+  std::string root_path;
+  const Node *nodes = nullptr;
+  const char *names = nullptr;
+  size_t node_count = 0;
+  size_t names_size = 0;
+
+  std::vector<Node> owned_nodes;
+  std::string owned_names;
+  void *mapping = nullptr;
+  size_t mapping_size = 0;
+
+  mutable std::once_flag trigram_once;
+  mutable std::unique_ptr<TrigramIndex> trigram_index;
+  mutable std::atomic<bool> trigrams_built{false};
+
+  // Whether a file passes the name and metadata terms of the query.
+  using Wanted = std::function<bool(uint32_t id)>;
+  // Reports a file whose name matched.
+  using Emit = std::function<void(unsigned worker, uint32_t id, const std::string &path)>;
+
+  // Returns the time the workers spent busy, summed over workers.
+  uint64_t search_candidates(const std::vector<uint32_t> &candidates, const Matcher &matcher,
+                             const Wanted &wanted, const Emit &emit, ResultBatcher &batcher,
+                             ProgressReporter &reporter, unsigned threads) const;
+};
+
+// The current index for one root, shared between searches and refreshes.
+// Searches keep using the snapshot they started with while a refresh builds
+// and publishes its replacement.
+class IndexStore {
+public:
+  IndexStore(std::string root, std::string file);
+
+  std::shared_ptr<const FileIndex> snapshot() const;
+
+  // Incrementally rebuilds the index, saves it and publishes it. Returns
+  // false if the scan failed or was cancelled.
+  bool refresh(unsigned thread_count, const std::atomic<bool> *cancel,
+               FileIndex::RefreshStats *stats = nullptr);
+
+  // Applies notification-driven changes and publishes the result without
+  // saving it; call save() to persist.
+  bool update(const FileIndex::UpdatePlan &plan, unsigned thread_count,
+              FileIndex::RefreshStats *stats = nullptr);
+  bool save();
+
+  const std::string &root_path() const { return root; }
+
+private:
+  std::string root;
+  std::string file;
+  mutable std::mutex mutex;
+  std::mutex refresh_mutex;
+  std::shared_ptr<const FileIndex> current;
+};
+
+} // namespace orion
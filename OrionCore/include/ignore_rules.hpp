@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace orion {
+
+// What a walk leaves out. Excluded directories are never opened, so the
+// subtrees below them cost nothing.
+struct IgnoreSettings {
+  // Honour the patterns in .gitignore and .orionignore files found along the
+  // walk, each for the directory it is in and everything below.
+  bool ignore_files = true;
+  // Patterns for the whole tree, in the same syntax. Ignore files take
+  // precedence, so they can re-include what these exclude.
+  std::vector<std::string> excludes = default_excludes();
+
+  // Version control metadata and dependency or build caches.
+  static std::vector<std::string> default_excludes();
+
+  bool operator==(const IgnoreSettings &other) const {
+    return ignore_files == other.ignore_files && excludes == other.excludes;
+  }
+  bool operator!=(const IgnoreSettings &other) const { return !(*this == other); }
+};
+
+// The patterns of one ignore file, chained to those of the directories
+// above it. The syntax is gitignore's: the last matching pattern wins, '!'
+// re-includes, a trailing '/' matches only directories, and a pattern with
+// a '/' before its end is anchored to the file's directory while any other
+// matches the name at any depth. '*', '?' and [a-z] stop at '/'; "**"
+// crosses it. Matching is case-sensitive.
+class IgnoreRules {
+public:
+  static constexpr const char *kFileNames[] = {".gitignore", ".orionignore"};
+
+  // `base` is the directory the patterns apply to, relative to the walk
+  // root ("" for the root itself).
+  IgnoreRules(std::string base, std::shared_ptr<const IgnoreRules> parent);
+
+  // Adds the patterns in `text`, one per line; blank lines and '#' comments
+  // are skipped.
+  void add(std::string_view text);
+  // Adds the patterns of the file `name` below the directory `dir_fd` (or
+  // AT_FDCWD); a missing or unreadable file adds nothing.
+  void add_file(int dir_fd, const char *name);
+  bool empty() const { return rules.empty(); }
+
+  // `relative` is the entry's path below the walk root, inside `base`.
+  // Only the entry itself is checked: a walk never reaches the contents of
+  // an excluded directory, so nothing inside it can be re-included.
+  bool ignored(std::string_view relative, bool directory) const;
+
+private:
+  struct Rule {
+    // Literal and Suffix patterns are compared directly; Suffix keeps the
+    // text after a leading '*', as in "*.o".
+    enum class Kind : uint8_t { Literal, Suffix, Glob };
+    Kind kind;
+    bool negated;
+    bool directory_only;
+    // Matched against the path below `base` instead of the name.
+    bool anchored;
+    std::string pattern;
+
+    bool matches(std::string_view text) const;
+  };
+
+  std::string base;
+  std::shared_ptr<const IgnoreRules> parent;
+  std::vector<Rule> rules;
+};
+
+} // namespace orion
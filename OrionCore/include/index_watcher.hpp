@@ -0,0 +1,60 @@
+#pragma once
+
+#include "file_index.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace orion {
+
+// Keeps an IndexStore current from inotify events. Creates, deletes and
+// renames are collected for a short window and applied as one UpdatePlan,
+// so only the directories that changed are read again. Directories that
+// cannot be watched (watch limit reached) and queue overflows fall back to an
+// mtime re-check of the affected subtree.
+class IndexWatcher {
+public:
+  explicit IndexWatcher(std::shared_ptr<IndexStore> store, unsigned thread_count = 0);
+  ~IndexWatcher();
+
+  IndexWatcher(const IndexWatcher &) = delete;
+  IndexWatcher &operator=(const IndexWatcher &) = delete;
+
+  // Watches every directory of the current snapshot. Returns false if the
+  // store has no index yet or notifications are not available.
+  bool start();
+  void stop();
+
+  uint64_t watched_directories() const { return watch_count.load(std::memory_order_relaxed); }
+  uint64_t unwatched_subtrees() const { return unwatched_count.load(std::memory_order_relaxed); }
+
+private:
+  std::shared_ptr<IndexStore> store;
+  unsigned threads;
+  int notify_fd = -1;
+  int stop_pipe[2] = {-1, -1};
+  std::thread runner;
+  std::atomic<uint64_t> watch_count{0};
+  std::atomic<uint64_t> unwatched_count{0};
+
+  // Owned by the watcher thread once it is running.
+  std::unordered_map<int, std::string> wd_paths;
+  std::unordered_map<std::string, int> path_wds;
+  std::unordered_set<std::string> unwatched;
+
+  void run();
+  // Watches the directories below and including `id` that have no watch yet,
+  // appending their paths to `added`. Unless `through_watched`, a watched
+  // directory's subtree is taken to be watched already.
+  void watch_subtree(const FileIndex &index, uint32_t id, bool through_watched = false,
+                     std::vector<std::string> *added = nullptr);
+  void rename_watches(const std::string &from, const std::string &to,
+                      std::unordered_set<std::string> &dirty);
+};
+
+} // namespace orion
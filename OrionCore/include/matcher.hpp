@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace orion {
+
+// Lower-cases ASCII and the other cased scripts of UTF-8 text. Bytes that are
+// not valid UTF-8 are kept as they are.
+std::string fold_case(std::string_view text);
+
+// Case-insensitive substring matcher. The needle is folded once on
+// construction. ASCII needles are searched for with SSE2/AVX2 (scalar
+// elsewhere), folding the haystack inside the vector registers; other
+// needles fold a copy of the haystack first.
+class Matcher {
+public:
+  explicit Matcher(std::string_view needle);
+
+  bool matches(std::string_view haystack) const;
+  const std::string &folded_needle() const { return needle; }
+  bool empty() const { return needle.empty(); }
+
+private:
+  std::string needle;
+  bool ascii_needle;
+};
+
+// fzf-style subsequence matcher, ignoring case like Matcher. Every pattern
+// character has to appear in order; the score rewards characters that start a
+// path component or word, continue a run of matches or lie in the basename,
+// and charges for the gaps in between. Scoring is linear in the path length.
+class FuzzyMatcher {
+public:
+  explicit FuzzyMatcher(std::string_view pattern);
+
+  // Returns false if `path` does not contain the pattern as a subsequence.
+  bool score(std::string_view path, int32_t &score) const;
+  bool empty() const { return pattern.empty(); }
+
+private:
+  std::string pattern;
+  bool ascii_pattern;
+
+  int32_t score_window(std::string_view text, size_t begin, size_t end, size_t basename) const;
+};
+
+// True when the extension of `name` equals `folded_extension` (given without
+// the leading dot). Names like ".bashrc" have no extension.
+bool has_extension(std::string_view name, std::string_view folded_extension);
+
+} // namespace orion
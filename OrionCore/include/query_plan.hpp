@@ -0,0 +1,63 @@
+#pragma once
+
+#include "matcher.hpp"
+#include "search_engine.hpp"
+#include "walker.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace orion {
+
+// True when the glob `folded_pattern` (already folded) matches all of
+// `text`, ignoring case. '*' matches any run of characters, '/' included,
+// '?' any one character, "[a-z]" and "[!a-z]" one character in or not in a
+// set, and '\' escapes the character after it.
+bool glob_matches(std::string_view folded_pattern, std::string_view text);
+
+// The terms of a query, compiled once per search and grouped by what they
+// need: the name, then the full path, then a stat. Each group is checked
+// only when the one before passed, and within a group cheap checks come
+// first. The query text itself is left to the engines, which have faster
+// ways to match it.
+class QueryPlan {
+public:
+  explicit QueryPlan(const SearchQuery &query);
+
+  bool matches_name(std::string_view name) const;
+  // `relative` is the path below the search root.
+  bool matches_path(std::string_view relative) const;
+  bool matches_metadata(const EntryMetadata &metadata) const;
+
+  bool needs_path() const { return !path_checks.empty(); }
+  bool needs_metadata() const { return !metadata_checks.empty(); }
+  // The extension every match must have, if the query allows exactly one.
+  std::string_view required_extension() const { return single_extension; }
+  // The longest folded literal, without a '/', that the relative path of
+  // every match contains according to the terms; empty if there is none.
+  std::string_view required_literal() const { return path_literal; }
+
+private:
+  struct Check {
+    QueryTerm::Kind kind;
+    bool negated;
+    Matcher matcher;
+    std::string glob;
+    std::shared_ptr<const Regex> regex;
+    std::vector<std::string> extensions;
+    int64_t min;
+    int64_t max;
+
+    bool test(std::string_view text) const;
+  };
+
+  std::vector<Check> name_checks;
+  std::vector<Check> path_checks;
+  std::vector<Check> metadata_checks;
+  std::string single_extension;
+  std::string path_literal;
+};
+
+} // namespace orion
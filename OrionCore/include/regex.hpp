@@ -0,0 +1,91 @@
+#pragma once
+
+#include "matcher.hpp"
+
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace orion {
+
+// Regular expressions matched without backtracking. The pattern is compiled
+// to a Thompson NFA that runs as a DFA built lazily, one state per set of NFA
+// states actually reached, so matching stays linear in the text whatever the
+// pattern. Before the automaton runs, the longest literal every match must
+// contain is searched for with Matcher's SIMD scan, which rejects most texts
+// without touching the DFA.
+//
+// Supports literals, '.', classes such as [a-z] and [^0-9], \d \w \s and
+// their negations, ^ and $, groups (also (?:...)), '|' and the quantifiers
+// * + ? {n} {n,} {n,m}, optionally lazy. Backreferences, lookaround and word
+// boundaries are not supported. Non-ASCII characters match as whole UTF-8
+// sequences and fold like Matcher when ignoring case.
+class Regex {
+public:
+  // Returns null and describes the problem in `error` if the pattern does
+  // not parse or compiles to too large an automaton.
+  static std::unique_ptr<Regex> compile(std::string_view pattern, bool ignore_case,
+                                        std::string *error = nullptr);
+
+  ~Regex();
+  Regex(const Regex &) = delete;
+  Regex &operator=(const Regex &) = delete;
+
+  // True if `text` contains a match. Any number of threads may match at
+  // once; they share the DFA states built so far.
+  bool matches(std::string_view text) const;
+
+  // Lines of `text` that contain a match, like grep -c. With a required
+  // literal only the lines around its occurrences are run.
+  uint32_t count_lines(std::string_view text) const;
+
+  // Folded when ignoring case; empty if no literal is required.
+  const std::string &required_literal() const { return literal; }
+
+private:
+  struct Instruction {
+    enum Op : uint8_t { Set, Split, Jump, Begin, End, Match };
+    Op op;
+    uint32_t set;
+    int32_t out;
+    int32_t out1;
+  };
+  struct State;
+
+  Regex() = default;
+
+  void add_closure(std::vector<uint32_t> &out, std::vector<uint8_t> &seen, int32_t pc,
+                   bool at_start, bool at_end) const;
+  std::vector<uint32_t> step(const std::vector<uint32_t> &set, unsigned char byte) const;
+  bool accepts_at_end(const std::vector<uint32_t> &set) const;
+  bool has_match(const std::vector<uint32_t> &set) const;
+  // Returns the state for `set`, adding it if there is room; -1 otherwise.
+  // Called with `mutex` held.
+  int32_t intern(std::vector<uint32_t> set) const;
+  int32_t next_state(int32_t state, unsigned char byte) const;
+  // The NFA run directly, once the DFA has no room for more states.
+  bool simulate(std::vector<uint32_t> set, std::string_view rest) const;
+  bool run(std::string_view text) const;
+
+  std::vector<Instruction> program;
+  std::vector<std::bitset<256>> sets;
+  int32_t start = 0;
+  bool ignore_case = false;
+  std::string literal;
+  std::unique_ptr<Matcher> prefilter;
+
+  mutable std::mutex mutex;
+  // Fixed capacity, so readers never see the array move.
+  std::unique_ptr<std::unique_ptr<State>[]> states;
+  mutable size_t state_count = 0;
+  mutable std::map<std::vector<uint32_t>, int32_t> state_ids;
+  int32_t initial_state = 0;
+};
+
+} // namespace orion
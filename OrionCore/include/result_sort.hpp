@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace orion {
+
+enum class SortKey { Name, Path, Size, ModifiedTime, Matches };
+
+// One result to sort. `path` has to be NUL-terminated when sorting by size or
+// modification time, since it is stat'ed as it is.
+struct SortItem {
+  std::string_view path;
+  uint32_t content_matches = 0;
+};
+
+// Returns the indices of `items` in sorted order. Every key is extracted once
+// up front (one stat per path for Size and ModifiedTime, names folded for
+// Name), spread over the threads; each thread then sorts a slice of the keys
+// and the slices are merged pairwise in parallel. Ties fall back to the path,
+// so the order does not depend on how the results arrived.
+std::vector<uint32_t> sort_order(const std::vector<SortItem> &items, SortKey key,
+                                 bool descending, unsigned thread_count = 0);
+
+} // namespace orion
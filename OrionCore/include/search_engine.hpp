@@ -0,0 +1,167 @@
+#pragma once
+
+#include "search_stats.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace orion {
+
+class ContentCache;
+struct IgnoreSettings;
+class Regex;
+
+// One filter of a query. Terms are ANDed; a negated term excludes what it
+// matches. Text terms match as case-insensitive substrings, globs must match
+// the whole name or path and regexes match anywhere in the path. Sizes are in bytes and times in nanoseconds since
+// the epoch, both as an inclusive [min, max].
+struct QueryTerm {
+  enum class Kind { Text, Glob, Regex, Extensions, Size, ModifiedTime };
+  // What Text and Glob terms are matched against: the path below the search
+  // root or just the file name.
+  enum class Scope { Path, Name };
+
+  Kind kind = Kind::Text;
+  Scope scope = Scope::Path;
+  bool negated = false;
+  std::string pattern;
+  // Compiled from `pattern`, ignoring case, for Regex terms.
+  std::shared_ptr<const Regex> regex;
+  // Folded, without the leading dot.
+  std::vector<std::string> extensions;
+  int64_t min = INT64_MIN;
+  int64_t max = INT64_MAX;
+  // The term as written, without its negation. Two terms with the same
+  // source filter the same way.
+  std::string source;
+};
+
+// The query language shared with OrionKit: whitespace-separated terms, e.g.
+// "report -draft ext:pdf,doc size:>1m mtime:>7d". See SearchQuery::parse.
+struct SearchQuery {
+  // The first plain word. The index looks it up by trigram and fuzzy
+  // searches rank by it; every other filter is in `terms`.
+  std::string text;
+  std::vector<QueryTerm> terms;
+  // Literal the file contents must contain; empty for a name-only search.
+  // Not part of the text format, callers set it directly.
+  std::string content;
+  // Matches `content` as a case-sensitive regular expression instead, and
+  // content_matches counts the matching lines like grep -c.
+  bool content_regex = false;
+  // Matches the text as a subsequence instead of a substring and delivers
+  // only the best `rank_limit` hits, best first, once the search is done.
+  // Also set by callers.
+  bool fuzzy = false;
+  size_t rank_limit = kDefaultRankLimit;
+  // Stop the whole search once this many results have been delivered (0 for
+  // no limit; fuzzy searches are bounded by rank_limit instead) or once
+  // `time_limit` has passed (0 for none). Either marks the search truncated.
+  size_t max_results = 0;
+  std::chrono::milliseconds time_limit{0};
+  // What the search leaves out, see IgnoreSettings; null searches
+  // everything. Also set by callers.
+  std::shared_ptr<const IgnoreSettings> ignore;
+  // Remembers what reading file contents found, so files unchanged since
+  // are not read again; see ContentCache. Null reads every file. Also set
+  // by callers.
+  std::shared_ptr<ContentCache> cache;
+
+  static constexpr size_t kDefaultRankLimit = 1000;
+
+  // Parses the text format. Each term is one of
+  //   word, "quoted words"     path below the root contains it
+  //   *.c, src/*/test?.py      glob over the name, or the path if it has a '/'
+  //   name:X, path:X           X (a word or glob) against the name or the path
+  //   regex:_test\.cc$         regular expression over the path, see Regex
+  //   ext:c,h  extension:.c    any of the extensions
+  //   size:>10k  size:1m..2g   size in bytes, with k/m/g/t units of 1024
+  //   mtime:>2024-01-31        modified after that day (local time)
+  //   mtime:<7d  mtime:2h      modified over 7 days ago / within 2 hours (s m h d w y)
+  // with ranges written "<X", "<=X", ">X", ">=X", "A..B" or "X". A leading '-'
+  // or '!' negates a term and \" stands for a quote inside quotes. Values
+  // that do not parse are searched for as text.
+  static SearchQuery parse(std::string_view query);
+
+  // True if, under the same root, every file this query matches is also
+  // matched by `previous`: the text contains the previous text, every term
+  // of `previous` is still there, the contents are searched for the same
+  // literal or pattern and the same paths are ignored. The complete results of `previous` can then be narrowed with
+  // SearchEngine::filter instead of searching again. Fuzzy queries never
+  // refine, since their results are cut to the best ranked.
+  bool refines(const SearchQuery &previous) const;
+};
+
+// One matching file. `content_matches` is the number of occurrences of the
+// content literal and stays 0 for name-only searches; `score` is only set by
+// fuzzy searches.
+struct SearchHit {
+  std::string path;
+  uint32_t content_matches = 0;
+  int32_t score = 0;
+};
+
+// Live counters of one search. Workers add to them in batches rather than per
+// entry; any thread may sample them at any time, e.g. once per frame.
+struct SearchProgress {
+  std::atomic<uint64_t> files_seen{0};
+  std::atomic<uint64_t> directories_done{0};
+  std::atomic<uint64_t> directories_pending{0};
+  std::atomic<uint64_t> matches{0};
+  // Fraction of the work done, from directories (or index entries) visited
+  // rather than matches found. Never moves backwards.
+  std::atomic<double> estimate{0.0};
+  // Set when max_results or time_limit stopped the search; more files may
+  // have matched.
+  std::atomic<bool> truncated{false};
+
+  // Filled in when the search returns; read it only after that.
+  SearchStats stats;
+  // If set before the search starts, receives a span per slow directory and
+  // per result delivery.
+  TraceRecorder *trace = nullptr;
+};
+
+class SearchEngine {
+public:
+  using ProgressCallback = std::function<void(double progress)>;
+  // Called from worker threads with batches of hits, never concurrently.
+  using ResultCallback = std::function<void(const std::vector<SearchHit> &batch)>;
+
+  explicit SearchEngine(unsigned thread_count = 0);
+
+  // Returns the full paths of all files below `directory` whose path relative
+  // to `directory` contains the query text, ignoring case. With a content
+  // literal, only files that also contain it are returned. Fuzzy queries
+  // return their ranked hits, best first.
+  std::vector<std::string> search(const SearchQuery &query, const std::string &directory,
+                                  const ProgressCallback &progress = nullptr);
+
+  // Streams matches as they are found. A batch is flushed once it is full or
+  // has been held for a few milliseconds, so early matches show up quickly.
+  // Setting `cancel` stops the walk after the directory buffer being read;
+  // no batch is delivered once it has been observed. `live`, if given, is kept
+  // current while the search runs. Fuzzy queries deliver all their batches at
+  // the end, in rank order.
+  void search(const SearchQuery &query, const std::string &directory,
+              const ResultCallback &on_results, const ProgressCallback &progress = nullptr,
+              const std::atomic<bool> *cancel = nullptr, SearchProgress *live = nullptr);
+
+  // Marks which of `paths`, results of an earlier search of `directory`,
+  // `query` matches. Only size and time terms touch the filesystem, with one
+  // stat per path, so the paths have to be NUL-terminated for those. Content
+  // matches are taken as given. Runs on all threads for large sets.
+  std::vector<uint8_t> filter(const SearchQuery &query, const std::string &directory,
+                              const std::vector<std::string_view> &paths) const;
+
+private:
+  unsigned threads;
+};
+
+} // namespace orion
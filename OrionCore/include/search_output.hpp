@@ -0,0 +1,294 @@
+#pragma once
+
+#include "search_engine.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace orion {
+
+// Collects matches per worker and hands them to the result callback in
+// batches. A batch is flushed once it is full or has been held for
+// kMaxBatchDelay, checked whenever a match is added or tick() is called.
+//
+// With a `rank_limit` nothing is delivered while the workers run. Each keeps
+// its best `rank_limit` hits in a bounded heap instead, and flush_all()
+// merges the heaps and delivers the overall best, best first. Ranking costs
+// O(n log k) and never sorts the full result set.
+//
+// The batcher also decides when a search is over: stop_signal() is set once
+// the caller cancels, max_results have been delivered or the time limit has
+// passed, and the workers pass it on to whatever they are looping over.
+class ResultBatcher {
+public:
+  static constexpr size_t kBatchSize = 256;
+  static constexpr auto kMaxBatchDelay = std::chrono::milliseconds(10);
+
+  ResultBatcher(unsigned workers, const SearchQuery &query,
+                const SearchEngine::ResultCallback &on_results, const std::atomic<bool> *cancel,
+                SearchProgress *live = nullptr)
+      : states(workers), on_results(on_results), cancel(cancel), live(live),
+        rank_limit(query.fuzzy ? query.rank_limit : 0),
+        max_results(query.fuzzy ? 0 : query.max_results),
+        batch_size(max_results ? std::min(kBatchSize, max_results) : kBatchSize),
+        has_deadline(query.time_limit.count() > 0),
+        deadline(Clock::now() + query.time_limit) {
+    if (live && live->trace) {
+      live->trace->prepare(workers);
+    }
+  }
+
+  void add(unsigned worker, std::string_view path, uint32_t content_matches = 0,
+           int32_t score = 0) {
+    WorkerState &state = states[worker];
+    if (rank_limit) {
+      offer(state, path, content_matches, score);
+      return;
+    }
+    if (stopped()) return;
+    if (state.batch.empty()) {
+      state.started = Clock::now();
+    }
+    state.batch.push_back(SearchHit{std::string(path), content_matches});
+    if (state.batch.size() >= batch_size || Clock::now() - state.started >= kMaxBatchDelay) {
+      flush(worker);
+    }
+  }
+
+  // Also where the workers notice cancellation and the time limit.
+  void tick(unsigned worker) {
+    WorkerState &state = states[worker];
+    if (cancel && cancel->load(std::memory_order_relaxed)) {
+      stop.store(true, std::memory_order_relaxed);
+    } else if (has_deadline && Clock::now() >= deadline) {
+      truncate();
+    }
+    if (rank_limit) {
+      publish_matches(state);
+      return;
+    }
+    if (!state.batch.empty() && Clock::now() - state.started >= kMaxBatchDelay) {
+      flush(worker);
+    }
+  }
+
+  void flush_all() {
+    if (rank_limit) {
+      deliver_ranked();
+      return;
+    }
+    for (unsigned worker = 0; worker < states.size(); worker++) {
+      flush(worker);
+    }
+  }
+
+  using Clock = std::chrono::steady_clock;
+
+  const std::atomic<bool> *stop_signal() const { return &stop; }
+  bool stopped() const { return stop.load(std::memory_order_relaxed); }
+  bool truncated() const { return truncated_flag.load(std::memory_order_relaxed); }
+
+  // Time spent in the result callback, and when it was first called. Read
+  // once the workers are done.
+  uint64_t delivery_nanoseconds() const { return deliver_ns; }
+  Clock::time_point first_delivery() const { return first_delivered; }
+
+private:
+  struct WorkerState {
+    std::vector<SearchHit> batch;
+    Clock::time_point started;
+    // A heap with the worst kept hit on top, and matches not yet counted in
+    // the live progress.
+    std::vector<SearchHit> ranked;
+    uint64_t unpublished = 0;
+  };
+
+  std::vector<WorkerState> states;
+  const SearchEngine::ResultCallback &on_results;
+  const std::atomic<bool> *cancel;
+  SearchProgress *live;
+  std::mutex mutex;
+  size_t rank_limit;
+  size_t max_results;
+  size_t batch_size;
+  bool has_deadline;
+  Clock::time_point deadline;
+  size_t delivered = 0;
+  std::atomic<bool> stop{false};
+  std::atomic<bool> truncated_flag{false};
+  uint64_t deliver_ns = 0;
+  Clock::time_point first_delivered{};
+
+  // Higher scores first, then shorter paths, then alphabetical.
+  static bool ranks_before(int32_t score, std::string_view path, const SearchHit &other) {
+    if (score != other.score) return score > other.score;
+    if (path.size() != other.path.size()) return path.size() < other.path.size();
+    return path < other.path;
+  }
+  static bool better(const SearchHit &a, const SearchHit &b) {
+    return ranks_before(a.score, a.path, b);
+  }
+
+  // Only copies the path when the hit makes it into the heap.
+  void offer(WorkerState &state, std::string_view path, uint32_t content_matches,
+             int32_t score) {
+    state.unpublished++;
+    std::vector<SearchHit> &heap = state.ranked;
+    if (heap.size() >= rank_limit) {
+      if (!ranks_before(score, path, heap.front())) return;
+      std::pop_heap(heap.begin(), heap.end(), better);
+      heap.pop_back();
+    }
+    heap.push_back(SearchHit{std::string(path), content_matches, score});
+    std::push_heap(heap.begin(), heap.end(), better);
+  }
+
+  void truncate() {
+    truncated_flag.store(true, std::memory_order_relaxed);
+    stop.store(true, std::memory_order_relaxed);
+    if (live) {
+      live->truncated.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  void publish_matches(WorkerState &state) {
+    if (live && state.unpublished) {
+      live->matches.fetch_add(state.unpublished, std::memory_order_relaxed);
+    }
+    state.unpublished = 0;
+  }
+
+  void deliver_ranked() {
+    std::vector<SearchHit> &merged = states[0].ranked;
+    publish_matches(states[0]);
+    for (size_t worker = 1; worker < states.size(); worker++) {
+      publish_matches(states[worker]);
+      std::vector<SearchHit> &ranked = states[worker].ranked;
+      std::move(ranked.begin(), ranked.end(), std::back_inserter(merged));
+      ranked.clear();
+    }
+    if (merged.size() > rank_limit) {
+      std::nth_element(merged.begin(), merged.begin() + rank_limit, merged.end(), better);
+      merged.resize(rank_limit);
+    }
+    std::sort(merged.begin(), merged.end(), better);
+
+    for (size_t first = 0; first < merged.size(); first += kBatchSize) {
+      size_t last = std::min(merged.size(), first + kBatchSize);
+      std::vector<SearchHit> &batch = states[0].batch;
+      batch.assign(std::make_move_iterator(merged.begin() + first),
+                   std::make_move_iterator(merged.begin() + last));
+      deliver(0, batch, false);
+      batch.clear();
+    }
+    merged.clear();
+  }
+
+  void flush(unsigned worker) {
+    WorkerState &state = states[worker];
+    if (state.batch.empty()) return;
+    deliver(worker, state.batch, true);
+    state.batch.clear();
+  }
+
+  // Trims the batch to what is left of max_results.
+  void deliver(unsigned worker, std::vector<SearchHit> &batch, bool count_matches) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cancel && cancel->load(std::memory_order_relaxed)) return;
+    if (max_results) {
+      if (delivered >= max_results) return;
+      if (batch.size() > max_results - delivered) {
+        batch.resize(max_results - delivered);
+      }
+      delivered += batch.size();
+      if (delivered == max_results) {
+        truncate();
+      }
+    }
+    auto begin = Clock::now();
+    on_results(batch);
+    auto end = Clock::now();
+    deliver_ns += elapsed_ns(begin, end);
+    if (first_delivered == Clock::time_point()) {
+      first_delivered = begin;
+    }
+    if (live) {
+      if (count_matches) {
+        live->matches.fetch_add(batch.size(), std::memory_order_relaxed);
+      }
+      if (live->trace) {
+        live->trace->add(worker, "deliver", begin, end);
+      }
+    }
+  }
+};
+
+// Completes `stats` once the workers are done: delivery and first-result
+// times from the batcher, and match time as whatever part of `busy_ns` was
+// not spent reading contents or delivering.
+inline void finish_stats(SearchStats &stats, const SearchProgress &live,
+                         const ResultBatcher &batcher, ResultBatcher::Clock::time_point started,
+                         uint64_t busy_ns) {
+  auto now = ResultBatcher::Clock::now();
+  stats.matches = live.matches.load(std::memory_order_relaxed);
+  stats.deliver_ns = batcher.delivery_nanoseconds();
+  uint64_t accounted = stats.read_ns + stats.deliver_ns;
+  stats.match_ns = busy_ns > accounted ? busy_ns - accounted : 0;
+  if (batcher.first_delivery() != ResultBatcher::Clock::time_point()) {
+    stats.first_result_ns = elapsed_ns(started, batcher.first_delivery());
+  }
+  stats.wall_ns = elapsed_ns(started, now);
+}
+
+// Forwards progress from several workers without ever moving backwards, to a
+// callback and/or a set of live counters. Only the callback takes a lock.
+class ProgressReporter {
+public:
+  ProgressReporter(const SearchEngine::ProgressCallback &progress, SearchProgress *live)
+      : progress(progress), live(live) {}
+
+  explicit operator bool() const { return progress || live; }
+
+  void report(double fraction) {
+    if (live) {
+      double current = live->estimate.load(std::memory_order_relaxed);
+      while (fraction > current &&
+             !live->estimate.compare_exchange_weak(current, fraction, std::memory_order_relaxed)) {
+      }
+    }
+    if (progress) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (fraction > last) {
+        last = fraction;
+        progress(fraction);
+      }
+    }
+  }
+
+  void add_files(uint64_t count) {
+    if (live && count) {
+      live->files_seen.fetch_add(count, std::memory_order_relaxed);
+    }
+  }
+
+  void set_directories(uint64_t done, uint64_t pending) {
+    if (live) {
+      live->directories_done.store(done, std::memory_order_relaxed);
+      live->directories_pending.store(pending, std::memory_order_relaxed);
+    }
+  }
+
+private:
+  const SearchEngine::ProgressCallback &progress;
+  SearchProgress *live;
+  std::mutex mutex;
+  double last = 0.0;
+};
+
+} // namespace orion
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace orion {
+
+// A job (a search, an index refresh, ...) running on its own thread that can
+// be cancelled cooperatively. Destroying a session cancels it and waits for
+// the job to return.
+class SearchSession {
+public:
+  using Job = std::function<void(const std::atomic<bool> *cancel)>;
+  using CompletionCallback = std::function<void(bool cancelled)>;
+
+  SearchSession(Job job, CompletionCallback on_complete);
+  ~SearchSession();
+
+  SearchSession(const SearchSession &) = delete;
+  SearchSession &operator=(const SearchSession &) = delete;
+
+  void cancel() { cancel_flag.store(true, std::memory_order_relaxed); }
+  bool cancelled() const { return cancel_flag.load(std::memory_order_relaxed); }
+  // True once the job has returned, before the completion callback runs.
+  bool finished() const { return finished_flag.load(std::memory_order_acquire); }
+  void wait();
+
+private:
+  std::atomic<bool> cancel_flag{false};
+  std::atomic<bool> finished_flag{false};
+  std::mutex join_mutex;
+  std::thread runner;
+};
+
+} // namespace orion
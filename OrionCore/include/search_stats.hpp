@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace orion {
+
+// Where the time of one search went. Durations are summed over workers and
+// can add up to more than wall_ns; idle_ns is time workers spent waiting for
+// another worker to find directories.
+struct SearchStats {
+  uint64_t directories_opened = 0;
+  uint64_t entries_read = 0;
+  uint64_t stat_calls = 0;
+  // Left out by ignore rules; see WalkStats.
+  uint64_t directories_skipped = 0;
+  uint64_t files_read = 0;
+  uint64_t bytes_read = 0;
+  // Files the ContentCache answered for, without reading them.
+  uint64_t cache_hits = 0;
+  uint64_t matches = 0;
+
+  uint64_t open_ns = 0;
+  uint64_t enumerate_ns = 0;
+  uint64_t stat_ns = 0;
+  // Name matching and filtering: what is left of the time spent visiting
+  // entries once reading contents and delivering results are taken out.
+  uint64_t match_ns = 0;
+  uint64_t read_ns = 0;
+  // Result callbacks, including the bridge's marshalling.
+  uint64_t deliver_ns = 0;
+  uint64_t idle_ns = 0;
+  uint64_t first_result_ns = 0;
+  uint64_t wall_ns = 0;
+};
+
+// Collects timed spans per worker and writes them as a Chrome trace-event
+// file (chrome://tracing, Perfetto). Each worker appends only to its own
+// list, so recording takes no lock.
+class TraceRecorder {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Shorter spans are dropped to keep traces of large walks small.
+  static constexpr auto kMinSpan = std::chrono::microseconds(50);
+  static constexpr size_t kMaxSpansPerWorker = 100000;
+
+  TraceRecorder() : origin(Clock::now()) {}
+
+  // Called before the workers start.
+  void prepare(unsigned workers) { spans.resize(workers); }
+
+  void add(unsigned worker, const char *name, Clock::time_point begin, Clock::time_point end,
+           std::string_view detail = {}) {
+    if (worker >= spans.size() || end - begin < kMinSpan) return;
+    auto &list = spans[worker];
+    if (list.size() >= kMaxSpansPerWorker) return;
+    list.push_back(Span{name, begin, end, std::string(detail)});
+  }
+
+  // Writes the spans plus `stats` as counters. Returns false if the file
+  // could not be written.
+  bool write(const std::string &path, const SearchStats &stats) const;
+
+private:
+  struct Span {
+    const char *name;
+    Clock::time_point begin;
+    Clock::time_point end;
+    std::string detail;
+  };
+
+  Clock::time_point origin;
+  std::vector<std::vector<Span>> spans;
+};
+
+inline uint64_t elapsed_ns(std::chrono::steady_clock::time_point begin,
+                           std::chrono::steady_clock::time_point end) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+}
+
+} // namespace orion
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace orion {
+
+// Work-stealing scheduler for tree traversals where processing a task can
+// produce more tasks. Each worker keeps its own deque: it pushes and pops at
+// the back, so it works depth-first on the directories it just found, while
+// idle workers steal from the front of other deques, where the oldest and
+// usually largest subtrees are. run() returns once every deque is empty and
+// no worker is still processing a task that could refill one.
+template <typename Task> class TaskQueue {
+public:
+  explicit TaskQueue(unsigned workers) : deques(workers > 0 ? workers : 1) {}
+
+  TaskQueue(const TaskQueue &) = delete;
+  TaskQueue &operator=(const TaskQueue &) = delete;
+
+  // Adds tasks to `worker`'s deque.
+  void push(unsigned worker, std::vector<Task> &tasks) {
+    if (tasks.empty()) return;
+    // Counted before the tasks become visible, so no worker can see the
+    // outstanding count reach zero while they are queued.
+    outstanding.fetch_add(tasks.size());
+    {
+      Deque &deque = deques[worker % deques.size()];
+      std::lock_guard<std::mutex> lock(deque.mutex);
+      for (auto &task : tasks) {
+        deque.tasks.push_back(std::move(task));
+      }
+    }
+    queued.fetch_add(static_cast<std::ptrdiff_t>(tasks.size()));
+    tasks.clear();
+    if (sleeping.load() > 0) {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      wake.notify_all();
+    }
+  }
+
+  // `process(worker, task, children)` may append follow-up tasks to
+  // `children`; they are pushed onto this worker's own deque.
+  template <typename Process> void run(unsigned worker, Process &&process) {
+    std::vector<Task> children;
+    Task task;
+    while (next(worker, task)) {
+      process(worker, task, children);
+      push(worker, children);
+      if (outstanding.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wake.notify_all();
+      }
+    }
+  }
+
+  uint64_t steals() const { return steal_count.load(std::memory_order_relaxed); }
+  // Total time workers spent asleep waiting for tasks.
+  uint64_t idle_nanoseconds() const { return idle_ns.load(std::memory_order_relaxed); }
+
+private:
+  struct alignas(64) Deque {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<Deque> deques;
+  std::atomic<size_t> outstanding{0};
+  // Can dip below zero while a task is taken before its push is counted.
+  std::atomic<std::ptrdiff_t> queued{0};
+  std::atomic<unsigned> sleeping{0};
+  std::atomic<uint64_t> steal_count{0};
+  std::atomic<uint64_t> idle_ns{0};
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+
+  bool pop(unsigned worker, Task &task) {
+    Deque &deque = deques[worker % deques.size()];
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    if (deque.tasks.empty()) return false;
+    task = std::move(deque.tasks.back());
+    deque.tasks.pop_back();
+    return true;
+  }
+
+  bool steal(unsigned worker, Task &task) {
+    for (size_t i = 1; i < deques.size(); i++) {
+      Deque &victim = deques[(worker + i) % deques.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (victim.tasks.empty()) continue;
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      steal_count.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  // Blocks until a task is available or all work is done.
+  bool next(unsigned worker, Task &task) {
+    for (;;) {
+      if (queued.load() > 0 && (pop(worker, task) || steal(worker, task))) {
+        queued.fetch_sub(1);
+        return true;
+      }
+      if (outstanding.load() == 0) return false;
+
+      // push() reads `sleeping` after publishing to `queued`, and a sleeper
+      // re-checks `queued` after registering, so no wakeup is lost.
+      auto asleep = std::chrono::steady_clock::now();
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      sleeping.fetch_add(1);
+      wake.wait(lock, [this] { return queued.load() > 0 || outstanding.load() == 0; });
+      sleeping.fetch_sub(1);
+      idle_ns.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                  std::chrono::steady_clock::now() - asleep)
+                                                  .count()),
+                        std::memory_order_relaxed);
+    }
+  }
+};
+
+// Maps a requested thread count of 0 to one thread per hardware thread.
+inline unsigned resolve_thread_count(unsigned requested) {
+  if (requested > 0) return requested;
+  unsigned hardware = std::thread::hardware_concurrency();
+  return hardware > 0 ? hardware : 1;
+}
+
+// Runs `fn(worker)` on `threads` threads, using the calling thread as worker 0.
+template <typename Fn> void run_on_threads(unsigned threads, Fn &&fn) {
+  std::vector<std::thread> workers;
+  workers.reserve(threads > 0 ? threads - 1 : 0);
+  for (unsigned i = 1; i < threads; i++) {
+    workers.emplace_back([&fn, i] { fn(i); });
+  }
+  fn(0u);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+} // namespace orion
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace orion {
+
+class FileIndex;
+
+// Posting lists of the case-folded trigrams of every name in a FileIndex.
+// Trigrams are hashed into a table sized for the index, so a lookup returns
+// a superset of the nodes whose name contains the needle; callers verify the
+// candidates with a Matcher.
+class TrigramIndex {
+public:
+  explicit TrigramIndex(const FileIndex &index);
+
+  // Nodes whose name contains every trigram of `folded_needle`, in ascending
+  // order. Returns false if the needle is too short or not plain ASCII, in
+  // which case the index cannot narrow the search.
+  bool candidates(std::string_view folded_needle, std::vector<uint32_t> &result) const;
+
+  size_t memory_bytes() const {
+    return offsets.capacity() * sizeof(uint32_t) + postings.capacity() * sizeof(uint32_t);
+  }
+
+private:
+  unsigned bucket_bits;
+  // Postings of bucket b are postings[offsets[b], offsets[b + 1]).
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> postings;
+};
+
+} // namespace orion
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace orion {
+
+enum class EntryType : uint8_t { Unknown, File, Directory, Symlink, Other };
+
+struct EntryMetadata {
+  uint64_t size = 0;
+  int64_t mtime_ns = 0;
+  // Tell hard links to one file apart from copies.
+  uint64_t device = 0;
+  uint64_t inode = 0;
+};
+
+struct DirEntry {
+  // Full path of the containing directory, without a trailing slash.
+  std::string_view dir_path;
+  std::string_view name;
+  // Taken from the directory entry; only entries the filesystem reports as
+  // DT_UNKNOWN cost a stat during the walk.
+  EntryType type;
+  // Descriptor of the containing directory, valid during the visitor call.
+  int dir_fd;
+
+  // Stats the entry on demand, for queries that need size or mtime.
+  bool metadata(EntryMetadata &out) const;
+};
+
+// Counters and timings of one walk, summed over workers.
+struct WalkStats {
+  uint64_t directories_opened = 0;
+  uint64_t entries_read = 0;
+  uint64_t stat_calls = 0;
+  // Directories left out by ignore rules, and so never opened.
+  uint64_t directories_skipped = 0;
+  uint64_t open_ns = 0;
+  uint64_t enumerate_ns = 0;
+  uint64_t stat_ns = 0;
+  // Time spent in the visitor.
+  uint64_t visit_ns = 0;
+  uint64_t idle_ns = 0;
+};
+
+struct IgnoreSettings;
+class TraceRecorder;
+
+// Strips trailing slashes so paths can be joined with a single '/'.
+std::string normalize_directory(std::string path);
+
+// Walks a directory tree on several threads. Directories are read with
+// getdents64 (readdir elsewhere) and opened with openat relative to the
+// parent's descriptor, so no path is resolved from the root more than once.
+class ParallelWalker {
+public:
+  // Called from worker threads; `worker` is in [0, thread_count()).
+  using Visitor = std::function<void(unsigned worker, const DirEntry &entry)>;
+
+  explicit ParallelWalker(unsigned thread_count = 0);
+
+  unsigned thread_count() const { return threads; }
+
+  // Returns false if the root itself could not be opened.
+  bool walk(const std::string &root, const Visitor &visitor,
+            const std::atomic<bool> *cancel = nullptr);
+
+  uint64_t directories_done() const { return dirs_done.load(std::memory_order_relaxed); }
+  uint64_t directories_pending() const { return dirs_pending.load(std::memory_order_relaxed); }
+
+  // Valid once walk() has returned. Collecting them costs a few clock reads
+  // per directory.
+  const WalkStats &stats() const { return walk_stats; }
+  // Records a span for every directory that takes a while to process.
+  void set_trace(TraceRecorder *recorder) { trace = recorder; }
+  // Leaves out what `settings` excludes: the visitor never sees those
+  // entries and excluded directories are not opened. Null walks everything.
+  void set_ignore(const IgnoreSettings *settings) { ignore = settings; }
+
+private:
+  unsigned threads;
+  WalkStats walk_stats;
+  TraceRecorder *trace = nullptr;
+  const IgnoreSettings *ignore = nullptr;
+  std::atomic<uint64_t> dirs_done{0};
+  std::atomic<uint64_t> dirs_pending{0};
+};
+
+} // namespace orion
@@ -0,0 +1,421 @@
+#include "bridge.h"
+#include "content_cache.hpp"
+#include "duplicate_finder.hpp"
+#include "file_index.hpp"
+#include "ignore_rules.hpp"
+#include "index_watcher.hpp"
+#include "result_sort.hpp"
+#include "search_engine.hpp"
+#include "search_session.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct orion_search_handle {
+  std::shared_ptr<orion::SearchProgress> progress;
+  std::unique_ptr<orion::SearchSession> session;
+};
+
+struct orion_index {
+  std::shared_ptr<orion::IndexStore> store;
+  std::unique_ptr<orion::IndexWatcher> watcher;
+};
+
+namespace {
+
+orion::SearchEngine::ProgressCallback wrap_progress(orion_progress_callback progress_cb,
+                                                    void *user_data) {
+  if (!progress_cb) return nullptr;
+  return [progress_cb, user_data](double fraction) { progress_cb(fraction, user_data); };
+}
+
+orion::SearchEngine::ResultCallback wrap_results(orion_results_callback results_cb,
+                                                 void *user_data) {
+  auto view = std::make_shared<std::vector<orion_search_result_t>>();
+  return [view, results_cb, user_data](const std::vector<orion::SearchHit> &batch) {
+    view->resize(batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+      (*view)[i].path = batch[i].path.c_str();
+      (*view)[i].length = static_cast<int32_t>(batch[i].path.size());
+      (*view)[i].match_count = static_cast<int32_t>(batch[i].content_matches);
+      (*view)[i].score = batch[i].score;
+    }
+    results_cb(view->data(), static_cast<int32_t>(view->size()), user_data);
+  };
+}
+
+orion::SearchSession::CompletionCallback wrap_completion(orion_completion_callback completion_cb,
+                                                        void *user_data) {
+  if (!completion_cb) return nullptr;
+  return [completion_cb, user_data](bool cancelled) { completion_cb(cancelled ? 1 : 0, user_data); };
+}
+
+// One cache per file for the life of the process, so it is loaded and
+// compacted once and shared by every search.
+std::shared_ptr<orion::ContentCache> open_cache(const std::string &path) {
+  static std::mutex mutex;
+  static std::map<std::string, std::shared_ptr<orion::ContentCache>> caches;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<orion::ContentCache> &cache = caches[path];
+  if (!cache) {
+    cache = orion::ContentCache::open(path);
+  }
+  return cache;
+}
+
+orion::SearchQuery parse_query(const char *query, const orion_search_options_t *options) {
+  orion::SearchQuery parsed = orion::SearchQuery::parse(query);
+  if (!options) return parsed;
+  if (options->content) {
+    parsed.content = options->content;
+    parsed.content_regex = options->content_regex != 0;
+  }
+  if (options->fuzzy) {
+    parsed.fuzzy = true;
+    if (options->rank_limit > 0) {
+      parsed.rank_limit = static_cast<size_t>(options->rank_limit);
+    }
+  }
+  if (options->max_results > 0) {
+    parsed.max_results = static_cast<size_t>(options->max_results);
+  }
+  if (options->time_limit_ms > 0) {
+    parsed.time_limit = std::chrono::milliseconds(options->time_limit_ms);
+  }
+  if (options->ignore) {
+    auto ignore = std::make_shared<orion::IgnoreSettings>();
+    ignore->ignore_files = options->no_ignore_files == 0;
+    if (options->excludes) {
+      ignore->excludes.clear();
+      std::string_view excludes = options->excludes;
+      while (!excludes.empty()) {
+        size_t end = std::min(excludes.find('\n'), excludes.size());
+        if (end > 0) {
+          ignore->excludes.emplace_back(excludes.substr(0, end));
+        }
+        excludes.remove_prefix(std::min(end + 1, excludes.size()));
+      }
+    }
+    parsed.ignore = std::move(ignore);
+  }
+  if (options->cache_path) {
+    parsed.cache = open_cache(options->cache_path);
+  }
+  return parsed;
+}
+
+std::string trace_path(const orion_search_options_t *options) {
+  return options && options->trace_path ? options->trace_path : "";
+}
+
+// `run` is called as run(cancel, live) on the session thread. The counters
+// are shared with the handle so they can be sampled while the job runs. With
+// a `trace` path the job's spans are recorded and written there once it ends.
+template <typename Run>
+orion_search_handle_t *start_session(Run run,
+                                     orion::SearchSession::CompletionCallback on_complete,
+                                     std::string trace = std::string()) {
+  auto *handle = new orion_search_handle;
+  handle->progress = std::make_shared<orion::SearchProgress>();
+  handle->session = std::make_unique<orion::SearchSession>(
+      [run = std::move(run), live = handle->progress,
+       trace = std::move(trace)](const std::atomic<bool> *cancel) {
+        if (trace.empty()) {
+          run(cancel, live.get());
+          return;
+        }
+        orion::TraceRecorder recorder;
+        live->trace = &recorder;
+        run(cancel, live.get());
+        live->trace = nullptr;
+        recorder.write(trace, live->stats);
+      },
+      std::move(on_complete));
+  return handle;
+}
+
+} // namespace
+
+extern "C" {
+
+orion_search_results_t *orion_search_files(const char *query, const char *directory,
+                                           orion_progress_callback progress_cb, void *user_data) {
+  // Paths go straight from the batches into one arena, so the engine never
+  // holds every result as its own string.
+  std::string arena;
+  std::vector<int32_t> lengths;
+  orion::SearchEngine engine;
+  engine.search(
+      orion::SearchQuery::parse(query), directory,
+      [&](const std::vector<orion::SearchHit> &batch) {
+        for (const orion::SearchHit &hit : batch) {
+          arena.append(hit.path.c_str(), hit.path.size() + 1);
+          lengths.push_back(static_cast<int32_t>(hit.path.size()));
+        }
+      },
+      wrap_progress(progress_cb, user_data));
+
+  constexpr size_t table_offset =
+      (sizeof(orion_search_results_t) + alignof(orion_search_result_t) - 1) /
+      alignof(orion_search_result_t) * alignof(orion_search_result_t);
+  const size_t arena_offset = table_offset + sizeof(orion_search_result_t) * lengths.size();
+
+  char *block = static_cast<char *>(malloc(arena_offset + arena.size()));
+  if (!block) return nullptr;
+  auto *results = reinterpret_cast<orion_search_results_t *>(block);
+  auto *table = reinterpret_cast<orion_search_result_t *>(block + table_offset);
+  char *paths = block + arena_offset;
+  memcpy(paths, arena.data(), arena.size());
+
+  results->count = static_cast<int32_t>(lengths.size());
+  results->results = lengths.empty() ? nullptr : table;
+  for (int32_t length : lengths) {
+    table->path = paths;
+    table->length = length;
+    table->match_count = 0;
+    table->score = 0;
+    table++;
+    paths += length + 1;
+  }
+  return results;
+}
+
+void orion_sort_order(const orion_search_result_t *results, int32_t count, int32_t key,
+                      int32_t descending, int32_t *order) {
+  std::vector<orion::SortItem> items(static_cast<size_t>(std::max(count, 0)));
+  for (size_t i = 0; i < items.size(); i++) {
+    items[i].path = orion_result_path(results[i]);
+    items[i].content_matches = static_cast<uint32_t>(std::max(results[i].match_count, 0));
+  }
+  orion::SortKey sort_key = orion::SortKey::Path;
+  switch (key) {
+  case ORION_SORT_NAME: sort_key = orion::SortKey::Name; break;
+  case ORION_SORT_SIZE: sort_key = orion::SortKey::Size; break;
+  case ORION_SORT_MODIFIED: sort_key = orion::SortKey::ModifiedTime; break;
+  case ORION_SORT_MATCHES: sort_key = orion::SortKey::Matches; break;
+  }
+  std::vector<uint32_t> sorted = orion::sort_order(items, sort_key, descending != 0);
+  for (size_t i = 0; i < sorted.size(); i++) {
+    order[i] = static_cast<int32_t>(sorted[i]);
+  }
+}
+
+int32_t orion_query_refines(const char *query, const orion_search_options_t *options,
+                            const char *previous, const orion_search_options_t *previous_options) {
+  return parse_query(query, options).refines(parse_query(previous, previous_options)) ? 1 : 0;
+}
+
+void orion_filter_results(const orion_search_result_t *results, int32_t count, const char *query,
+                          const orion_search_options_t *options, const char *directory,
+                          uint8_t *keep) {
+  std::vector<std::string_view> paths(static_cast<size_t>(std::max(count, 0)));
+  for (size_t i = 0; i < paths.size(); i++) {
+    paths[i] = orion_result_path(results[i]);
+  }
+  std::vector<uint8_t> kept =
+      orion::SearchEngine().filter(parse_query(query, options), directory, paths);
+  std::copy(kept.begin(), kept.end(), keep);
+}
+
+void orion_search_files_streaming(const char *query, const char *directory,
+                                  orion_results_callback results_cb,
+                                  orion_progress_callback progress_cb, void *user_data) {
+  orion::SearchEngine engine;
+  engine.search(orion::SearchQuery::parse(query), directory, wrap_results(results_cb, user_data),
+                wrap_progress(progress_cb, user_data));
+}
+
+orion_search_handle_t *orion_search_start(const char *query, const char *directory,
+                                          const orion_search_options_t *options,
+                                          orion_results_callback results_cb,
+                                          orion_progress_callback progress_cb,
+                                          orion_completion_callback completion_cb,
+                                          void *user_data) {
+  return start_session(
+      [query = parse_query(query, options), directory = std::string(directory),
+       on_results = wrap_results(results_cb, user_data),
+       progress = wrap_progress(progress_cb, user_data)](const std::atomic<bool> *cancel,
+                                                         orion::SearchProgress *live) {
+        orion::SearchEngine engine;
+        engine.search(query, directory, on_results, progress, cancel, live);
+      },
+      wrap_completion(completion_cb, user_data), trace_path(options));
+}
+
+orion_search_handle_t *orion_duplicates_start(const char *query, const char *directory,
+                                              const orion_search_options_t *options,
+                                              int64_t min_size,
+                                              orion_duplicates_callback duplicates_cb,
+                                              orion_completion_callback completion_cb,
+                                              void *user_data) {
+  return start_session(
+      [query = parse_query(query, options), directory = std::string(directory),
+       min_size = static_cast<uint64_t>(std::max<int64_t>(min_size, 0)), duplicates_cb,
+       user_data](const std::atomic<bool> *cancel, orion::SearchProgress *live) {
+        std::vector<orion::DuplicateGroup> groups =
+            orion::DuplicateFinder().find(query, directory, min_size, cancel, live);
+        if (!duplicates_cb || (cancel && cancel->load())) return;
+
+        size_t file_count = 0;
+        for (const orion::DuplicateGroup &group : groups) {
+          file_count += group.paths.size();
+        }
+        std::vector<orion_search_result_t> files;
+        files.reserve(file_count);
+        std::vector<orion_duplicate_group_t> view(groups.size());
+        for (size_t i = 0; i < groups.size(); i++) {
+          view[i].size = static_cast<int64_t>(groups[i].size);
+          view[i].files = files.data() + files.size();
+          view[i].count = static_cast<int32_t>(groups[i].paths.size());
+          for (const std::string &path : groups[i].paths) {
+            files.push_back(
+                orion_search_result_t{path.c_str(), static_cast<int32_t>(path.size()), 0, 0});
+          }
+        }
+        duplicates_cb(view.data(), static_cast<int32_t>(view.size()), user_data);
+      },
+      wrap_completion(completion_cb, user_data), trace_path(options));
+}
+
+void orion_search_cancel(orion_search_handle_t *handle) {
+  if (handle) {
+    handle->session->cancel();
+  }
+}
+
+void orion_search_wait(orion_search_handle_t *handle) {
+  if (handle) {
+    handle->session->wait();
+  }
+}
+
+void orion_search_get_progress(const orion_search_handle_t *handle,
+                               orion_search_progress_t *progress) {
+  const orion::SearchProgress &live = *handle->progress;
+  progress->files_seen = static_cast<int64_t>(live.files_seen.load(std::memory_order_relaxed));
+  progress->directories_done =
+      static_cast<int64_t>(live.directories_done.load(std::memory_order_relaxed));
+  progress->directories_pending =
+      static_cast<int64_t>(live.directories_pending.load(std::memory_order_relaxed));
+  progress->matches = static_cast<int64_t>(live.matches.load(std::memory_order_relaxed));
+  progress->estimate = live.estimate.load(std::memory_order_relaxed);
+  progress->finished = handle->session->finished() ? 1 : 0;
+  progress->truncated = live.truncated.load(std::memory_order_relaxed) ? 1 : 0;
+}
+
+void orion_search_get_stats(const orion_search_handle_t *handle, orion_search_stats_t *stats) {
+  *stats = orion_search_stats_t();
+  if (!handle->session->finished()) return;
+  const orion::SearchStats &done = handle->progress->stats;
+  stats->directories_opened = static_cast<int64_t>(done.directories_opened);
+  stats->entries_read = static_cast<int64_t>(done.entries_read);
+  stats->stat_calls = static_cast<int64_t>(done.stat_calls);
+  stats->directories_skipped = static_cast<int64_t>(done.directories_skipped);
+  stats->files_read = static_cast<int64_t>(done.files_read);
+  stats->bytes_read = static_cast<int64_t>(done.bytes_read);
+  stats->cache_hits = static_cast<int64_t>(done.cache_hits);
+  stats->matches = static_cast<int64_t>(done.matches);
+  stats->open_ns = static_cast<int64_t>(done.open_ns);
+  stats->enumerate_ns = static_cast<int64_t>(done.enumerate_ns);
+  stats->stat_ns = static_cast<int64_t>(done.stat_ns);
+  stats->match_ns = static_cast<int64_t>(done.match_ns);
+  stats->read_ns = static_cast<int64_t>(done.read_ns);
+  stats->deliver_ns = static_cast<int64_t>(done.deliver_ns);
+  stats->idle_ns = static_cast<int64_t>(done.idle_ns);
+  stats->first_result_ns = static_cast<int64_t>(done.first_result_ns);
+  stats->wall_ns = static_cast<int64_t>(done.wall_ns);
+}
+
+void orion_search_free(orion_search_handle_t *handle) {
+  delete handle;
+}
+
+orion_index_t *orion_index_open(const char *root, const char *index_dir) {
+  auto *index = new orion_index;
+  index->store = std::make_shared<orion::IndexStore>(
+      root, orion::FileIndex::file_for_root(index_dir, root));
+  return index;
+}
+
+int64_t orion_index_entry_count(const orion_index_t *index) {
+  auto snapshot = index->store->snapshot();
+  return snapshot ? static_cast<int64_t>(snapshot->size()) : 0;
+}
+
+int64_t orion_index_memory_usage(const orion_index_t *index) {
+  auto snapshot = index->store->snapshot();
+  return snapshot ? static_cast<int64_t>(snapshot->memory_bytes()) : 0;
+}
+
+orion_search_handle_t *orion_index_refresh_start(orion_index_t *index,
+                                                 orion_completion_callback completion_cb,
+                                                 void *user_data) {
+  return start_session(
+      [store = index->store](const std::atomic<bool> *cancel, orion::SearchProgress *) {
+        store->refresh(0, cancel);
+      },
+      wrap_completion(completion_cb, user_data));
+}
+
+orion_search_handle_t *orion_index_search_start(orion_index_t *index, const char *query,
+                                                const orion_search_options_t *options,
+                                                orion_results_callback results_cb,
+                                                orion_progress_callback progress_cb,
+                                                orion_completion_callback completion_cb,
+                                                void *user_data) {
+  return start_session(
+      [snapshot = index->store->snapshot(), query = parse_query(query, options),
+       on_results = wrap_results(results_cb, user_data),
+       progress = wrap_progress(progress_cb, user_data)](const std::atomic<bool> *cancel,
+                                                         orion::SearchProgress *live) {
+        if (snapshot) {
+          snapshot->search(query, on_results, progress, 0, cancel, live);
+        }
+      },
+      wrap_completion(completion_cb, user_data), trace_path(options));
+}
+
+int32_t orion_index_watch_start(orion_index_t *index) {
+  if (!index->watcher) {
+    index->watcher = std::make_unique<orion::IndexWatcher>(index->store);
+  }
+  return index->watcher->start() ? 1 : 0;
+}
+
+void orion_index_watch_stop(orion_index_t *index) {
+  index->watcher.reset();
+}
+
+void orion_index_free(orion_index_t *index) {
+  delete index;
+}
+
+void orion_free_search_results(orion_search_results_t *results) {
+  free(results);
+}
+
+void orion_open_in_finder(const char *path) {
+  // Double fork so the opener is reparented to init and never left a zombie.
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (fork() == 0) {
+#if defined(__APPLE__)
+      execlp("open", "open", "-R", path, static_cast<char *>(nullptr));
+#else
+      execlp("xdg-open", "xdg-open", path, static_cast<char *>(nullptr));
+#endif
+    }
+    _exit(0);
+  }
+  if (pid > 0) {
+    waitpid(pid, nullptr, 0);
+  }
+}
+
+}
@@ -0,0 +1,299 @@
+#include "content_cache.hpp"
+#include "dir_reader.hpp"
+#include "duplicate_finder.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace orion {
+
+namespace {
+
+constexpr char kMagic[8] = {'O', 'R', 'I', 'O', 'N', 'C', 'C', '\0'};
+// Bump when the record layout or the meaning of a hash changes, e.g.
+// DuplicateFinder::kEdgeBlock; logs of other versions are started afresh.
+constexpr uint32_t kVersion = 1;
+// Stored facts are appended once this many have queued up.
+constexpr size_t kAppendBatch = 1024;
+constexpr uint32_t kKnownFlags =
+    ContentFacts::kEdgeHash | ContentFacts::kFullHash | ContentFacts::kBinary;
+
+constexpr uint32_t kRecordSize = 64;
+
+struct LogHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+
+  static LogHeader current() {
+    LogHeader header{};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.record_size = kRecordSize;
+    return header;
+  }
+};
+
+bool write_all(int fd, const void *data, size_t size) {
+  const char *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t written = write(fd, bytes, size);
+    if (written <= 0) return false;
+    bytes += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+} // namespace
+
+// Native byte order: the log never leaves the machine that wrote it.
+struct ContentCache::Record {
+  uint64_t device;
+  uint64_t inode;
+  uint64_t size;
+  int64_t mtime_ns;
+  uint64_t edge_hash;
+  uint64_t full_hash;
+  uint32_t flags;
+  uint32_t reserved;
+  // ContentHash of the fields above, so torn or damaged records are skipped.
+  uint64_t check;
+
+  uint64_t checksum() const {
+    return ContentHash::of(
+        std::string_view(reinterpret_cast<const char *>(this), offsetof(Record, check)));
+  }
+};
+
+ContentKey ContentKey::of(const struct stat &st) {
+  return ContentKey{static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+                    static_cast<uint64_t>(st.st_size), mtime_of(st)};
+}
+
+ContentCache::ContentCache(std::string path) : path(std::move(path)) {
+  static_assert(sizeof(Record) == kRecordSize, "Record layout changed");
+}
+
+ContentCache::~ContentCache() {
+  flush();
+  if (log_fd >= 0) {
+    close(log_fd);
+  }
+}
+
+std::shared_ptr<ContentCache> ContentCache::open(const std::string &path) {
+  auto cache = std::shared_ptr<ContentCache>(new ContentCache(path));
+  cache->load_and_compact();
+  return cache;
+}
+
+bool ContentCache::lookup(const ContentKey &key, ContentFacts &facts) const {
+  const Shard &shard = shard_of(FileId{key.device, key.inode});
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.entries.find(FileId{key.device, key.inode});
+  if (it == shard.entries.end() || it->second.size != key.size ||
+      it->second.mtime_ns != key.mtime_ns) {
+    return false;
+  }
+  facts = it->second.facts;
+  return true;
+}
+
+void ContentCache::store(const ContentKey &key, const ContentFacts &facts) {
+  Record record{key.device, key.inode, key.size, key.mtime_ns, facts.edge_hash,
+                facts.full_hash, facts.flags, 0, 0};
+  Record merged;
+  if (!merge(record, next_sequence.fetch_add(1, std::memory_order_relaxed), &merged)) return;
+  merged.check = merged.checksum();
+  std::lock_guard<std::mutex> lock(log_mutex);
+  pending.push_back(merged);
+  if (pending.size() >= kAppendBatch) {
+    append(pending);
+    pending.clear();
+  }
+}
+
+void ContentCache::flush() {
+  std::lock_guard<std::mutex> lock(log_mutex);
+  if (pending.empty()) return;
+  append(pending);
+  pending.clear();
+}
+
+size_t ContentCache::size() const {
+  size_t total = 0;
+  for (const Shard &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total += shard.entries.size();
+  }
+  return total;
+}
+
+bool ContentCache::merge(const Record &record, uint64_t sequence, Record *merged) {
+  const FileId id{record.device, record.inode};
+  Shard &shard = shard_of(id);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto [it, inserted] = shard.entries.try_emplace(id);
+  Entry &entry = it->second;
+  bool changed = inserted;
+  if (inserted || entry.size != record.size || entry.mtime_ns != record.mtime_ns) {
+    entry = Entry{record.size, record.mtime_ns, ContentFacts(), sequence};
+    changed = true;
+  }
+  ContentFacts &facts = entry.facts;
+  const uint32_t flags = record.flags & kKnownFlags;
+  if ((flags & ContentFacts::kEdgeHash) &&
+      (!(facts.flags & ContentFacts::kEdgeHash) || facts.edge_hash != record.edge_hash)) {
+    facts.edge_hash = record.edge_hash;
+    changed = true;
+  }
+  if ((flags & ContentFacts::kFullHash) &&
+      (!(facts.flags & ContentFacts::kFullHash) || facts.full_hash != record.full_hash)) {
+    facts.full_hash = record.full_hash;
+    changed = true;
+  }
+  if ((flags | facts.flags) != facts.flags) {
+    changed = true;
+  }
+  facts.flags |= flags;
+  if (!changed) return false;
+  entry.sequence = sequence;
+  if (merged) {
+    *merged = Record{record.device, record.inode, entry.size, entry.mtime_ns, facts.edge_hash,
+                     facts.full_hash, facts.flags, 0, 0};
+  }
+  return true;
+}
+
+int ContentCache::lock_log(int fd) {
+  for (int attempt = 0; attempt < 3; attempt++) {
+    if (fd < 0) {
+      fd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+      if (fd < 0) return -1;
+    }
+    struct stat opened, current;
+    if (flock(fd, LOCK_EX) == 0 && fstat(fd, &opened) == 0 && stat(path.c_str(), &current) == 0 &&
+        opened.st_dev == current.st_dev && opened.st_ino == current.st_ino) {
+      return fd;
+    }
+    close(fd);
+    fd = -1;
+  }
+  return -1;
+}
+
+void ContentCache::append(const std::vector<Record> &records) {
+  log_fd = lock_log(log_fd);
+  if (log_fd < 0) return;
+  struct stat st;
+  bool ok = fstat(log_fd, &st) == 0;
+  if (ok && st.st_size == 0) {
+    const LogHeader header = LogHeader::current();
+    ok = write_all(log_fd, &header, sizeof(header));
+  }
+  if (ok) {
+    write_all(log_fd, records.data(), records.size() * sizeof(Record));
+  }
+  flock(log_fd, LOCK_UN);
+}
+
+void ContentCache::load_and_compact() {
+  try {
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+  } catch (const std::exception &) {
+  }
+  int fd = lock_log(-1);
+  if (fd < 0) return;
+
+  // Anything but a whole number of valid records under a matching header
+  // is rewritten, which also realigns the log after a torn append.
+  bool damaged = false;
+  size_t records = 0;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    const size_t size = static_cast<size_t>(st.st_size);
+    void *mapping = size >= sizeof(LogHeader)
+                        ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                        : MAP_FAILED;
+    damaged = true;
+    if (mapping != MAP_FAILED) {
+      const auto *bytes = static_cast<const char *>(mapping);
+      LogHeader header;
+      memcpy(&header, bytes, sizeof(header));
+      const LogHeader expected = LogHeader::current();
+      if (memcmp(&header, &expected, sizeof(header)) == 0) {
+        const size_t body = size - sizeof(LogHeader);
+        damaged = body % sizeof(Record) != 0;
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        for (size_t offset = sizeof(LogHeader); offset + sizeof(Record) <= size;
+             offset += sizeof(Record)) {
+          Record record;
+          memcpy(&record, bytes + offset, sizeof(record));
+          if (record.check != record.checksum()) {
+            damaged = true;
+            continue;
+          }
+          merge(record, next_sequence++, nullptr);
+          records++;
+        }
+      }
+      munmap(mapping, size);
+    }
+  }
+
+  // A file's every change adds a record; once a quarter of them are stale
+  // the log is rewritten with one record per live entry, oldest first.
+  const size_t live = size();
+  if (damaged || records - live > live / 4 || live > kMaxEntries) {
+    std::vector<std::pair<FileId, Entry>> entries;
+    entries.reserve(live);
+    for (Shard &shard : shards) {
+      for (const auto &item : shard.entries) {
+        entries.push_back(item);
+      }
+    }
+    std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+      return a.second.sequence < b.second.sequence;
+    });
+    if (entries.size() > kMaxEntries) {
+      const size_t evicted = entries.size() - kMaxEntries;
+      for (size_t i = 0; i < evicted; i++) {
+        shard_of(entries[i].first).entries.erase(entries[i].first);
+      }
+      entries.erase(entries.begin(), entries.begin() + static_cast<ptrdiff_t>(evicted));
+    }
+
+    std::vector<Record> rewritten;
+    rewritten.reserve(entries.size());
+    for (const auto &[id, entry] : entries) {
+      Record record{id.device, id.inode, entry.size, entry.mtime_ns, entry.facts.edge_hash,
+                    entry.facts.full_hash, entry.facts.flags, 0, 0};
+      record.check = record.checksum();
+      rewritten.push_back(record);
+    }
+    const std::string temp = path + ".tmp." + std::to_string(getpid());
+    int out = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out >= 0) {
+      const LogHeader header = LogHeader::current();
+      bool ok = write_all(out, &header, sizeof(header)) &&
+                write_all(out, rewritten.data(), rewritten.size() * sizeof(Record));
+      ok = close(out) == 0 && ok;
+      if (!ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+      }
+    }
+  }
+  // Appends check that the file they hold is still the one at `path`, so
+  // the old log can go once it is unlocked.
+  close(fd);
+}
+
+} // namespace orion
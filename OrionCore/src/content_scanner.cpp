@@ -0,0 +1,270 @@
+#include "content_scanner.hpp"
+#include "content_cache.hpp"
+#include "regex.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define ORION_SCANNER_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define ORION_SCANNER_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ORION_ALWAYS_INLINE __attribute__((always_inline))
+#else
+#define ORION_ALWAYS_INLINE
+#endif
+
+namespace orion {
+
+namespace {
+
+// Files are read into the worker's buffer this much at a time. Unlike a
+// mapping, a read of a file truncated mid-scan just comes up short instead
+// of raising SIGBUS.
+constexpr size_t kReadChunk = 256 * 1024;
+// Regex scans carry an unfinished line between chunks up to this length; a
+// longer line, as in minified files, is matched on this much of it alone.
+constexpr size_t kMaxLine = 4 * 1024 * 1024;
+// A NUL byte in this many leading bytes marks a file as binary, as in grep.
+constexpr size_t kBinaryProbe = 8192;
+
+// Counts non-overlapping matches. `next` is the first position a new match
+// may start at; candidates before it overlap the previous match.
+struct Counter {
+  const char *haystack;
+  std::string_view needle;
+  size_t next = 0;
+  uint32_t found = 0;
+
+  ORION_ALWAYS_INLINE inline void check(size_t at) {
+    if (at < next) return;
+    if (needle.size() > 2 && memcmp(haystack + at + 1, needle.data() + 1, needle.size() - 2) != 0) {
+      return;
+    }
+    found++;
+    next = at + needle.size();
+  }
+};
+
+void count_scalar(Counter &counter, size_t length, size_t start) {
+  const std::string_view needle = counter.needle;
+  for (size_t i = start; i + needle.size() <= length; i++) {
+    if (counter.haystack[i] == needle.front() &&
+        counter.haystack[i + needle.size() - 1] == needle.back()) {
+      counter.check(i);
+    }
+  }
+}
+
+#if defined(ORION_SCANNER_SSE2)
+
+ORION_ALWAYS_INLINE inline void count_blocks(Counter &counter, size_t length, size_t &i) {
+  const __m128i first = _mm_set1_epi8(counter.needle.front());
+  const __m128i last = _mm_set1_epi8(counter.needle.back());
+  const size_t last_offset = counter.needle.size() - 1;
+  const char *haystack = counter.haystack;
+
+  for (; i + last_offset + 16 <= length; i += 16) {
+    __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i));
+    __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i + last_offset));
+    unsigned mask = static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last))));
+    while (mask != 0) {
+      counter.check(i + static_cast<unsigned>(__builtin_ctz(mask)));
+      mask &= mask - 1;
+    }
+  }
+}
+
+void count_sse2(Counter &counter, size_t length) {
+  size_t i = 0;
+  count_blocks(counter, length, i);
+  count_scalar(counter, length, i);
+}
+
+#endif
+
+#if defined(ORION_SCANNER_AVX2)
+
+__attribute__((target("avx2"))) void count_avx2(Counter &counter, size_t length) {
+  const __m256i first = _mm256_set1_epi8(counter.needle.front());
+  const __m256i last = _mm256_set1_epi8(counter.needle.back());
+  const size_t last_offset = counter.needle.size() - 1;
+  const char *haystack = counter.haystack;
+
+  size_t i = 0;
+  for (; i + last_offset + 32 <= length; i += 32) {
+    __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i));
+    __m256i tail =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i + last_offset));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last))));
+    while (mask != 0) {
+      counter.check(i + static_cast<unsigned>(__builtin_ctz(mask)));
+      mask &= mask - 1;
+    }
+  }
+  // Inlined so the tail stays VEX-encoded; see find_avx2 in matcher.cpp.
+  count_blocks(counter, length, i);
+  count_scalar(counter, length, i);
+}
+
+bool has_avx2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+
+#endif
+
+bool is_binary(const char *data, size_t size) {
+  return memchr(data, '\0', size < kBinaryProbe ? size : kBinaryProbe) != nullptr;
+}
+
+// Bytes read from `offset`; fewer than `size` only at the end of the file or
+// on an error.
+size_t read_at(int fd, char *out, size_t size, uint64_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t got = pread(fd, out + done, size - done, static_cast<off_t>(offset + done));
+    if (got <= 0) break;
+    done += static_cast<size_t>(got);
+  }
+  return done;
+}
+
+// Fills `counter` over its first `length` bytes, leaving `next` after the
+// last match.
+void count_into(Counter &counter, size_t length) {
+#if defined(ORION_SCANNER_AVX2)
+  if (length >= 32 + counter.needle.size() && has_avx2()) {
+    count_avx2(counter, length);
+    return;
+  }
+#endif
+#if defined(ORION_SCANNER_SSE2)
+  count_sse2(counter, length);
+#else
+  count_scalar(counter, length, 0);
+#endif
+}
+
+} // namespace
+
+ContentScanner::ContentScanner(std::string needle, bool regex, std::shared_ptr<ContentCache> cache)
+    : needle(std::move(needle)), regex_mode(regex), cache(std::move(cache)) {
+  if (regex_mode) {
+    this->regex = Regex::compile(this->needle, false);
+  }
+}
+
+ContentScanner::~ContentScanner() = default;
+
+uint32_t ContentScanner::count_in(std::string_view contents) const {
+  return regex_mode ? regex->count_lines(contents) : count(contents, needle);
+}
+
+uint32_t ContentScanner::count(std::string_view haystack, std::string_view needle) {
+  if (needle.empty() || haystack.size() < needle.size()) return 0;
+  Counter counter{haystack.data(), needle};
+  count_into(counter, haystack.size());
+  return counter.found;
+}
+
+uint32_t ContentScanner::scan(int dir_fd, const char *name, std::vector<char> &buffer,
+                              uint64_t *bytes_read, uint64_t *cache_hits) const {
+  if (regex_mode && !regex) return 0;
+  int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NOCTTY);
+  if (fd < 0) return 0;
+
+  uint32_t found = 0;
+  // A pattern's matching lines are at least as long as its required literal.
+  const size_t shortest = regex_mode ? regex->required_literal().size() : needle.size();
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && static_cast<uint64_t>(st.st_size) >= shortest &&
+      st.st_size > 0 && !needle.empty()) {
+    const size_t size = static_cast<size_t>(st.st_size);
+    ContentKey key;
+    ContentFacts facts;
+    if (cache) {
+      key = ContentKey::of(st);
+      if (cache->lookup(key, facts) && (facts.flags & ContentFacts::kBinary)) {
+        if (cache_hits) ++*cache_hits;
+        close(fd);
+        return 0;
+      }
+    }
+    // Only binary files are remembered: text has to be read for every
+    // pattern anyway.
+    auto found_binary = [&] {
+      if (cache) cache->store(key, ContentFacts{ContentFacts::kBinary});
+    };
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if (size > kReadChunk) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+    // The front `kept` bytes of the buffer are carried over from the last
+    // chunk: the tail a literal match may still start in, or a regex's
+    // unfinished line, so nothing is counted twice or cut in half.
+    uint64_t offset = 0;
+    size_t kept = 0;
+    // The buffer starts inside a line that was cut at kMaxLine.
+    bool skip_line = false;
+    while (offset < size) {
+      if (buffer.size() < kept + kReadChunk) {
+        buffer.resize(kept + kReadChunk);
+      }
+      const size_t wanted =
+          static_cast<size_t>(std::min<uint64_t>(size - offset, buffer.size() - kept));
+      const size_t got = read_at(fd, buffer.data() + kept, wanted, offset);
+      if (bytes_read) *bytes_read += got;
+      if (offset == 0 && is_binary(buffer.data(), got)) {
+        found_binary();
+        break;
+      }
+      offset += got;
+      std::string_view data(buffer.data(), kept + got);
+      if (skip_line) {
+        const size_t newline = data.find('\n');
+        skip_line = newline == std::string_view::npos;
+        data.remove_prefix(skip_line ? data.size() : newline + 1);
+      }
+      if (got < wanted || offset >= size) {
+        found += count_in(data);
+        break;
+      }
+      if (regex_mode) {
+        const size_t newline = data.rfind('\n');
+        if (newline != std::string_view::npos) {
+          found += regex->count_lines(data.substr(0, newline + 1));
+          data.remove_prefix(newline + 1);
+        } else if (data.size() >= kMaxLine) {
+          found += regex->count_lines(data);
+          data.remove_prefix(data.size());
+          skip_line = true;
+        }
+      } else {
+        Counter counter{data.data(), needle};
+        count_into(counter, data.size());
+        found += counter.found;
+        const size_t tail = std::min(data.size(), needle.size() - 1);
+        data.remove_prefix(std::max(counter.next, data.size() - tail));
+      }
+      kept = data.size();
+      memmove(buffer.data(), data.data(), kept);
+    }
+  }
+  close(fd);
+  return found;
+}
+
+} // namespace orion
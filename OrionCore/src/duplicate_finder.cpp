@@ -0,0 +1,476 @@
+#include "duplicate_finder.hpp"
+#include "content_cache.hpp"
+#include "dir_reader.hpp"
+#include "matcher.hpp"
+#include "query_plan.hpp"
+#include "search_output.hpp"
+#include "task_queue.hpp"
+#include "walker.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace orion {
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+constexpr uint64_t kFlushCheckInterval = 256;
+// Full hashes read files in pieces of this size into the worker's buffer.
+constexpr size_t kReadChunk = 1 << 20;
+// Edge hashes are cheap, so they take only this much of the estimate.
+constexpr double kEdgeShare = 0.1;
+
+inline uint64_t rotate_left(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+// Loads are little-endian on every platform the engine runs on.
+inline uint64_t load64(const unsigned char *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint32_t load32(const unsigned char *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint64_t accumulate(uint64_t lane, uint64_t input) {
+  lane += input * kPrime2;
+  return rotate_left(lane, 31) * kPrime1;
+}
+
+inline uint64_t merge_round(uint64_t hash, uint64_t lane) {
+  hash ^= accumulate(0, lane);
+  return hash * kPrime1 + kPrime4;
+}
+
+inline void consume(uint64_t *lanes, const unsigned char *stripe) {
+  lanes[0] = accumulate(lanes[0], load64(stripe));
+  lanes[1] = accumulate(lanes[1], load64(stripe + 8));
+  lanes[2] = accumulate(lanes[2], load64(stripe + 16));
+  lanes[3] = accumulate(lanes[3], load64(stripe + 24));
+}
+
+struct Candidate {
+  std::string path;
+  uint64_t size;
+  uint64_t device;
+  uint64_t inode;
+  int64_t mtime_ns;
+  // The hash of the last stage; unreadable files drop out.
+  uint64_t key = 0;
+  bool readable = true;
+};
+
+bool read_at(int fd, unsigned char *out, size_t size, uint64_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t got = pread(fd, out + done, size - done, static_cast<off_t>(offset + done));
+    if (got <= 0) return false;
+    done += static_cast<size_t>(got);
+  }
+  return true;
+}
+
+int open_file(const std::string &path) {
+  return open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NOCTTY);
+}
+
+// The first and last kEdgeBlock bytes, or the whole file when it is no
+// larger than both.
+bool hash_edges(Candidate &file, std::vector<unsigned char> &buffer, uint64_t &bytes_read) {
+  constexpr size_t block = DuplicateFinder::kEdgeBlock;
+  int fd = open_file(file.path);
+  if (fd < 0) return false;
+  ContentHash hash;
+  bool read = false;
+  if (file.size <= 2 * block) {
+    const size_t size = static_cast<size_t>(file.size);
+    read = read_at(fd, buffer.data(), size, 0);
+    if (read) hash.update(buffer.data(), size);
+    bytes_read += size;
+  } else {
+    read = read_at(fd, buffer.data(), block, 0) &&
+           read_at(fd, buffer.data() + block, block, file.size - block);
+    if (read) hash.update(buffer.data(), 2 * block);
+    bytes_read += 2 * block;
+  }
+  close(fd);
+  file.key = hash.digest();
+  return read;
+}
+
+// Stops early, returning false, when the file turns out to have changed size
+// or the search is cancelled.
+bool hash_contents(Candidate &file, std::vector<unsigned char> &buffer, uint64_t &bytes_read,
+                   std::atomic<uint64_t> &bytes_done, const std::atomic<bool> *cancel) {
+  int fd = open_file(file.path);
+  if (fd < 0) return false;
+#if defined(POSIX_FADV_SEQUENTIAL)
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  ContentHash hash;
+  uint64_t total = 0;
+  ssize_t got;
+  while ((got = read(fd, buffer.data(), buffer.size())) > 0) {
+    hash.update(buffer.data(), static_cast<size_t>(got));
+    total += static_cast<uint64_t>(got);
+    bytes_done.fetch_add(static_cast<uint64_t>(got), std::memory_order_relaxed);
+    if (total > file.size || (cancel && cancel->load(std::memory_order_relaxed))) break;
+  }
+  close(fd);
+  bytes_read += total;
+  file.key = hash.digest();
+  return got == 0 && total == file.size;
+}
+
+// Calls `fn(begin, end)` for every run of two or more files in `files`
+// (sorted) that `same` says are alike.
+template <typename Same, typename Fn>
+void for_each_run(const std::vector<Candidate *> &files, Same &&same, Fn &&fn) {
+  for (size_t begin = 0; begin < files.size();) {
+    size_t end = begin + 1;
+    while (end < files.size() && same(*files[begin], *files[end])) end++;
+    if (end - begin >= 2) fn(begin, end);
+    begin = end;
+  }
+}
+
+bool by_size_then_key(const Candidate *a, const Candidate *b) {
+  if (a->size != b->size) return a->size > b->size;
+  if (a->key != b->key) return a->key < b->key;
+  return a->path < b->path;
+}
+
+} // namespace
+
+ContentHash::ContentHash(uint64_t seed)
+    : lanes{seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1}, seed(seed) {}
+
+void ContentHash::update(const void *data, size_t size) {
+  const unsigned char *input = static_cast<const unsigned char *>(data);
+  total += size;
+  if (pending_size + size < sizeof(pending)) {
+    memcpy(pending + pending_size, input, size);
+    pending_size += size;
+    return;
+  }
+  if (pending_size) {
+    const size_t fill = sizeof(pending) - pending_size;
+    memcpy(pending + pending_size, input, fill);
+    consume(lanes, pending);
+    input += fill;
+    size -= fill;
+    pending_size = 0;
+  }
+  for (; size >= 32; input += 32, size -= 32) {
+    consume(lanes, input);
+  }
+  memcpy(pending, input, size);
+  pending_size = size;
+}
+
+uint64_t ContentHash::digest() const {
+  uint64_t hash;
+  if (total >= 32) {
+    hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) +
+           rotate_left(lanes[3], 18);
+    for (uint64_t lane : lanes) {
+      hash = merge_round(hash, lane);
+    }
+  } else {
+    hash = seed + kPrime5;
+  }
+  hash += total;
+
+  const unsigned char *p = pending;
+  size_t left = pending_size;
+  for (; left >= 8; p += 8, left -= 8) {
+    hash ^= accumulate(0, load64(p));
+    hash = rotate_left(hash, 27) * kPrime1 + kPrime4;
+  }
+  if (left >= 4) {
+    hash ^= uint64_t(load32(p)) * kPrime1;
+    hash = rotate_left(hash, 23) * kPrime2 + kPrime3;
+    p += 4;
+    left -= 4;
+  }
+  for (; left > 0; p++, left--) {
+    hash ^= *p * kPrime5;
+    hash = rotate_left(hash, 11) * kPrime1;
+  }
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+DuplicateFinder::DuplicateFinder(unsigned thread_count) : threads(thread_count) {}
+
+std::vector<DuplicateGroup> DuplicateFinder::find(const SearchQuery &query,
+                                                  const std::string &directory, uint64_t min_size,
+                                                  const std::atomic<bool> *cancel,
+                                                  SearchProgress *live) {
+  const auto started = ResultBatcher::Clock::now();
+  ParallelWalker walker(threads);
+  walker.set_trace(live ? live->trace : nullptr);
+  walker.set_ignore(query.ignore.get());
+  if (live && live->trace) {
+    live->trace->prepare(walker.thread_count());
+  }
+  const Matcher matcher(query.text);
+  const QueryPlan plan(query);
+  const SearchEngine::ProgressCallback no_callback;
+  ProgressReporter reporter(no_callback, live);
+  auto cancelled = [cancel] { return cancel && cancel->load(std::memory_order_relaxed); };
+  min_size = std::max<uint64_t>(min_size, 1);
+
+  const std::string root = normalize_directory(directory);
+  const size_t relative_offset = root == "/" ? 1 : root.size() + 1;
+
+  struct WorkerState {
+    uint64_t entries = 0;
+    uint64_t unreported_files = 0;
+    std::vector<Candidate> files;
+    std::vector<unsigned char> buffer;
+    uint64_t files_read = 0;
+    uint64_t bytes_read = 0;
+    uint64_t cache_hits = 0;
+    uint64_t read_ns = 0;
+  };
+  std::vector<WorkerState> workers(walker.thread_count());
+
+  walker.walk(root, [&](unsigned worker, const DirEntry &entry) {
+    WorkerState &state = workers[worker];
+    if (++state.entries % kFlushCheckInterval == 0 && reporter) {
+      reporter.add_files(state.unreported_files);
+      state.unreported_files = 0;
+      uint64_t done = walker.directories_done();
+      uint64_t pending = walker.directories_pending();
+      reporter.set_directories(done, pending);
+      reporter.report(0.5 * static_cast<double>(done) /
+                      (static_cast<double>(done + pending) + 1.0));
+    }
+
+    if (entry.type != EntryType::File) return;
+    state.unreported_files++;
+    if (!plan.matches_name(entry.name)) return;
+
+    std::string path(entry.dir_path);
+    if (path.back() != '/') {
+      path += '/';
+    }
+    path.append(entry.name);
+    std::string_view relative = std::string_view(path).substr(std::min(relative_offset, path.size()));
+    if (!matcher.matches(relative) || !plan.matches_path(relative)) return;
+
+    EntryMetadata metadata;
+    if (!entry.metadata(metadata) || metadata.size < min_size) return;
+    if (plan.needs_metadata() && !plan.matches_metadata(metadata)) return;
+    state.files.push_back(Candidate{std::move(path), metadata.size, metadata.device,
+                                    metadata.inode, metadata.mtime_ns});
+  }, cancel);
+
+  for (WorkerState &state : workers) {
+    reporter.add_files(state.unreported_files);
+  }
+  reporter.set_directories(walker.directories_done(), walker.directories_pending());
+  reporter.report(0.5);
+
+  // Stage 1: sizes seen once, and further links to a file already listed,
+  // drop out.
+  std::vector<Candidate *> files;
+  for (WorkerState &state : workers) {
+    for (Candidate &file : state.files) {
+      files.push_back(&file);
+    }
+  }
+  std::sort(files.begin(), files.end(), [](const Candidate *a, const Candidate *b) {
+    if (a->size != b->size) return a->size > b->size;
+    if (a->device != b->device) return a->device < b->device;
+    if (a->inode != b->inode) return a->inode < b->inode;
+    return a->path < b->path;
+  });
+  files.erase(std::unique(files.begin(), files.end(),
+                          [](const Candidate *a, const Candidate *b) {
+                            return a->size == b->size && a->device == b->device &&
+                                   a->inode == b->inode;
+                          }),
+              files.end());
+  std::vector<Candidate *> same_size;
+  for_each_run(files, [](const Candidate &a, const Candidate &b) { return a.size == b.size; },
+               [&](size_t begin, size_t end) {
+                 same_size.insert(same_size.end(), files.begin() + begin, files.begin() + end);
+               });
+
+  // Runs `hash(worker, file)` over `stage` on every worker, largest file
+  // first since `stage` is sorted by size, and drops the files it fails on.
+  // Files the cache has the hash of (the `kind` of ContentFacts) are keyed
+  // without reading them, and new hashes are stored. `done(file, cached)`
+  // follows every file.
+  ContentCache *const cache = query.cache.get();
+  const unsigned hash_workers = walker.thread_count();
+  auto run_stage = [&](std::vector<Candidate *> &stage, uint32_t kind, auto &&hash,
+                       auto &&done) {
+    uint64_t ContentFacts::*const field =
+        kind == ContentFacts::kEdgeHash ? &ContentFacts::edge_hash : &ContentFacts::full_hash;
+    std::atomic<size_t> next{0};
+    run_on_threads(hash_workers, [&](unsigned worker) {
+      WorkerState &state = workers[worker];
+      if (state.buffer.empty()) {
+        state.buffer.resize(kReadChunk);
+      }
+      while (!cancelled()) {
+        size_t i = next.fetch_add(1);
+        if (i >= stage.size()) break;
+        Candidate &file = *stage[i];
+        const ContentKey key{file.device, file.inode, file.size, file.mtime_ns};
+        ContentFacts facts;
+        if (cache && cache->lookup(key, facts) && (facts.flags & kind)) {
+          file.key = facts.*field;
+          state.cache_hits++;
+          done(file, true);
+          continue;
+        }
+        auto begin = ResultBatcher::Clock::now();
+        file.readable = hash(worker, file);
+        auto end = ResultBatcher::Clock::now();
+        state.read_ns += elapsed_ns(begin, end);
+        state.files_read++;
+        if (live && live->trace) {
+          live->trace->add(worker, "hash", begin, end, file.path);
+        }
+        if (cache && file.readable) {
+          facts = ContentFacts();
+          facts.flags = kind;
+          facts.*field = file.key;
+          cache->store(key, facts);
+        }
+        done(file, false);
+      }
+    });
+    stage.erase(std::remove_if(stage.begin(), stage.end(),
+                               [](const Candidate *file) { return !file->readable; }),
+                stage.end());
+    std::sort(stage.begin(), stage.end(), by_size_then_key);
+  };
+
+  std::vector<DuplicateGroup> groups;
+  auto confirm = [&](const std::vector<Candidate *> &stage, size_t begin, size_t end) {
+    DuplicateGroup group;
+    group.size = stage[begin]->size;
+    for (size_t i = begin; i < end; i++) {
+      group.paths.push_back(std::move(stage[i]->path));
+    }
+    std::sort(group.paths.begin(), group.paths.end());
+    groups.push_back(std::move(group));
+    if (live) {
+      live->matches.fetch_add(end - begin, std::memory_order_relaxed);
+    }
+  };
+  auto same_key = [](const Candidate &a, const Candidate &b) {
+    return a.size == b.size && a.key == b.key;
+  };
+
+  // Stage 2: the edges. Small files are read whole here and need no third
+  // stage.
+  std::atomic<size_t> edges_done{0};
+  run_stage(
+      same_size, ContentFacts::kEdgeHash,
+      [&](unsigned worker, Candidate &file) {
+        WorkerState &state = workers[worker];
+        return hash_edges(file, state.buffer, state.bytes_read);
+      },
+      [&](const Candidate &, bool) {
+        size_t done = edges_done.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (reporter && done % kFlushCheckInterval == 0) {
+          reporter.report(0.5 + kEdgeShare * static_cast<double>(done) /
+                                    static_cast<double>(same_size.size()));
+        }
+      });
+  std::vector<Candidate *> full;
+  uint64_t bytes_to_hash = 0;
+  for_each_run(same_size, same_key, [&](size_t begin, size_t end) {
+    if (same_size[begin]->size <= 2 * kEdgeBlock) {
+      confirm(same_size, begin, end);
+      return;
+    }
+    full.insert(full.end(), same_size.begin() + begin, same_size.begin() + end);
+    bytes_to_hash += same_size[begin]->size * (end - begin);
+  });
+  reporter.report(0.5 + kEdgeShare);
+
+  // Stage 3: whole contents.
+  std::atomic<uint64_t> bytes_done{0};
+  run_stage(
+      full, ContentFacts::kFullHash,
+      [&](unsigned worker, Candidate &file) {
+        WorkerState &state = workers[worker];
+        return hash_contents(file, state.buffer, state.bytes_read, bytes_done, cancel);
+      },
+      [&](const Candidate &file, bool cached) {
+        if (cached) {
+          bytes_done.fetch_add(file.size, std::memory_order_relaxed);
+        }
+        if (reporter && bytes_to_hash) {
+          reporter.report(0.5 + kEdgeShare +
+                          (0.5 - kEdgeShare) * static_cast<double>(bytes_done.load()) /
+                              static_cast<double>(bytes_to_hash));
+        }
+      });
+  for_each_run(full, same_key, [&](size_t begin, size_t end) { confirm(full, begin, end); });
+  if (cache) {
+    cache->flush();
+  }
+
+  if (cancelled()) {
+    groups.clear();
+  }
+  std::sort(groups.begin(), groups.end(), [](const DuplicateGroup &a, const DuplicateGroup &b) {
+    if (a.reclaimable() != b.reclaimable()) return a.reclaimable() > b.reclaimable();
+    if (a.size != b.size) return a.size > b.size;
+    return a.paths.front() < b.paths.front();
+  });
+
+  if (live) {
+    const WalkStats &walk = walker.stats();
+    SearchStats &stats = live->stats;
+    stats = SearchStats();
+    stats.directories_opened = walk.directories_opened;
+    stats.entries_read = walk.entries_read;
+    stats.stat_calls = walk.stat_calls;
+    stats.directories_skipped = walk.directories_skipped;
+    stats.open_ns = walk.open_ns;
+    stats.enumerate_ns = walk.enumerate_ns;
+    stats.stat_ns = walk.stat_ns;
+    stats.match_ns = walk.visit_ns;
+    stats.idle_ns = walk.idle_ns;
+    for (const WorkerState &state : workers) {
+      stats.files_read += state.files_read;
+      stats.bytes_read += state.bytes_read;
+      stats.cache_hits += state.cache_hits;
+      stats.read_ns += state.read_ns;
+    }
+    stats.matches = live->matches.load(std::memory_order_relaxed);
+    stats.wall_ns = elapsed_ns(started, ResultBatcher::Clock::now());
+  }
+  if (reporter && !cancelled()) {
+    reporter.report(1.0);
+  }
+  return groups;
+}
+
+} // namespace orion
@@ -0,0 +1,864 @@
+#include "file_index.hpp"
+#include "content_cache.hpp"
+#include "content_scanner.hpp"
+#include "dir_reader.hpp"
+#include "ignore_rules.hpp"
+#include "matcher.hpp"
+#include "query_plan.hpp"
+#include "search_output.hpp"
+#include "task_queue.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sys/mman.h>
+#include <unordered_set>
+
+namespace orion {
+
+namespace {
+
+constexpr char kMagic[8] = {'O', 'R', 'I', 'O', 'N', 'I', 'D', 'X'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kSearchChunk = 64 * 1024;
+constexpr size_t kCandidateChunk = 256;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t node_size;
+  uint64_t node_count;
+  uint64_t names_size;
+  uint64_t root_length;
+};
+
+size_t align8(size_t value) { return (value + 7) & ~size_t(7); }
+
+struct ScanDir;
+
+// Names point into the previous index or into ScanDir::names, both of which
+// outlive the scan.
+struct ScanEntry {
+  std::string_view name;
+  EntryType type = EntryType::Unknown;
+  int64_t mtime_ns = 0;
+  uint64_t size = 0;
+  std::unique_ptr<ScanDir> dir;
+};
+
+struct ScanDir {
+  uint32_t previous = FileIndex::kNoNode;
+  int64_t mtime_ns = 0;
+  std::vector<ScanEntry> entries;
+  std::string names;
+};
+
+struct ScanTask {
+  ScanDir *dir = nullptr;
+  std::shared_ptr<DirFd> parent;
+  std::string path;
+  size_t name_offset = 0;
+  bool verify = false;
+};
+
+uint32_t find_child(const FileIndex &index, uint32_t parent, std::string_view name) {
+  const FileIndex::Node &node = index.node(parent);
+  uint32_t low = node.first_child;
+  uint32_t high = node.first_child + node.child_count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    int order = index.name(mid).compare(name);
+    if (order == 0) return mid;
+    if (order < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return FileIndex::kNoNode;
+}
+
+// Ignore rules applied to index nodes, so an index search leaves out what a
+// walk with the same settings would have. The index itself keeps the whole
+// tree. Each worker works out the directories it meets from the root down
+// and remembers them; an ignore file is read from disk where the index lists
+// one.
+class IndexIgnore {
+public:
+  IndexIgnore(const FileIndex &index, const IgnoreSettings &settings, unsigned workers)
+      : index(index), settings(settings), cache(workers), skipped(workers) {
+    auto excludes = std::make_shared<IgnoreRules>(std::string(), nullptr);
+    for (const std::string &pattern : settings.excludes) {
+      excludes->add(pattern);
+    }
+    if (!excludes->empty()) {
+      root_rules = std::move(excludes);
+    }
+  }
+
+  // `relative` is the node's path below the root.
+  bool ignored(unsigned worker, uint32_t id, std::string_view relative) {
+    const Directory &parent = directory(worker, index.node(id).parent);
+    return parent.excluded ||
+           (parent.rules &&
+            parent.rules->ignored(relative, index.node(id).type ==
+                                                static_cast<uint8_t>(EntryType::Directory)));
+  }
+
+  // Excluded directories met below included ones, as a walk counts them.
+  uint64_t directories_skipped() const {
+    std::unordered_set<uint32_t> distinct;
+    for (const std::vector<uint32_t> &ids : skipped) {
+      distinct.insert(ids.begin(), ids.end());
+    }
+    return distinct.size();
+  }
+
+private:
+  struct Directory {
+    bool excluded = false;
+    // Rules for the directory's entries, its own ignore files included.
+    std::shared_ptr<const IgnoreRules> rules;
+  };
+
+  const Directory &directory(unsigned worker, uint32_t id) {
+    auto &known = cache[worker];
+    auto found = known.find(id);
+    if (found != known.end()) return found->second;
+
+    Directory dir;
+    dir.rules = root_rules;
+    std::string relative;
+    if (id != 0) {
+      // Elements of an unordered_map stay put as it grows.
+      const Directory &parent = directory(worker, index.node(id).parent);
+      const std::string path = index.path_of(id);
+      relative = path.substr(std::min(path.size(), index.root() == "/" ? 1 : index.root().size() + 1));
+      dir.rules = parent.rules;
+      dir.excluded = parent.excluded || (parent.rules && parent.rules->ignored(relative, true));
+      if (dir.excluded && !parent.excluded) {
+        skipped[worker].push_back(id);
+      }
+    }
+    if (!dir.excluded && settings.ignore_files) {
+      std::shared_ptr<IgnoreRules> own;
+      for (const char *file_name : IgnoreRules::kFileNames) {
+        if (find_child(index, id, file_name) == FileIndex::kNoNode) continue;
+        if (!own) {
+          own = std::make_shared<IgnoreRules>(relative, dir.rules);
+        }
+        own->add_file(AT_FDCWD, (index.path_of(id) + "/" + file_name).c_str());
+      }
+      if (own && !own->empty()) {
+        dir.rules = std::move(own);
+      }
+    }
+    return known.emplace(id, std::move(dir)).first->second;
+  }
+
+  const FileIndex &index;
+  const IgnoreSettings &settings;
+  std::shared_ptr<const IgnoreRules> root_rules;
+  std::vector<std::unordered_map<uint32_t, Directory>> cache;
+  std::vector<std::vector<uint32_t>> skipped;
+};
+
+} // namespace
+
+FileIndex::~FileIndex() {
+  if (mapping) {
+    munmap(mapping, mapping_size);
+  }
+}
+
+std::unique_ptr<FileIndex> FileIndex::load(const std::string &file) {
+  int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return nullptr;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+    close(fd);
+    return nullptr;
+  }
+
+  size_t size = static_cast<size_t>(st.st_size);
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return nullptr;
+
+  auto index = std::unique_ptr<FileIndex>(new FileIndex);
+  index->mapping = mapping;
+  index->mapping_size = size;
+
+  const auto *bytes = static_cast<const char *>(mapping);
+  FileHeader header;
+  memcpy(&header, bytes, sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+      header.node_size != sizeof(Node) || header.node_count == 0) {
+    return nullptr;
+  }
+
+  size_t nodes_offset = align8(sizeof(FileHeader) + header.root_length);
+  size_t names_offset = nodes_offset + header.node_count * sizeof(Node);
+  if (header.root_length > size || header.node_count > size / sizeof(Node) ||
+      names_offset > size || header.names_size > size - names_offset) {
+    return nullptr;
+  }
+
+  // Every lookup indexes through these fields, so a truncated or damaged
+  // file must not get past here: parents come first, children are a
+  // contiguous range after their directory that points back to it, and
+  // names lie inside the name table.
+  const Node *nodes = reinterpret_cast<const Node *>(bytes + nodes_offset);
+  const uint64_t count = header.node_count;
+  if (nodes[0].parent != kNoNode) return nullptr;
+  for (uint64_t id = 0; id < count; id++) {
+    const Node &node = nodes[id];
+    if (node.type > static_cast<uint8_t>(EntryType::Other) ||
+        uint64_t(node.name_offset) + node.name_length > header.names_size ||
+        (id > 0 && node.parent >= id)) {
+      return nullptr;
+    }
+    if (node.child_count == 0) continue;
+    if (node.first_child <= id || uint64_t(node.first_child) + node.child_count > count) {
+      return nullptr;
+    }
+    const uint64_t end = uint64_t(node.first_child) + node.child_count;
+    for (uint64_t child = node.first_child; child < end; child++) {
+      if (nodes[child].parent != id) return nullptr;
+    }
+  }
+
+  index->root_path.assign(bytes + sizeof(FileHeader), header.root_length);
+  index->nodes = nodes;
+  index->node_count = header.node_count;
+  index->names = bytes + names_offset;
+  index->names_size = header.names_size;
+  return index;
+}
+
+std::unique_ptr<FileIndex> FileIndex::build(const std::string &root, const FileIndex *previous,
+                                            unsigned thread_count,
+                                            const std::atomic<bool> *cancel,
+                                            RefreshStats *stats, const UpdatePlan *plan) {
+  const std::string root_path = normalize_directory(root);
+  if (previous && previous->root() != root_path) {
+    previous = nullptr;
+  }
+
+  auto cancelled = [cancel] { return cancel && cancel->load(std::memory_order_relaxed); };
+
+  ScanDir root_dir;
+  root_dir.previous = previous ? 0 : kNoNode;
+
+  std::atomic<uint64_t> scanned{0};
+  std::atomic<uint64_t> reused{0};
+  std::atomic<bool> root_opened{false};
+
+  const unsigned threads = resolve_thread_count(thread_count);
+  TaskQueue<ScanTask> queue(threads);
+  std::vector<ScanTask> initial(1);
+  initial[0].dir = &root_dir;
+  initial[0].path = root_path;
+  initial[0].verify = plan == nullptr;
+  queue.push(0, initial);
+
+  auto reuse = [&](ScanDir &dir, const Node &old) {
+    reused.fetch_add(1, std::memory_order_relaxed);
+    dir.entries.reserve(old.child_count);
+    for (uint32_t i = 0; i < old.child_count; i++) {
+      uint32_t id = old.first_child + i;
+      const Node &child = previous->node(id);
+      ScanEntry entry;
+      entry.name = previous->name(id);
+      entry.type = static_cast<EntryType>(child.type);
+      entry.mtime_ns = child.mtime_ns;
+      entry.size = child.size;
+      if (entry.type == EntryType::Directory) {
+        entry.dir = std::make_unique<ScanDir>();
+        entry.dir->previous = id;
+      }
+      dir.entries.push_back(std::move(entry));
+    }
+  };
+
+  run_on_threads(threads, [&](unsigned worker) {
+    std::vector<char> buffer;
+    std::vector<std::pair<size_t, size_t>> spans;
+    queue.run(worker, [&](unsigned, ScanTask &task, std::vector<ScanTask> &children) {
+      if (cancelled()) return;
+
+      ScanDir &dir = *task.dir;
+      const Node *old = dir.previous != kNoNode ? &previous->node(dir.previous) : nullptr;
+      const bool verify = task.verify || (plan && plan->verify.count(task.path) > 0);
+      const bool dirty = plan && plan->dirty.count(task.path) > 0;
+      std::shared_ptr<DirFd> dir_fd;
+
+      if (old && !verify && !dirty) {
+        // Notifications reported no change here; trust the previous index.
+        dir.mtime_ns = old->mtime_ns;
+        reuse(dir, *old);
+      } else {
+        int fd = open_directory(task.parent.get(), task.path.c_str() + task.name_offset,
+                                task.path.c_str());
+        if (fd < 0) return;
+        dir_fd = std::make_shared<DirFd>(fd);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) return;
+        dir.mtime_ns = mtime_of(st);
+
+        if (old && !dirty && old->mtime_ns == dir.mtime_ns) {
+          reuse(dir, *old);
+        } else {
+          scanned.fetch_add(1, std::memory_order_relaxed);
+          spans.clear();
+          read_entries(fd, buffer, cancel, [&](const char *name, size_t length, EntryType type) {
+            // A directory's mtime comes from the fstat when it is opened, so
+            // only other entries are stat'ed for the size and mtime the
+            // index stores.
+            ScanEntry entry;
+            if (type != EntryType::Directory) {
+              EntryMetadata metadata;
+              if (stat_entry(fd, name, type, &metadata)) {
+                entry.size = metadata.size;
+                entry.mtime_ns = metadata.mtime_ns;
+              } else if (type == EntryType::Unknown) {
+                return;
+              }
+            }
+            entry.type = type;
+            spans.emplace_back(dir.names.size(), length);
+            dir.names.append(name, length);
+            dir.entries.push_back(std::move(entry));
+          });
+          for (size_t i = 0; i < dir.entries.size(); i++) {
+            dir.entries[i].name = std::string_view(dir.names).substr(spans[i].first, spans[i].second);
+          }
+
+          std::sort(dir.entries.begin(), dir.entries.end(),
+                    [](const ScanEntry &a, const ScanEntry &b) { return a.name < b.name; });
+          for (auto &entry : dir.entries) {
+            if (entry.type != EntryType::Directory) continue;
+            entry.dir = std::make_unique<ScanDir>();
+            if (old) {
+              entry.dir->previous = find_child(*previous, dir.previous, entry.name);
+            }
+          }
+        }
+      }
+
+      if (!task.parent && task.path == root_path) {
+        root_opened = true;
+      }
+
+      for (auto &entry : dir.entries) {
+        if (!entry.dir) continue;
+        ScanTask child;
+        child.dir = entry.dir.get();
+        child.parent = dir_fd;
+        child.verify = verify;
+        child.path.reserve(task.path.size() + 1 + entry.name.size());
+        child.path = task.path;
+        if (child.path.back() != '/') {
+          child.path += '/';
+        }
+        child.name_offset = child.path.size();
+        child.path += entry.name;
+        if (previous && entry.dir->previous == kNoNode && plan) {
+          auto moved = plan->moved.find(child.path);
+          if (moved != plan->moved.end()) {
+            entry.dir->previous = moved->second;
+          }
+        }
+        children.push_back(std::move(child));
+      }
+    });
+  });
+
+  if (cancelled() || !root_opened) return nullptr;
+
+  auto index = std::unique_ptr<FileIndex>(new FileIndex);
+  index->root_path = root_path;
+  std::vector<Node> &nodes = index->owned_nodes;
+  std::string &names = index->owned_names;
+
+  Node root_node{};
+  root_node.parent = kNoNode;
+  root_node.mtime_ns = root_dir.mtime_ns;
+  root_node.type = static_cast<uint8_t>(EntryType::Directory);
+  nodes.push_back(root_node);
+
+  std::vector<std::pair<const ScanDir *, uint32_t>> pending{{&root_dir, 0}};
+  for (size_t next = 0; next < pending.size(); next++) {
+    auto [dir, id] = pending[next];
+    if (nodes.size() + dir->entries.size() >= kNoNode) return nullptr;
+    nodes[id].first_child = static_cast<uint32_t>(nodes.size());
+    nodes[id].child_count = static_cast<uint32_t>(dir->entries.size());
+    for (const auto &entry : dir->entries) {
+      if (names.size() + entry.name.size() > UINT32_MAX) return nullptr;
+      Node node{};
+      node.parent = id;
+      node.name_offset = static_cast<uint32_t>(names.size());
+      node.name_length = static_cast<uint16_t>(entry.name.size());
+      node.type = static_cast<uint8_t>(entry.type);
+      node.mtime_ns = entry.dir ? entry.dir->mtime_ns : entry.mtime_ns;
+      node.size = entry.size;
+      names += entry.name;
+      if (entry.dir) {
+        pending.emplace_back(entry.dir.get(), static_cast<uint32_t>(nodes.size()));
+      }
+      nodes.push_back(node);
+    }
+  }
+
+  index->nodes = nodes.data();
+  index->node_count = nodes.size();
+  index->names = names.data();
+  index->names_size = names.size();
+
+  if (stats) {
+    stats->directories_scanned = scanned;
+    stats->directories_reused = reused;
+  }
+  return index;
+}
+
+bool FileIndex::save(const std::string &file) const {
+  // A temporary file of its own, so processes saving the same root at once
+  // never write into one file.
+  std::string temp = file + ".XXXXXX";
+  try {
+    std::filesystem::create_directories(std::filesystem::path(file).parent_path());
+    int fd = mkstemp(temp.data());
+    if (fd < 0) return false;
+    fchmod(fd, 0644);
+    close(fd);
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      std::remove(temp.c_str());
+      return false;
+    }
+
+    FileHeader header{};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.node_size = sizeof(Node);
+    header.node_count = node_count;
+    header.names_size = names_size;
+    header.root_length = root_path.size();
+
+    static const char padding[8] = {};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(root_path.data(), root_path.size());
+    out.write(padding, align8(sizeof(header) + root_path.size()) - sizeof(header) - root_path.size());
+    out.write(reinterpret_cast<const char *>(nodes), node_count * sizeof(Node));
+    out.write(names, names_size);
+    out.close();
+    if (!out) {
+      std::remove(temp.c_str());
+      return false;
+    }
+  } catch (const std::exception &) {
+    std::remove(temp.c_str());
+    return false;
+  }
+  if (std::rename(temp.c_str(), file.c_str()) != 0) {
+    std::remove(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::string FileIndex::file_for_root(const std::string &index_dir, const std::string &root) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (char c : normalize_directory(root)) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.idx", static_cast<unsigned long long>(hash));
+  return index_dir + "/" + name;
+}
+
+std::string FileIndex::path_of(uint32_t id) const {
+  std::vector<uint32_t> chain;
+  for (uint32_t current = id; current != 0 && current != kNoNode; current = nodes[current].parent) {
+    chain.push_back(current);
+  }
+
+  std::string path = root_path;
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    if (path.back() != '/') {
+      path += '/';
+    }
+    path += name(*it);
+  }
+  return path;
+}
+
+uint32_t FileIndex::find(std::string_view path) const {
+  if (path.size() < root_path.size() || path.compare(0, root_path.size(), root_path) != 0) {
+    return kNoNode;
+  }
+
+  std::string_view rest = path.substr(root_path.size());
+  if (!rest.empty() && rest.front() != '/' && root_path != "/") {
+    return kNoNode;
+  }
+  uint32_t current = 0;
+  while (current != kNoNode) {
+    while (!rest.empty() && rest.front() == '/') {
+      rest.remove_prefix(1);
+    }
+    if (rest.empty()) return current;
+    size_t separator = rest.find('/');
+    current = find_child(*this, current, rest.substr(0, separator));
+    rest = separator == std::string_view::npos ? std::string_view() : rest.substr(separator);
+  }
+  return kNoNode;
+}
+
+void FileIndex::search(const SearchQuery &query, const SearchEngine::ResultCallback &on_results,
+                       const SearchEngine::ProgressCallback &progress, unsigned thread_count,
+                       const std::atomic<bool> *cancel, SearchProgress *live) const {
+  auto cancelled = [cancel] { return cancel && cancel->load(std::memory_order_relaxed); };
+  const auto started = ResultBatcher::Clock::now();
+
+  const unsigned threads = resolve_thread_count(thread_count);
+  const Matcher matcher(query.text);
+  const FuzzyMatcher fuzzy(query.text);
+  const QueryPlan plan(query);
+  const size_t relative_offset = root_path == "/" ? 1 : root_path.size() + 1;
+
+  // Unless the query contains a separator it cannot span path components, so
+  // a file matches when its name or the name of any ancestor does.
+  const bool spans_components = query.text.find('/') != std::string::npos;
+
+  ResultBatcher batcher(threads, query, on_results, cancel, live);
+  ProgressReporter reporter(progress, live);
+
+  const ContentScanner scanner(query.content, query.content_regex, query.cache);
+  const bool scan_contents = !query.content.empty();
+  std::unique_ptr<IndexIgnore> ignore;
+  if (query.ignore) {
+    ignore = std::make_unique<IndexIgnore>(*this, *query.ignore, threads);
+  }
+  struct ReadState {
+    std::vector<char> buffer;
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    uint64_t cache_hits = 0;
+    uint64_t ns = 0;
+  };
+  std::vector<ReadState> reads(scan_contents ? threads : 0);
+  // Names are checked before the path is built.
+  auto wanted = [&](uint32_t id) { return plan.matches_name(name(id)); };
+  auto emit = [&](unsigned worker, uint32_t id, const std::string &path, int32_t score = 0) {
+    const std::string_view relative = std::string_view(path).substr(std::min(relative_offset, path.size()));
+    if (plan.needs_path() && !plan.matches_path(relative)) return;
+    if (ignore && ignore->ignored(worker, id, relative)) return;
+    // A refresh only rescans directories whose own mtime changed, so the
+    // sizes and mtimes stored for files may be stale; stat as the walker does.
+    if (plan.needs_metadata()) {
+      EntryMetadata metadata;
+      EntryType type;
+      if (!stat_entry(AT_FDCWD, path.c_str(), type, &metadata) || !plan.matches_metadata(metadata)) {
+        return;
+      }
+    }
+    if (!scan_contents) {
+      batcher.add(worker, path, 0, score);
+      return;
+    }
+    if (nodes[id].type != static_cast<uint8_t>(EntryType::File) || batcher.stopped()) return;
+    ReadState &read = reads[worker];
+    auto read_begin = ResultBatcher::Clock::now();
+    uint32_t found =
+        scanner.scan(AT_FDCWD, path.c_str(), read.buffer, &read.bytes, &read.cache_hits);
+    read.ns += elapsed_ns(read_begin, ResultBatcher::Clock::now());
+    read.files++;
+    if (found) {
+      batcher.add(worker, path, found, score);
+    }
+    batcher.tick(worker);
+  };
+  auto finish = [&](uint64_t busy_ns) {
+    if (query.cache) {
+      query.cache->flush();
+    }
+    if (!live) return;
+    SearchStats &stats = live->stats;
+    stats = SearchStats();
+    stats.entries_read = live->files_seen.load(std::memory_order_relaxed);
+    stats.directories_skipped = ignore ? ignore->directories_skipped() : 0;
+    for (const ReadState &read : reads) {
+      stats.files_read += read.files;
+      stats.bytes_read += read.bytes;
+      stats.cache_hits += read.cache_hits;
+      stats.read_ns += read.ns;
+    }
+    finish_stats(stats, *live, batcher, started, busy_ns);
+  };
+
+  // Without query text, a literal the other terms require (such as a
+  // regex's) narrows by its trigrams the same way, and a required extension
+  // alone by those of ".ext"; matching directories do not pull in their
+  // subtree then. Fuzzy patterns need not
+  // contain any trigram of the path and always scan.
+  std::vector<uint32_t> candidates;
+  std::unique_ptr<Matcher> literal_matcher;
+  bool indexed = false;
+  if (!query.fuzzy && !matcher.empty() && !spans_components) {
+    indexed = trigrams().candidates(matcher.folded_needle(), candidates);
+  } else if (matcher.empty() && plan.required_literal().size() >= 3) {
+    indexed = trigrams().candidates(plan.required_literal(), candidates);
+    literal_matcher = std::make_unique<Matcher>(plan.required_literal());
+  } else if (matcher.empty() && !plan.required_extension().empty()) {
+    indexed = trigrams().candidates("." + std::string(plan.required_extension()), candidates);
+  }
+  if (indexed) {
+    uint64_t busy_ns = search_candidates(candidates, literal_matcher ? *literal_matcher : matcher,
+                                         wanted, emit, batcher, reporter, threads);
+    batcher.flush_all();
+    finish(busy_ns);
+    if (reporter && !cancelled()) {
+      reporter.report(1.0);
+    }
+    return;
+  }
+
+  // Parents precede their children, so one forward pass resolves every
+  // directory.
+  std::vector<uint8_t> directory_matches;
+  if (!matcher.empty() && !spans_components && !query.fuzzy) {
+    directory_matches.assign(node_count, 0);
+    for (uint32_t id = 1; id < node_count; id++) {
+      const Node &node = nodes[id];
+      if (node.type != static_cast<uint8_t>(EntryType::Directory)) continue;
+      directory_matches[id] = directory_matches[node.parent] || matcher.matches(name(id));
+    }
+  }
+
+  // Reading files is slow enough to need finer chunks to balance.
+  const size_t chunk_size = scan_contents ? kCandidateChunk : kSearchChunk;
+  const size_t chunk_count = (node_count + chunk_size - 1) / chunk_size;
+  std::atomic<size_t> next_chunk{0};
+  std::atomic<size_t> chunks_done{0};
+  std::atomic<uint64_t> busy_ns{0};
+
+  run_on_threads(threads, [&](unsigned worker) {
+    const auto worker_started = ResultBatcher::Clock::now();
+    for (;;) {
+      size_t chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+      if (chunk >= chunk_count || batcher.stopped()) break;
+
+      size_t end = std::min(node_count, (chunk + 1) * chunk_size);
+      uint64_t files = 0;
+      for (size_t id = std::max<size_t>(1, chunk * chunk_size); id < end; id++) {
+        const Node &node = nodes[id];
+        if (node.type == static_cast<uint8_t>(EntryType::Directory)) continue;
+        files++;
+
+        std::string_view entry_name = name(static_cast<uint32_t>(id));
+        if (!wanted(static_cast<uint32_t>(id))) continue;
+
+        if (query.fuzzy) {
+          std::string path = path_of(static_cast<uint32_t>(id));
+          int32_t score = 0;
+          if (fuzzy.score(std::string_view(path).substr(std::min(relative_offset, path.size())),
+                          score)) {
+            emit(worker, static_cast<uint32_t>(id), path, score);
+          }
+        } else if (matcher.empty() ||
+            (!spans_components && (directory_matches[node.parent] || matcher.matches(entry_name)))) {
+          emit(worker, static_cast<uint32_t>(id), path_of(static_cast<uint32_t>(id)));
+        } else if (spans_components) {
+          std::string path = path_of(static_cast<uint32_t>(id));
+          if (matcher.matches(std::string_view(path).substr(std::min(relative_offset, path.size())))) {
+            emit(worker, static_cast<uint32_t>(id), path);
+          }
+        }
+      }
+
+      batcher.tick(worker);
+      if (reporter) {
+        reporter.add_files(files);
+        reporter.report(static_cast<double>(chunks_done.fetch_add(1) + 1) / chunk_count);
+      }
+    }
+    busy_ns.fetch_add(elapsed_ns(worker_started, ResultBatcher::Clock::now()),
+                      std::memory_order_relaxed);
+  });
+
+  batcher.flush_all();
+  finish(busy_ns.load());
+
+  if (reporter && !cancelled()) {
+    reporter.report(1.0);
+  }
+}
+
+uint64_t FileIndex::search_candidates(const std::vector<uint32_t> &candidates, const Matcher &matcher,
+                                     const Wanted &wanted, const Emit &emit, ResultBatcher &batcher,
+                                     ProgressReporter &reporter, unsigned threads) const {
+  auto stopped = [&batcher] { return batcher.stopped(); };
+  auto is_directory = [this](uint32_t id) {
+    return nodes[id].type == static_cast<uint8_t>(EntryType::Directory);
+  };
+  // Trigrams are hashed, so candidates still have to contain the needle.
+  std::vector<uint32_t> matched;
+  std::vector<uint32_t> matched_directories;
+  for (uint32_t id : candidates) {
+    if (!matcher.matches(name(id))) continue;
+    if (is_directory(id)) {
+      if (matcher.empty()) continue;
+      matched_directories.push_back(id);
+    }
+    matched.push_back(id);
+  }
+
+  // A match inside a matching directory is reported with that directory's
+  // subtree.
+  auto covered = [&](uint32_t id) {
+    for (uint32_t parent = nodes[id].parent; parent != 0 && parent != kNoNode;
+         parent = nodes[parent].parent) {
+      if (std::binary_search(matched_directories.begin(), matched_directories.end(), parent)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  const size_t chunk_count = (matched.size() + kCandidateChunk - 1) / kCandidateChunk;
+  std::atomic<size_t> next_chunk{0};
+  std::atomic<size_t> chunks_done{0};
+  std::atomic<uint64_t> busy_ns{0};
+
+  run_on_threads(threads, [&](unsigned worker) {
+    const auto worker_started = ResultBatcher::Clock::now();
+    std::vector<uint32_t> pending;
+    for (;;) {
+      size_t chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+      if (chunk >= chunk_count || stopped()) break;
+
+      size_t end = std::min(matched.size(), (chunk + 1) * kCandidateChunk);
+      uint64_t files = 0;
+      for (size_t i = chunk * kCandidateChunk; i < end; i++) {
+        uint32_t id = matched[i];
+        if (covered(id)) continue;
+        if (!is_directory(id)) {
+          files++;
+          if (wanted(id)) emit(worker, id, path_of(id));
+          continue;
+        }
+
+        pending.assign(1, id);
+        while (!pending.empty() && !stopped()) {
+          const Node &node = nodes[pending.back()];
+          pending.pop_back();
+          for (uint32_t child = node.first_child; child < node.first_child + node.child_count;
+               child++) {
+            if (is_directory(child)) {
+              pending.push_back(child);
+              continue;
+            }
+            files++;
+            if (wanted(child)) {
+              emit(worker, child, path_of(child));
+            }
+          }
+          batcher.tick(worker);
+        }
+      }
+
+      batcher.tick(worker);
+      if (reporter) {
+        reporter.add_files(files);
+        reporter.report(static_cast<double>(chunks_done.fetch_add(1) + 1) / chunk_count);
+      }
+    }
+    busy_ns.fetch_add(elapsed_ns(worker_started, ResultBatcher::Clock::now()),
+                      std::memory_order_relaxed);
+  });
+  return busy_ns.load();
+}
+
+const TrigramIndex &FileIndex::trigrams() const {
+  std::call_once(trigram_once, [this] {
+    trigram_index = std::make_unique<TrigramIndex>(*this);
+    trigrams_built.store(true, std::memory_order_release);
+  });
+  return *trigram_index;
+}
+
+size_t FileIndex::memory_bytes() const {
+  size_t bytes = node_count * sizeof(Node) + names_size;
+  if (trigrams_built.load(std::memory_order_acquire)) {
+    bytes += trigram_index->memory_bytes();
+  }
+  return bytes;
+}
+
+IndexStore::IndexStore(std::string root, std::string file)
+    : root(normalize_directory(std::move(root))), file(std::move(file)) {
+  auto loaded = FileIndex::load(this->file);
+  if (loaded && loaded->root() == this->root) {
+    current = std::move(loaded);
+  }
+}
+
+std::shared_ptr<const FileIndex> IndexStore::snapshot() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return current;
+}
+
+bool IndexStore::refresh(unsigned thread_count, const std::atomic<bool> *cancel,
+                         FileIndex::RefreshStats *stats) {
+  std::lock_guard<std::mutex> refresh_lock(refresh_mutex);
+  auto previous = snapshot();
+  std::shared_ptr<const FileIndex> fresh =
+      FileIndex::build(root, previous.get(), thread_count, cancel, stats);
+  if (!fresh) return false;
+
+  // Publish the mapped copy when possible so the built arrays can be freed
+  // and the index pages are shared with the page cache.
+  if (fresh->save(file)) {
+    if (auto mapped = FileIndex::load(file)) {
+      fresh = std::move(mapped);
+    }
+  }
+
+  // Searches on the published snapshot should not pay for the trigram table.
+  fresh->trigrams();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  current = std::move(fresh);
+  return true;
+}
+
+bool IndexStore::update(const FileIndex::UpdatePlan &plan, unsigned thread_count,
+                        FileIndex::RefreshStats *stats) {
+  std::lock_guard<std::mutex> refresh_lock(refresh_mutex);
+  auto previous = snapshot();
+  if (!previous) return false;
+
+  std::shared_ptr<const FileIndex> fresh =
+      FileIndex::build(root, previous.get(), thread_count, nullptr, stats, &plan);
+  if (!fresh) return false;
+
+  // Searches on the published snapshot should not pay for the trigram table.
+  fresh->trigrams();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  current = std::move(fresh);
+  return true;
+}
+
+bool IndexStore::save() {
+  auto index = snapshot();
+  return index && index->save(file);
+}
+
+} // namespace orion
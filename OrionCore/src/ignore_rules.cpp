@@ -0,0 +1,194 @@
+#include "ignore_rules.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace orion {
+
+namespace {
+
+// Larger ignore files are read only this far.
+constexpr size_t kMaxFileSize = 1 << 20;
+
+bool has_wildcard(std::string_view pattern) {
+  return pattern.find_first_of("*?[\\") != std::string_view::npos;
+}
+
+// Matches `c` against the class opening at pattern[start]. Returns the index
+// after the closing ']', or npos if the class is never closed.
+size_t match_class(std::string_view pattern, size_t start, char c, bool &in_class) {
+  size_t i = start + 1;
+  bool invert = false;
+  if (i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^')) {
+    invert = true;
+    i++;
+  }
+  bool found = false;
+  bool first = true;
+  while (i < pattern.size() && (pattern[i] != ']' || first)) {
+    first = false;
+    char low = pattern[i];
+    if (low == '\\' && i + 1 < pattern.size()) {
+      low = pattern[++i];
+    }
+    if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+      found = found || (c >= low && c <= pattern[i + 2]);
+      i += 3;
+    } else {
+      found = found || c == low;
+      i++;
+    }
+  }
+  if (i >= pattern.size()) return std::string_view::npos;
+  in_class = found != invert && c != '/';
+  return i + 1;
+}
+
+bool glob_matches(std::string_view pattern, std::string_view text) {
+  size_t p = 0;
+  size_t t = 0;
+  while (p < pattern.size()) {
+    const char c = pattern[p];
+    if (c == '*') {
+      size_t stars = p;
+      while (p < pattern.size() && pattern[p] == '*') p++;
+      if (p - stars >= 2 && (stars == 0 || pattern[stars - 1] == '/')) {
+        // "**/" matches any number of whole directories, a trailing "**"
+        // everything left. Elsewhere "**" is a plain '*'.
+        if (p == pattern.size()) return true;
+        if (pattern[p] == '/') {
+          std::string_view rest = pattern.substr(p + 1);
+          if (glob_matches(rest, text.substr(t))) return true;
+          for (size_t k = t; k < text.size(); k++) {
+            if (text[k] == '/' && glob_matches(rest, text.substr(k + 1))) return true;
+          }
+          return false;
+        }
+      }
+      std::string_view rest = pattern.substr(p);
+      for (size_t k = t;; k++) {
+        if (glob_matches(rest, text.substr(k))) return true;
+        if (k >= text.size() || text[k] == '/') return false;
+      }
+    }
+    if (t >= text.size()) return false;
+    if (c == '?') {
+      if (text[t] == '/') return false;
+      p++;
+      t++;
+      continue;
+    }
+    if (c == '[') {
+      bool in_class = false;
+      size_t next = match_class(pattern, p, text[t], in_class);
+      if (next != std::string_view::npos) {
+        if (!in_class) return false;
+        p = next;
+        t++;
+        continue;
+      }
+    }
+    size_t literal = c == '\\' && p + 1 < pattern.size() ? p + 1 : p;
+    if (pattern[literal] != text[t]) return false;
+    p = literal + 1;
+    t++;
+  }
+  return t == text.size();
+}
+
+} // namespace
+
+std::vector<std::string> IgnoreSettings::default_excludes() {
+  return {".git/", ".hg/", ".svn/", "node_modules/", ".build/", "__pycache__/"};
+}
+
+IgnoreRules::IgnoreRules(std::string base, std::shared_ptr<const IgnoreRules> parent)
+    : base(std::move(base)), parent(std::move(parent)) {}
+
+void IgnoreRules::add(std::string_view text) {
+  while (!text.empty()) {
+    size_t end = text.find('\n');
+    std::string_view line = text.substr(0, end);
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    while (!line.empty() && line.back() == ' ' &&
+           !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+      line.remove_suffix(1);
+    }
+    if (line.empty() || line.front() == '#') continue;
+
+    Rule rule{Rule::Kind::Glob, false, false, false, {}};
+    if (line.front() == '!') {
+      rule.negated = true;
+      line.remove_prefix(1);
+    } else if (line.size() >= 2 && line[0] == '\\' && (line[1] == '!' || line[1] == '#')) {
+      line.remove_prefix(1);
+    }
+    if (!line.empty() && line.back() == '/') {
+      rule.directory_only = true;
+      line.remove_suffix(1);
+    }
+    // "**/name" is the same as "name": any depth.
+    if (line.size() > 3 && line.substr(0, 3) == "**/" &&
+        line.find('/', 3) == std::string_view::npos) {
+      line.remove_prefix(3);
+    }
+    rule.anchored = line.find('/') != std::string_view::npos;
+    if (!line.empty() && line.front() == '/') line.remove_prefix(1);
+    if (line.empty()) continue;
+
+    if (!has_wildcard(line)) {
+      rule.kind = Rule::Kind::Literal;
+    } else if (!rule.anchored && line.front() == '*' && !has_wildcard(line.substr(1))) {
+      rule.kind = Rule::Kind::Suffix;
+      line.remove_prefix(1);
+    }
+    rule.pattern = std::string(line);
+    rules.push_back(std::move(rule));
+  }
+}
+
+void IgnoreRules::add_file(int dir_fd, const char *name) {
+  int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return;
+  std::string text;
+  char chunk[16384];
+  ssize_t bytes;
+  while (text.size() < kMaxFileSize && (bytes = read(fd, chunk, sizeof(chunk))) > 0) {
+    text.append(chunk, static_cast<size_t>(bytes));
+  }
+  close(fd);
+  add(text);
+}
+
+bool IgnoreRules::Rule::matches(std::string_view text) const {
+  switch (kind) {
+  case Kind::Literal:
+    return text == pattern;
+  case Kind::Suffix:
+    return text.size() >= pattern.size() &&
+           text.compare(text.size() - pattern.size(), pattern.size(), pattern) == 0;
+  default:
+    return glob_matches(pattern, text);
+  }
+}
+
+bool IgnoreRules::ignored(std::string_view relative, bool directory) const {
+  for (const IgnoreRules *level = this; level; level = level->parent.get()) {
+    std::string_view local = relative;
+    if (!level->base.empty()) {
+      local.remove_prefix(std::min(local.size(), level->base.size() + 1));
+    }
+    const size_t slash = local.rfind('/');
+    const std::string_view name = slash == std::string_view::npos ? local : local.substr(slash + 1);
+    for (auto rule = level->rules.rbegin(); rule != level->rules.rend(); ++rule) {
+      if (rule->directory_only && !directory) continue;
+      if (rule->matches(rule->anchored ? local : name)) return !rule->negated;
+    }
+  }
+  return false;
+}
+
+} // namespace orion
@@ -0,0 +1,342 @@
+#include "index_watcher.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+namespace orion {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Events are collected for this long after the first one before the index
+// is updated, and never for longer than kMaxBatchDelay under a steady stream.
+constexpr auto kBatchWindow = std::chrono::milliseconds(250);
+constexpr auto kMaxBatchDelay = std::chrono::seconds(2);
+// How often subtrees without watches are re-checked by mtime.
+constexpr auto kVerifyInterval = std::chrono::seconds(30);
+// Updates are only written to disk this often; the in-memory index is always
+// current.
+constexpr auto kSaveInterval = std::chrono::seconds(60);
+
+#if defined(__linux__)
+constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+#endif
+
+std::string join_path(const std::string &dir, const char *name) {
+  std::string path = dir;
+  if (path.back() != '/') {
+    path += '/';
+  }
+  path += name;
+  return path;
+}
+
+} // namespace
+
+IndexWatcher::IndexWatcher(std::shared_ptr<IndexStore> store, unsigned thread_count)
+    : store(std::move(store)), threads(thread_count) {}
+
+IndexWatcher::~IndexWatcher() { stop(); }
+
+#if defined(__linux__)
+
+bool IndexWatcher::start() {
+  if (runner.joinable()) return true;
+
+  auto index = store->snapshot();
+  if (!index) return false;
+
+  notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (notify_fd < 0) return false;
+  if (pipe2(stop_pipe, O_CLOEXEC) != 0) {
+    close(notify_fd);
+    notify_fd = -1;
+    return false;
+  }
+
+  runner = std::thread([this, index] {
+    watch_subtree(*index, 0);
+    run();
+  });
+  return true;
+}
+
+void IndexWatcher::stop() {
+  if (runner.joinable()) {
+    char byte = 0;
+    if (write(stop_pipe[1], &byte, 1) < 0) {
+      // The watcher also stops when the pipe is closed below.
+    }
+    runner.join();
+  }
+  for (int &fd : stop_pipe) {
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (notify_fd >= 0) {
+    close(notify_fd);
+    notify_fd = -1;
+  }
+  wd_paths.clear();
+  path_wds.clear();
+  unwatched.clear();
+  watch_count = 0;
+  unwatched_count = 0;
+}
+
+void IndexWatcher::watch_subtree(const FileIndex &index, uint32_t id, bool through_watched,
+                                 std::vector<std::string> *added) {
+  std::vector<uint32_t> pending{id};
+  while (!pending.empty()) {
+    uint32_t current = pending.back();
+    pending.pop_back();
+
+    // A watched directory's subtree was handled when it was first watched,
+    // unless events were lost since.
+    std::string path = index.path_of(current);
+    if (unwatched.count(path) > 0) continue;
+    if (path_wds.count(path) == 0) {
+      int wd = inotify_add_watch(notify_fd, path.c_str(), kWatchMask);
+      if (wd < 0) {
+        // Out of watches: the subtree is re-checked by mtime instead. Other
+        // errors mean the directory is gone or unreadable.
+        if (errno == ENOSPC || errno == ENOMEM) {
+          unwatched.insert(path);
+          unwatched_count = unwatched.size();
+        }
+        continue;
+      }
+      wd_paths[wd] = path;
+      path_wds[path] = wd;
+      if (added) added->push_back(path);
+    } else if (!through_watched) {
+      continue;
+    }
+
+    const FileIndex::Node &node = index.node(current);
+    for (uint32_t i = 0; i < node.child_count; i++) {
+      uint32_t child = node.first_child + i;
+      if (index.node(child).type == static_cast<uint8_t>(EntryType::Directory)) {
+        pending.push_back(child);
+      }
+    }
+  }
+  watch_count = wd_paths.size();
+}
+
+void IndexWatcher::rename_watches(const std::string &from, const std::string &to,
+                                  std::unordered_set<std::string> &dirty) {
+  std::string prefix = from + "/";
+  auto moved = [&](const std::string &path) {
+    return path == from || path.compare(0, prefix.size(), prefix) == 0;
+  };
+
+  for (auto &[wd, path] : wd_paths) {
+    if (moved(path)) {
+      path_wds.erase(path);
+      path = to + path.substr(from.size());
+      path_wds[path] = wd;
+    }
+  }
+
+  // Changes recorded earlier in the batch now live under the new path.
+  std::vector<std::string> renamed;
+  for (auto it = dirty.begin(); it != dirty.end();) {
+    if (moved(*it)) {
+      renamed.push_back(to + it->substr(from.size()));
+      it = dirty.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  dirty.insert(renamed.begin(), renamed.end());
+}
+
+void IndexWatcher::run() {
+  FileIndex::UpdatePlan plan;
+  std::unordered_map<uint32_t, std::string> moved_from;
+  std::vector<std::pair<std::string, std::string>> renames;
+  std::vector<char> buffer(64 * 1024);
+
+  bool pending = false;
+  bool unsaved = false;
+  Clock::time_point first_event;
+  Clock::time_point last_event;
+  Clock::time_point last_verify = Clock::now();
+  Clock::time_point last_save = Clock::now();
+
+  auto apply = [&] {
+    auto previous = store->snapshot();
+    for (const auto &[from, to] : renames) {
+      uint32_t id = previous ? previous->find(from) : FileIndex::kNoNode;
+      if (id != FileIndex::kNoNode) {
+        plan.moved[to] = id;
+      }
+    }
+
+    std::vector<std::string> added;
+    if (store->update(plan, threads)) {
+      unsaved = true;
+      // Watch directories that appeared in this batch, and any a re-checked
+      // subtree gained while its events were lost. Renamed ones kept their
+      // watches and are skipped by watch_subtree.
+      auto index = store->snapshot();
+      for (const auto &root : plan.verify) {
+        uint32_t id = index->find(root);
+        if (id != FileIndex::kNoNode) {
+          watch_subtree(*index, id, true, &added);
+        }
+      }
+      for (const auto &dir : plan.dirty) {
+        uint32_t id = index->find(dir);
+        if (id == FileIndex::kNoNode) continue;
+        const FileIndex::Node &node = index->node(id);
+        for (uint32_t i = 0; i < node.child_count; i++) {
+          uint32_t child = node.first_child + i;
+          if (index->node(child).type == static_cast<uint8_t>(EntryType::Directory)) {
+            watch_subtree(*index, child, false, &added);
+          }
+        }
+      }
+    }
+
+    plan = FileIndex::UpdatePlan();
+    moved_from.clear();
+    renames.clear();
+    pending = false;
+
+    // Entries created in a new directory after it was read but before its
+    // watch was added raised no event, so it is read once more.
+    if (!added.empty()) {
+      plan.dirty.insert(added.begin(), added.end());
+      pending = true;
+      first_event = last_event = Clock::now();
+    }
+  };
+
+  for (;;) {
+    auto now = Clock::now();
+    int timeout = -1;
+    auto until = [&](Clock::time_point deadline) {
+      auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+      int value = static_cast<int>(std::max<int64_t>(0, ms));
+      timeout = timeout < 0 ? value : std::min(timeout, value);
+    };
+    if (pending) {
+      until(std::min(last_event + kBatchWindow, first_event + kMaxBatchDelay));
+    }
+    if (!unwatched.empty()) {
+      until(last_verify + kVerifyInterval);
+    }
+    if (unsaved) {
+      until(last_save + kSaveInterval);
+    }
+
+    pollfd fds[2] = {{notify_fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+    int ready = poll(fds, 2, timeout);
+    if (ready < 0 && errno != EINTR) break;
+    if (fds[1].revents) break;
+
+    now = Clock::now();
+    if (ready > 0 && (fds[0].revents & POLLIN)) {
+      ssize_t bytes;
+      while ((bytes = read(notify_fd, buffer.data(), buffer.size())) > 0) {
+        for (ssize_t offset = 0; offset < bytes;) {
+          auto *event = reinterpret_cast<inotify_event *>(buffer.data() + offset);
+          offset += sizeof(inotify_event) + event->len;
+
+          if (event->mask & IN_Q_OVERFLOW) {
+            plan.verify.insert(store->root_path());
+          } else if (event->mask & IN_IGNORED) {
+            auto it = wd_paths.find(event->wd);
+            if (it != wd_paths.end()) {
+              path_wds.erase(it->second);
+              wd_paths.erase(it);
+            }
+            continue;
+          } else {
+            auto it = wd_paths.find(event->wd);
+            if (it == wd_paths.end() || event->len == 0) continue;
+            const std::string &dir = it->second;
+            plan.dirty.insert(dir);
+
+            if (event->mask & IN_ISDIR) {
+              if (event->mask & IN_MOVED_FROM) {
+                moved_from[event->cookie] = join_path(dir, event->name);
+              } else if (event->mask & IN_MOVED_TO) {
+                auto from = moved_from.find(event->cookie);
+                if (from != moved_from.end()) {
+                  std::string to = join_path(dir, event->name);
+                  rename_watches(from->second, to, plan.dirty);
+                  renames.emplace_back(from->second, std::move(to));
+                  moved_from.erase(from);
+                }
+              }
+            }
+          }
+
+          if (!pending) {
+            pending = true;
+            first_event = now;
+          }
+          last_event = now;
+        }
+      }
+    }
+
+    if (!unwatched.empty() && now - last_verify >= kVerifyInterval) {
+      plan.verify.insert(unwatched.begin(), unwatched.end());
+      last_verify = now;
+      pending = true;
+      first_event = last_event = now - kBatchWindow;
+    }
+
+    if (pending && (now - last_event >= kBatchWindow || now - first_event >= kMaxBatchDelay)) {
+      apply();
+      watch_count = wd_paths.size();
+    }
+
+    if (unsaved && now - last_save >= kSaveInterval) {
+      store->save();
+      unsaved = false;
+      last_save = now;
+    }
+  }
+
+  if (pending) {
+    apply();
+  }
+  if (unsaved) {
+    store->save();
+  }
+}
+
+#else
+
+bool IndexWatcher::start() { return false; }
+
+void IndexWatcher::stop() {}
+
+void IndexWatcher::watch_subtree(const FileIndex &, uint32_t, bool, std::vector<std::string> *) {}
+
+void IndexWatcher::rename_watches(const std::string &, const std::string &,
+                                  std::unordered_set<std::string> &) {}
+
+void IndexWatcher::run() {}
+
+#endif
+
+} // namespace orion
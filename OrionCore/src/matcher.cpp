@@ -0,0 +1,407 @@
+#include "matcher.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ORION_MATCHER_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+// AVX2 is selected at run time so the library still runs on older CPUs.
+#define ORION_MATCHER_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ORION_ALWAYS_INLINE __attribute__((always_inline))
+#else
+#define ORION_ALWAYS_INLINE
+#endif
+
+namespace orion {
+
+namespace {
+
+char fold_ascii(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+bool is_ascii(std::string_view text) {
+  return std::none_of(text.begin(), text.end(),
+                      [](char c) { return static_cast<unsigned char>(c) >= 0x80; });
+}
+
+// Simple lower-case mapping for the scripts that have case. Characters whose
+// lower case is ASCII (KELVIN SIGN, LONG S, dotted capital I) are left alone,
+// so an ASCII needle only ever matches ASCII bytes and can be searched for
+// bytewise.
+uint32_t fold_code_point(uint32_t c) {
+  if (c >= 0xC0 && c <= 0xDE && c != 0xD7) return c + 0x20;
+  if ((c >= 0x100 && c <= 0x12F) || (c >= 0x132 && c <= 0x137) || (c >= 0x14A && c <= 0x177)) {
+    return c | 1;
+  }
+  if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) return (c & 1) ? c + 1 : c;
+  if (c == 0x178) return 0xFF;
+  if (c == 0x386) return 0x3AC;
+  if (c >= 0x388 && c <= 0x38A) return c + 37;
+  if (c == 0x38C) return 0x3CC;
+  if (c == 0x38E || c == 0x38F) return c + 63;
+  if (c >= 0x391 && c <= 0x3AB && c != 0x3A2) return c + 32;
+  if (c >= 0x400 && c <= 0x40F) return c + 80;
+  if (c >= 0x410 && c <= 0x42F) return c + 32;
+  if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) || (c >= 0x4D0 && c <= 0x52F)) {
+    return c | 1;
+  }
+  if (c == 0x4C0) return 0x4CF;
+  if (c >= 0x4C1 && c <= 0x4CE) return (c & 1) ? c + 1 : c;
+  if (c >= 0x531 && c <= 0x556) return c + 48;
+  if (c >= 0x10A0 && c <= 0x10C5) return c + 0x1C60;
+  if ((c >= 0x1E00 && c <= 0x1E95) || (c >= 0x1EA0 && c <= 0x1EFF)) return c | 1;
+  if (c >= 0x2160 && c <= 0x216F) return c + 16;
+  if (c >= 0x24B6 && c <= 0x24CF) return c + 26;
+  if (c >= 0xFF21 && c <= 0xFF3A) return c + 32;
+  if (c >= 0x10400 && c <= 0x10427) return c + 40;
+  return c;
+}
+
+// Decodes one UTF-8 sequence. Returns its length, or 0 if the bytes are not
+// valid UTF-8 and should be copied through unchanged.
+size_t decode_utf8(const unsigned char *p, size_t available, uint32_t &c) {
+  if (p[0] >= 0xC2 && p[0] <= 0xDF && available >= 2 && (p[1] & 0xC0) == 0x80) {
+    c = (uint32_t(p[0] & 0x1F) << 6) | (p[1] & 0x3F);
+    return 2;
+  }
+  if (p[0] >= 0xE0 && p[0] <= 0xEF && available >= 3 && (p[1] & 0xC0) == 0x80 &&
+      (p[2] & 0xC0) == 0x80) {
+    c = (uint32_t(p[0] & 0x0F) << 12) | (uint32_t(p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+    return c >= 0x800 ? 3 : 0;
+  }
+  if (p[0] >= 0xF0 && p[0] <= 0xF4 && available >= 4 && (p[1] & 0xC0) == 0x80 &&
+      (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80) {
+    c = (uint32_t(p[0] & 0x07) << 18) | (uint32_t(p[1] & 0x3F) << 12) |
+        (uint32_t(p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+    return c >= 0x10000 && c <= 0x10FFFF ? 4 : 0;
+  }
+  return 0;
+}
+
+void append_utf8(std::string &out, uint32_t c) {
+  if (c < 0x800) {
+    out += static_cast<char>(0xC0 | (c >> 6));
+  } else if (c < 0x10000) {
+    out += static_cast<char>(0xE0 | (c >> 12));
+    out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (c >> 18));
+    out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+  }
+  out += static_cast<char>(0x80 | (c & 0x3F));
+}
+
+void fold_into(std::string &out, std::string_view text) {
+  out.clear();
+  const auto *bytes = reinterpret_cast<const unsigned char *>(text.data());
+  for (size_t i = 0; i < text.size();) {
+    if (bytes[i] < 0x80) {
+      out += fold_ascii(text[i++]);
+      continue;
+    }
+    uint32_t c;
+    size_t length = decode_utf8(bytes + i, text.size() - i, c);
+    if (length == 0) {
+      out += text[i++];
+      continue;
+    }
+    append_utf8(out, fold_code_point(c));
+    i += length;
+  }
+}
+
+// Compares the needle against the haystack at `at`, skipping the first and
+// last byte, which the vector filters have already checked.
+bool middle_matches(const char *at, const std::string &needle) {
+  for (size_t j = 1; j + 1 < needle.size(); j++) {
+    if (fold_ascii(at[j]) != needle[j]) return false;
+  }
+  return true;
+}
+
+bool find_scalar(const char *haystack, size_t length, size_t start, const std::string &needle) {
+  const char first = needle.front();
+  const char last = needle.back();
+  for (size_t i = start; i + needle.size() <= length; i++) {
+    if (fold_ascii(haystack[i]) == first &&
+        fold_ascii(haystack[i + needle.size() - 1]) == last &&
+        middle_matches(haystack + i, needle)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#if defined(ORION_MATCHER_SSE2)
+
+inline unsigned lowest_bit(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// Adds 0x20 to the bytes in 'A'..'Z'. Bytes >= 0x80 compare as negative and
+// are left unchanged.
+ORION_ALWAYS_INLINE inline __m128i fold_block(__m128i block) {
+  __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('A' - 1)),
+                                _mm_cmplt_epi8(block, _mm_set1_epi8('Z' + 1)));
+  return _mm_add_epi8(block, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+// Compares the first and last needle byte against 16 candidate positions at
+// once and only verifies the positions where both agree. Advances `i` past
+// the blocks it checked.
+ORION_ALWAYS_INLINE inline bool scan_blocks(const char *haystack, size_t length, size_t &i,
+                                            const std::string &needle) {
+  const __m128i first = _mm_set1_epi8(needle.front());
+  const __m128i last = _mm_set1_epi8(needle.back());
+  const size_t last_offset = needle.size() - 1;
+
+  for (; i + last_offset + 16 <= length; i += 16) {
+    __m128i head = fold_block(_mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i)));
+    __m128i tail = fold_block(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i + last_offset)));
+    unsigned mask = static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last))));
+    while (mask != 0) {
+      unsigned bit = lowest_bit(mask);
+      if (middle_matches(haystack + i + bit, needle)) return true;
+      mask &= mask - 1;
+    }
+  }
+  return false;
+}
+
+bool find_sse2(const char *haystack, size_t length, const std::string &needle) {
+  size_t i = 0;
+  return scan_blocks(haystack, length, i, needle) || find_scalar(haystack, length, i, needle);
+}
+
+#endif
+
+#if defined(ORION_MATCHER_AVX2)
+
+__attribute__((target("avx2"))) inline __m256i fold_block_avx2(__m256i block) {
+  __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8('A' - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), block));
+  return _mm256_add_epi8(block, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2"))) bool find_avx2(const char *haystack, size_t length,
+                                               const std::string &needle) {
+  const __m256i first = _mm256_set1_epi8(needle.front());
+  const __m256i last = _mm256_set1_epi8(needle.back());
+  const size_t last_offset = needle.size() - 1;
+
+  size_t i = 0;
+  for (; i + last_offset + 32 <= length; i += 32) {
+    __m256i head =
+        fold_block_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i)));
+    __m256i tail = fold_block_avx2(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(haystack + i + last_offset)));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last))));
+    while (mask != 0) {
+      unsigned bit = lowest_bit(mask);
+      if (middle_matches(haystack + i + bit, needle)) return true;
+      mask &= mask - 1;
+    }
+  }
+  // The remainder is scanned with the 16-byte loop inlined here, so it is
+  // VEX-encoded too; switching to legacy SSE code with dirty upper halves
+  // stalls on many CPUs.
+  return scan_blocks(haystack, length, i, needle) || find_scalar(haystack, length, i, needle);
+}
+
+bool has_avx2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+
+#endif
+
+bool find_folded_ascii(std::string_view haystack, const std::string &needle) {
+  if (haystack.size() < needle.size()) return false;
+#if defined(ORION_MATCHER_AVX2)
+  if (haystack.size() >= 32 + needle.size() && has_avx2()) {
+    return find_avx2(haystack.data(), haystack.size(), needle);
+  }
+#endif
+#if defined(ORION_MATCHER_SSE2)
+  return find_sse2(haystack.data(), haystack.size(), needle);
+#else
+  return find_scalar(haystack.data(), haystack.size(), 0, needle);
+#endif
+}
+
+constexpr int32_t kScoreMatch = 16;
+constexpr int32_t kScoreGapStart = -3;
+constexpr int32_t kScoreGapExtension = -1;
+constexpr int32_t kBonusComponent = 10;
+constexpr int32_t kBonusWord = 8;
+constexpr int32_t kBonusCamelCase = 7;
+constexpr int32_t kBonusConsecutive = 4;
+constexpr int32_t kBonusBasename = 2;
+constexpr int32_t kFirstCharMultiplier = 2;
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// Bonus for a match at `i`: the start of a path component beats the start
+// of a word, which beats a camelCase hump or the first digit of a number.
+int32_t boundary_bonus(std::string_view text, size_t i) {
+  if (i == 0 || text[i - 1] == '/') return kBonusComponent;
+  char previous = text[i - 1];
+  char current = text[i];
+  if (previous == '_' || previous == '-' || previous == '.' || previous == ' ') return kBonusWord;
+  if (previous >= 'a' && previous <= 'z' && current >= 'A' && current <= 'Z') {
+    return kBonusCamelCase;
+  }
+  if (!is_digit(previous) && is_digit(current)) return kBonusCamelCase;
+  return 0;
+}
+
+} // namespace
+
+std::string fold_case(std::string_view text) {
+  std::string result;
+  if (is_ascii(text)) {
+    result.assign(text);
+    std::transform(result.begin(), result.end(), result.begin(), fold_ascii);
+  } else {
+    fold_into(result, text);
+  }
+  return result;
+}
+
+Matcher::Matcher(std::string_view needle)
+    : needle(fold_case(needle)), ascii_needle(is_ascii(this->needle)) {}
+
+bool Matcher::matches(std::string_view haystack) const {
+  if (needle.empty()) return true;
+  if (ascii_needle) return find_folded_ascii(haystack, needle);
+
+  // A needle with non-ASCII characters cannot occur in a plain ASCII name.
+  if (is_ascii(haystack)) return false;
+  thread_local std::string folded;
+  fold_into(folded, haystack);
+  return folded.find(needle) != std::string::npos;
+}
+
+FuzzyMatcher::FuzzyMatcher(std::string_view pattern)
+    : pattern(fold_case(pattern)), ascii_pattern(is_ascii(this->pattern)) {}
+
+bool FuzzyMatcher::score(std::string_view path, int32_t &score) const {
+  score = 0;
+  if (pattern.empty()) return true;
+
+  // Non-ASCII patterns are matched against a folded copy, which loses the
+  // camelCase bonus but keeps the rest.
+  std::string_view text = path;
+  if (!ascii_pattern) {
+    if (is_ascii(path)) return false;
+    thread_local std::string folded;
+    fold_into(folded, path);
+    text = folded;
+  }
+  const size_t length = text.size();
+  const size_t last = pattern.size() - 1;
+  if (length < pattern.size()) return false;
+  auto same = [&](size_t i, size_t j) { return fold_ascii(text[i]) == pattern[j]; };
+
+  // The leftmost occurrence, tightened from its end.
+  size_t end = 0;
+  for (size_t i = 0, j = 0;; i++) {
+    if (i == length) return false;
+    if (same(i, j) && ++j == pattern.size()) {
+      end = i;
+      break;
+    }
+  }
+  size_t begin = end;
+  for (size_t j = last;; begin--) {
+    if (same(begin, j) && j-- == 0) break;
+  }
+
+  // The rightmost occurrence, tightened from its start. It usually lies in
+  // the basename, which the leftmost one often misses.
+  size_t right_begin = length - 1;
+  for (size_t j = last;; right_begin--) {
+    if (same(right_begin, j) && j-- == 0) break;
+  }
+  size_t right_end = right_begin;
+  for (size_t j = 0;; right_end++) {
+    if (same(right_end, j) && ++j == pattern.size()) break;
+  }
+
+  size_t slash = text.rfind('/');
+  size_t basename = slash == std::string_view::npos ? 0 : slash + 1;
+  score = score_window(text, begin, end, basename);
+  if (right_begin != begin) {
+    score = std::max(score, score_window(text, right_begin, right_end, basename));
+  }
+  return true;
+}
+
+// Scores the greedy match of the pattern inside text[begin, end], which is
+// known to contain it.
+int32_t FuzzyMatcher::score_window(std::string_view text, size_t begin, size_t end,
+                                   size_t basename) const {
+  int32_t score = 0;
+  int32_t run_bonus = 0;
+  bool consecutive = false;
+  bool in_gap = false;
+  size_t j = 0;
+  for (size_t i = begin; i <= end && j < pattern.size(); i++) {
+    if (fold_ascii(text[i]) != pattern[j]) {
+      score += in_gap ? kScoreGapExtension : kScoreGapStart;
+      in_gap = true;
+      consecutive = false;
+      continue;
+    }
+    // A run keeps the bonus of the boundary it started on.
+    int32_t bonus = boundary_bonus(text, i);
+    if (consecutive) {
+      bonus = std::max({bonus, run_bonus, kBonusConsecutive});
+    } else {
+      run_bonus = bonus;
+    }
+    if (j == 0) bonus *= kFirstCharMultiplier;
+    score += kScoreMatch + bonus + (i >= basename ? kBonusBasename : 0);
+    consecutive = true;
+    in_gap = false;
+    j++;
+  }
+  return score;
+}
+
+bool has_extension(std::string_view name, std::string_view folded_extension) {
+  size_t dot = name.rfind('.');
+  if (dot == std::string_view::npos || dot == 0) return folded_extension.empty();
+  std::string_view extension = name.substr(dot + 1);
+  if (!is_ascii(extension) || !is_ascii(folded_extension)) {
+    return fold_case(extension) == folded_extension;
+  }
+  if (extension.size() != folded_extension.size()) return false;
+  for (size_t i = 0; i < extension.size(); i++) {
+    if (fold_ascii(extension[i]) != folded_extension[i]) return false;
+  }
+  return true;
+}
+
+} // namespace orion
@@ -0,0 +1,447 @@
+#include "query_plan.hpp"
+#include "regex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+namespace orion {
+
+namespace {
+
+constexpr int64_t kNanosecondsPerSecond = 1000000000;
+
+struct Token {
+  std::string text;
+  // Started with a quote: taken as text whatever it contains.
+  bool literal = false;
+};
+
+std::vector<Token> tokenize(std::string_view query) {
+  std::vector<Token> tokens;
+  Token current;
+  bool in_token = false;
+  bool quoted = false;
+  for (size_t i = 0; i < query.size(); i++) {
+    const char c = query[i];
+    // Inside quotes \" and \\ stand for the character; any other backslash
+    // is kept, so patterns like \d need no doubling.
+    if (quoted && c == '\\' && i + 1 < query.size() &&
+        (query[i + 1] == '"' || query[i + 1] == '\\')) {
+      current.text += query[i + 1];
+      i++;
+      continue;
+    }
+    if (c == '"') {
+      if (!in_token) {
+        in_token = true;
+        current.literal = true;
+      }
+      quoted = !quoted;
+      continue;
+    }
+    if (!quoted && (c == ' ' || c == '\t')) {
+      if (in_token && !current.text.empty()) {
+        tokens.push_back(std::move(current));
+      }
+      current = Token();
+      in_token = false;
+      continue;
+    }
+    in_token = true;
+    current.text += c;
+  }
+  if (in_token && !current.text.empty()) {
+    tokens.push_back(std::move(current));
+  }
+  return tokens;
+}
+
+bool is_glob(std::string_view text) {
+  return text.find_first_of("*?[") != std::string_view::npos;
+}
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// "10", "1.5m", "2gb": [begin, end) is the one byte count.
+bool parse_size(std::string_view value, int64_t &begin, int64_t &end) {
+  if (value.empty() || !(is_digit(value.front()) || value.front() == '.')) return false;
+  const std::string text(value);
+  char *rest = nullptr;
+  double number = std::strtod(text.c_str(), &rest);
+  const std::string unit = fold_case(rest);
+  double factor;
+  if (unit.empty() || unit == "b") factor = 1;
+  else if (unit == "k" || unit == "kb") factor = 1024.0;
+  else if (unit == "m" || unit == "mb") factor = 1024.0 * 1024;
+  else if (unit == "g" || unit == "gb") factor = 1024.0 * 1024 * 1024;
+  else if (unit == "t" || unit == "tb") factor = 1024.0 * 1024 * 1024 * 1024;
+  else return false;
+  double bytes = number * factor;
+  if (!(bytes >= 0) || bytes >= 9e18) return false;
+  begin = std::llround(bytes);
+  end = begin + 1;
+  return true;
+}
+
+// "2024-01-31" is that day in local time; "7d" (or s, m, h, w, y) is the
+// instant that long before `now_ns`, and sets `instant`.
+bool parse_time(std::string_view value, int64_t now_ns, int64_t &begin, int64_t &end,
+                bool &instant) {
+  const std::string text(value);
+  int year = 0, month = 0, day = 0, consumed = 0;
+  if (std::sscanf(text.c_str(), "%4d-%2d-%2d%n", &year, &month, &day, &consumed) == 3 &&
+      consumed == static_cast<int>(text.size())) {
+    std::tm date = {};
+    date.tm_year = year - 1900;
+    date.tm_mon = month - 1;
+    date.tm_mday = day;
+    date.tm_isdst = -1;
+    std::time_t first = std::mktime(&date);
+    date.tm_mday++;
+    date.tm_isdst = -1;
+    std::time_t next = std::mktime(&date);
+    if (first == -1 || next == -1) return false;
+    begin = int64_t(first) * kNanosecondsPerSecond;
+    end = int64_t(next) * kNanosecondsPerSecond;
+    instant = false;
+    return true;
+  }
+
+  if (text.size() < 2 || !is_digit(text.front())) return false;
+  char *rest = nullptr;
+  long long count = std::strtoll(text.c_str(), &rest, 10);
+  if (rest[0] == '\0' || rest[1] != '\0') return false;
+  int64_t seconds;
+  switch (rest[0]) {
+  case 's': seconds = 1; break;
+  case 'm': seconds = 60; break;
+  case 'h': seconds = 3600; break;
+  case 'd': seconds = 86400; break;
+  case 'w': seconds = 7 * 86400; break;
+  case 'y': seconds = 365 * 86400; break;
+  default: return false;
+  }
+  if (count > INT64_MAX / kNanosecondsPerSecond / seconds) return false;
+  begin = now_ns - count * seconds * kNanosecondsPerSecond;
+  end = begin + 1;
+  instant = true;
+  return true;
+}
+
+// Turns "<X", "<=X", ">X", ">=X", "A..B" or "X" into an inclusive range, with
+// `point` parsing each X into the half-open span it stands for.
+template <typename Point>
+bool parse_range(std::string_view value, Point &&point, int64_t &min, int64_t &max) {
+  int64_t begin = 0, end = 0;
+  auto starts_with = [&value](std::string_view prefix) {
+    return value.substr(0, prefix.size()) == prefix;
+  };
+  if (starts_with(">=")) {
+    if (!point(value.substr(2), begin, end)) return false;
+    min = begin;
+  } else if (starts_with(">")) {
+    if (!point(value.substr(1), begin, end)) return false;
+    min = end;
+  } else if (starts_with("<=")) {
+    if (!point(value.substr(2), begin, end)) return false;
+    max = end - 1;
+  } else if (starts_with("<")) {
+    if (!point(value.substr(1), begin, end)) return false;
+    max = begin - 1;
+  } else if (size_t dots = value.find(".."); dots != std::string_view::npos) {
+    std::string_view low = value.substr(0, dots);
+    std::string_view high = value.substr(dots + 2);
+    if (low.empty() && high.empty()) return false;
+    if (!low.empty()) {
+      if (!point(low, begin, end)) return false;
+      min = begin;
+    }
+    if (!high.empty()) {
+      if (!point(high, begin, end)) return false;
+      max = end - 1;
+    }
+  } else {
+    if (!point(value, begin, end)) return false;
+    min = begin;
+    max = end - 1;
+  }
+  return true;
+}
+
+std::vector<std::string> parse_extensions(std::string_view list) {
+  std::vector<std::string> extensions;
+  while (!list.empty()) {
+    size_t comma = list.find(',');
+    std::string_view item = list.substr(0, comma);
+    list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    while (!item.empty() && item.front() == '.') item.remove_prefix(1);
+    if (!item.empty()) {
+      extensions.push_back(fold_case(item));
+    }
+  }
+  return extensions;
+}
+
+void pattern_term(QueryTerm &term, std::string_view pattern, QueryTerm::Scope scope) {
+  term.kind = is_glob(pattern) ? QueryTerm::Kind::Glob : QueryTerm::Kind::Text;
+  term.scope = scope;
+  term.pattern = std::string(pattern);
+}
+
+int cost(QueryTerm::Kind kind) {
+  switch (kind) {
+  case QueryTerm::Kind::Extensions: return 0;
+  case QueryTerm::Kind::Text: return 1;
+  case QueryTerm::Kind::Glob: return 2;
+  default: return 3;
+  }
+}
+
+unsigned char fold_ascii(unsigned char c) { return c >= 'A' && c <= 'Z' ? c | 0x20 : c; }
+
+// Matches `c` against the set opening at pattern[start]. Sets `next` past
+// its ']', or to npos if the set is never closed.
+bool set_matches(std::string_view pattern, size_t start, unsigned char c, size_t &next) {
+  size_t i = start + 1;
+  bool invert = false;
+  if (i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^')) {
+    invert = true;
+    i++;
+  }
+  bool found = false;
+  for (bool first = true; i < pattern.size() && (pattern[i] != ']' || first); first = false) {
+    unsigned char low = pattern[i];
+    if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+      found |= c >= low && c <= static_cast<unsigned char>(pattern[i + 2]);
+      i += 3;
+    } else {
+      found |= c == low;
+      i++;
+    }
+  }
+  if (i >= pattern.size()) {
+    next = std::string_view::npos;
+    return false;
+  }
+  next = i + 1;
+  return found != invert;
+}
+
+// Iterative matching that backtracks only to the last '*', so a pattern
+// costs O(pattern * text) at worst instead of exponential time.
+bool glob_match(std::string_view pattern, std::string_view text) {
+  constexpr size_t npos = std::string_view::npos;
+  size_t p = 0, t = 0;
+  size_t star = npos, star_text = 0;
+  while (t < text.size()) {
+    if (p < pattern.size()) {
+      const unsigned char c = fold_ascii(text[t]);
+      if (pattern[p] == '*') {
+        star = ++p;
+        star_text = t;
+        continue;
+      }
+      if (pattern[p] == '?') {
+        p++;
+        t++;
+        while (t < text.size() && (static_cast<unsigned char>(text[t]) & 0xC0) == 0x80) t++;
+        continue;
+      }
+      if (pattern[p] == '[') {
+        size_t next;
+        bool in_set = set_matches(pattern, p, c, next);
+        if (next != npos) {
+          if (in_set) {
+            p = next;
+            t++;
+            continue;
+          }
+        } else if (c == '[') {
+          p++;
+          t++;
+          continue;
+        }
+      } else {
+        size_t literal = pattern[p] == '\\' && p + 1 < pattern.size() ? p + 1 : p;
+        if (static_cast<unsigned char>(pattern[literal]) == c) {
+          p = literal + 1;
+          t++;
+          continue;
+        }
+      }
+    }
+    if (star == npos) return false;
+    p = star;
+    t = ++star_text;
+  }
+  while (p < pattern.size() && pattern[p] == '*') p++;
+  return p == pattern.size();
+}
+
+} // namespace
+
+bool glob_matches(std::string_view folded_pattern, std::string_view text) {
+  for (unsigned char c : text) {
+    if (c >= 0x80) return glob_match(folded_pattern, fold_case(text));
+  }
+  return glob_match(folded_pattern, text);
+}
+
+SearchQuery SearchQuery::parse(std::string_view query) {
+  SearchQuery result;
+  const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+
+  for (const Token &token : tokenize(query)) {
+    QueryTerm term;
+    std::string_view text = token.text;
+    if (!token.literal && text.size() > 1 && (text.front() == '-' || text.front() == '!')) {
+      term.negated = true;
+      text.remove_prefix(1);
+    }
+    term.source = std::string(text);
+
+    const size_t colon = token.literal ? std::string_view::npos : text.find(':');
+    const std::string key = colon == std::string_view::npos ? std::string() : fold_case(text.substr(0, colon));
+    const std::string_view value = colon == std::string_view::npos ? text : text.substr(colon + 1);
+    bool parsed = true;
+    if (key == "ext" || key == "extension") {
+      term.kind = QueryTerm::Kind::Extensions;
+      term.extensions = parse_extensions(value);
+      if (term.extensions.empty()) continue;
+    } else if (key == "name" || key == "path") {
+      if (value.empty()) continue;
+      pattern_term(term, value, key == "name" ? QueryTerm::Scope::Name : QueryTerm::Scope::Path);
+    } else if (key == "regex" || key == "re") {
+      term.kind = QueryTerm::Kind::Regex;
+      term.pattern = std::string(value);
+      term.regex = Regex::compile(value, true);
+      parsed = term.regex != nullptr;
+    } else if (key == "size") {
+      term.kind = QueryTerm::Kind::Size;
+      parsed = parse_range(value, parse_size, term.min, term.max);
+    } else if (key == "mtime" || key == "modified") {
+      term.kind = QueryTerm::Kind::ModifiedTime;
+      bool instant = false;
+      auto point = [&](std::string_view when, int64_t &begin, int64_t &end) {
+        return parse_time(when, now_ns, begin, end, instant);
+      };
+      parsed = parse_range(value, point, term.min, term.max);
+      // A bare age means "within the last ...".
+      if (parsed && instant && value.front() != '<' && value.front() != '>' &&
+          value.find("..") == std::string_view::npos) {
+        term.max = INT64_MAX;
+      }
+    } else {
+      parsed = false;
+    }
+
+    if (!parsed) {
+      term.kind = QueryTerm::Kind::Text;
+      term.scope = QueryTerm::Scope::Path;
+      term.pattern = std::string(text);
+      if (!token.literal && is_glob(text)) {
+        term.kind = QueryTerm::Kind::Glob;
+        if (text.find('/') == std::string_view::npos) {
+          term.scope = QueryTerm::Scope::Name;
+        }
+      }
+    }
+
+    if (term.kind == QueryTerm::Kind::Text && term.scope == QueryTerm::Scope::Path &&
+        !term.negated && result.text.empty()) {
+      result.text = std::move(term.pattern);
+      continue;
+    }
+    result.terms.push_back(std::move(term));
+  }
+  return result;
+}
+
+QueryPlan::QueryPlan(const SearchQuery &query) {
+  for (const QueryTerm &term : query.terms) {
+    Check check{term.kind,
+                term.negated,
+                Matcher(term.kind == QueryTerm::Kind::Text ? term.pattern : std::string()),
+                term.kind == QueryTerm::Kind::Glob ? fold_case(term.pattern) : std::string(),
+                term.regex,
+                term.extensions,
+                term.min,
+                term.max};
+    switch (term.kind) {
+    case QueryTerm::Kind::Extensions:
+      if (!term.negated && term.extensions.size() == 1 && single_extension.empty()) {
+        single_extension = term.extensions.front();
+      }
+      name_checks.push_back(std::move(check));
+      break;
+    case QueryTerm::Kind::Regex:
+    case QueryTerm::Kind::Text:
+    case QueryTerm::Kind::Glob:
+      (term.scope == QueryTerm::Scope::Name ? name_checks : path_checks).push_back(std::move(check));
+      break;
+    case QueryTerm::Kind::Size:
+    case QueryTerm::Kind::ModifiedTime:
+      metadata_checks.push_back(std::move(check));
+      break;
+    }
+  }
+  for (const QueryTerm &term : query.terms) {
+    if (term.negated || term.scope != QueryTerm::Scope::Path) continue;
+    std::string literal = term.kind == QueryTerm::Kind::Text    ? fold_case(term.pattern)
+                          : term.kind == QueryTerm::Kind::Regex ? term.regex->required_literal()
+                                                                : std::string();
+    if (literal.find('/') == std::string::npos && literal.size() > path_literal.size()) {
+      path_literal = std::move(literal);
+    }
+  }
+
+  auto cheaper = [](const Check &a, const Check &b) { return cost(a.kind) < cost(b.kind); };
+  std::stable_sort(name_checks.begin(), name_checks.end(), cheaper);
+  std::stable_sort(path_checks.begin(), path_checks.end(), cheaper);
+}
+
+bool QueryPlan::Check::test(std::string_view text) const {
+  switch (kind) {
+  case QueryTerm::Kind::Text:
+    return matcher.matches(text);
+  case QueryTerm::Kind::Glob:
+    return glob_matches(glob, text);
+  case QueryTerm::Kind::Regex:
+    return regex->matches(text);
+  case QueryTerm::Kind::Extensions:
+    return std::any_of(extensions.begin(), extensions.end(),
+                       [text](const std::string &extension) { return has_extension(text, extension); });
+  default:
+    return true;
+  }
+}
+
+bool QueryPlan::matches_name(std::string_view name) const {
+  for (const Check &check : name_checks) {
+    if (check.test(name) == check.negated) return false;
+  }
+  return true;
+}
+
+bool QueryPlan::matches_path(std::string_view relative) const {
+  for (const Check &check : path_checks) {
+    if (check.test(relative) == check.negated) return false;
+  }
+  return true;
+}
+
+bool QueryPlan::matches_metadata(const EntryMetadata &metadata) const {
+  for (const Check &check : metadata_checks) {
+    int64_t value = check.kind == QueryTerm::Kind::Size ? static_cast<int64_t>(metadata.size)
+                                                         : metadata.mtime_ns;
+    if ((value >= check.min && value <= check.max) == check.negated) return false;
+  }
+  return true;
+}
+
+} // namespace orion
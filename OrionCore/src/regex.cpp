@@ -0,0 +1,796 @@
+#include "regex.hpp"
+
+#include <algorithm>
+#include <functional>
+
+namespace orion {
+
+namespace {
+
+// Bounds on what a pattern may compile to; repetition is expanded, so
+// "a{1000}{1000}" would otherwise be a million instructions.
+constexpr size_t kMaxProgram = 100000;
+constexpr int kMaxRepeat = 1000;
+constexpr int kMaxDepth = 200;
+// DFA states cached per regex; each holds a 1 KiB transition row.
+constexpr size_t kMaxStates = 4096;
+
+using ByteSet = std::bitset<256>;
+
+struct Node {
+  enum class Kind { Empty, Set, Concat, Alternate, Repeat, Begin, End };
+  Kind kind = Kind::Empty;
+  uint32_t set = 0;
+  std::vector<uint32_t> children;
+  int min = 0;
+  int max = -1;
+};
+
+bool is_ascii_letter(unsigned char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+
+size_t utf8_length(unsigned char lead) {
+  if (lead >= 0xF0 && lead <= 0xF4) return 4;
+  if (lead >= 0xE0) return lead <= 0xEF ? 3 : 1;
+  if (lead >= 0xC2) return 2;
+  return 1;
+}
+
+ByteSet byte_range(unsigned low, unsigned high) {
+  ByteSet set;
+  for (unsigned c = low; c <= high; c++) set.set(c);
+  return set;
+}
+
+class Parser {
+public:
+  Parser(std::string_view pattern, bool ignore_case, std::vector<ByteSet> &sets)
+      : pattern(pattern), ignore_case(ignore_case), sets(sets) {}
+
+  bool parse(uint32_t &root) {
+    if (!alternation(root)) return false;
+    if (pos < pattern.size()) return fail("unmatched ')'");
+    return true;
+  }
+
+  std::vector<Node> nodes;
+  std::string error;
+
+private:
+  std::string_view pattern;
+  bool ignore_case;
+  std::vector<ByteSet> &sets;
+  size_t pos = 0;
+  int depth = 0;
+
+  bool fail(const std::string &message) {
+    error = message;
+    return false;
+  }
+
+  bool at(char c) const { return pos < pattern.size() && pattern[pos] == c; }
+
+  uint32_t add(Node node) {
+    nodes.push_back(std::move(node));
+    return static_cast<uint32_t>(nodes.size() - 1);
+  }
+
+  uint32_t add(Node::Kind kind, std::vector<uint32_t> children = {}) {
+    Node node;
+    node.kind = kind;
+    node.children = std::move(children);
+    return add(std::move(node));
+  }
+
+  uint32_t set_node(ByteSet set) {
+    if (ignore_case) {
+      for (unsigned c = 'a'; c <= 'z'; c++) {
+        if (set[c] || set[c - 32]) {
+          set.set(c);
+          set.set(c - 32);
+        }
+      }
+    }
+    sets.push_back(set);
+    Node node;
+    node.kind = Node::Kind::Set;
+    node.set = static_cast<uint32_t>(sets.size() - 1);
+    return add(std::move(node));
+  }
+
+  // One UTF-8 character spelled out as a sequence of single bytes.
+  uint32_t sequence_node(std::string_view character) {
+    std::string bytes = ignore_case ? fold_case(character) : std::string(character);
+    std::vector<uint32_t> children;
+    for (unsigned char c : bytes) {
+      ByteSet set;
+      set.set(c);
+      children.push_back(set_node(set));
+    }
+    return add(Node::Kind::Concat, std::move(children));
+  }
+
+  // Any multi-byte UTF-8 sequence.
+  void add_multibyte(std::vector<uint32_t> &branches) {
+    const ByteSet continuation = byte_range(0x80, 0xBF);
+    for (unsigned length = 2; length <= 4; length++) {
+      std::vector<uint32_t> bytes;
+      bytes.push_back(set_node(length == 2   ? byte_range(0xC2, 0xDF)
+                               : length == 3 ? byte_range(0xE0, 0xEF)
+                                             : byte_range(0xF0, 0xF4)));
+      for (unsigned i = 1; i < length; i++) bytes.push_back(set_node(continuation));
+      branches.push_back(add(Node::Kind::Concat, std::move(bytes)));
+    }
+  }
+
+  // A character class: single bytes from `ascii`, whole sequences for the
+  // listed characters and, with `non_ascii`, any other character too. Bytes
+  // that cannot start a valid sequence count as characters of their own.
+  uint32_t class_node(ByteSet ascii, const std::vector<std::string> &characters, bool non_ascii) {
+    std::vector<uint32_t> branches;
+    if (non_ascii) {
+      ascii |= byte_range(0x80, 0xC1) | byte_range(0xF5, 0xFF);
+      add_multibyte(branches);
+    }
+    if (ascii.any() || branches.empty()) {
+      branches.insert(branches.begin(), set_node(ascii));
+    }
+    if (!non_ascii) {
+      for (const std::string &character : characters) {
+        branches.push_back(sequence_node(character));
+      }
+    }
+    return branches.size() == 1 ? branches.front() : add(Node::Kind::Alternate, std::move(branches));
+  }
+
+  bool alternation(uint32_t &out) {
+    std::vector<uint32_t> branches;
+    for (;;) {
+      uint32_t branch;
+      if (!concatenation(branch)) return false;
+      branches.push_back(branch);
+      if (!at('|')) break;
+      pos++;
+    }
+    out = branches.size() == 1 ? branches.front() : add(Node::Kind::Alternate, std::move(branches));
+    return true;
+  }
+
+  bool concatenation(uint32_t &out) {
+    std::vector<uint32_t> items;
+    while (pos < pattern.size() && !at('|') && !at(')')) {
+      uint32_t item;
+      if (!repetition(item)) return false;
+      items.push_back(item);
+    }
+    out = items.size() == 1 ? items.front() : add(Node::Kind::Concat, std::move(items));
+    return true;
+  }
+
+  // Parses "{n}", "{n,}" or "{n,m}" at `pos`. Leaves `pos` alone and returns
+  // false if there is none, so the brace is taken literally.
+  bool braces(int &min, int &max) {
+    size_t i = pos + 1;
+    auto number = [&](int &value) {
+      size_t begin = i;
+      long parsed = 0;
+      while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9') {
+        parsed = std::min<long>(parsed * 10 + (pattern[i] - '0'), kMaxRepeat + 1);
+        i++;
+      }
+      value = static_cast<int>(parsed);
+      return i > begin;
+    };
+    if (!number(min)) return false;
+    max = min;
+    if (i < pattern.size() && pattern[i] == ',') {
+      i++;
+      if (!number(max)) max = -1;
+    }
+    if (i >= pattern.size() || pattern[i] != '}') return false;
+    pos = i + 1;
+    return true;
+  }
+
+  bool repetition(uint32_t &out) {
+    if (at('*') || at('+') || at('?')) return fail("nothing to repeat");
+    if (!atom(out)) return false;
+    for (;;) {
+      int min, max;
+      if (at('*')) {
+        min = 0, max = -1;
+        pos++;
+      } else if (at('+')) {
+        min = 1, max = -1;
+        pos++;
+      } else if (at('?')) {
+        min = 0, max = 1;
+        pos++;
+      } else if (!at('{') || !braces(min, max)) {
+        return true;
+      }
+      if (min > kMaxRepeat || max > kMaxRepeat) return fail("repetition count is too large");
+      if (max >= 0 && max < min) return fail("repetition range is reversed");
+      // Only whether a text matches is reported, so lazy is the same.
+      if (at('?')) pos++;
+      Node node;
+      node.kind = Node::Kind::Repeat;
+      node.children = {out};
+      node.min = min;
+      node.max = max;
+      out = add(std::move(node));
+    }
+  }
+
+  bool atom(uint32_t &out) {
+    const unsigned char c = pattern[pos];
+    switch (c) {
+    case '(': {
+      pos++;
+      if (pattern.substr(pos, 2) == "?:") {
+        pos += 2;
+      } else if (at('?')) {
+        return fail("unsupported group");
+      }
+      if (++depth > kMaxDepth) return fail("groups are nested too deeply");
+      if (!alternation(out)) return false;
+      depth--;
+      if (!at(')')) return fail("missing ')'");
+      pos++;
+      return true;
+    }
+    case '[':
+      pos++;
+      return character_class(out);
+    case '.':
+      pos++;
+      out = class_node(byte_range(0x00, 0x7F), {}, true);
+      return true;
+    case '^':
+      pos++;
+      out = add(Node::Kind::Begin);
+      return true;
+    case '$':
+      pos++;
+      out = add(Node::Kind::End);
+      return true;
+    case '\\': {
+      pos++;
+      ByteSet ascii;
+      bool non_ascii = false;
+      if (class_escape(ascii, non_ascii)) {
+        out = class_node(ascii, {}, non_ascii);
+        return true;
+      }
+      if (!error.empty()) return false;
+      unsigned char literal;
+      if (!literal_escape(literal)) return false;
+      ByteSet set;
+      set.set(literal);
+      out = set_node(set);
+      return true;
+    }
+    default: {
+      size_t length = std::min(utf8_length(c), pattern.size() - pos);
+      if (length == 1) {
+        ByteSet set;
+        set.set(c);
+        out = set_node(set);
+      } else {
+        out = sequence_node(pattern.substr(pos, length));
+      }
+      pos += length;
+      return true;
+    }
+    }
+  }
+
+  // \d \w \s and their negations, with `pos` just past the backslash.
+  // Returns false without an error for any other escape.
+  bool class_escape(ByteSet &ascii, bool &non_ascii) {
+    if (pos >= pattern.size()) return fail("trailing backslash");
+    ByteSet set;
+    switch (pattern[pos] | 0x20) {
+    case 'd': set = byte_range('0', '9'); break;
+    case 'w': set = byte_range('0', '9') | byte_range('A', 'Z') | byte_range('a', 'z'); set.set('_'); break;
+    case 's': for (char s : {' ', '\t', '\n', '\r', '\f', '\v'}) set.set(static_cast<unsigned char>(s)); break;
+    default: return false;
+    }
+    if (pattern[pos] >= 'A' && pattern[pos] <= 'Z') {
+      set = ~set & byte_range(0x00, 0x7F);
+      non_ascii = true;
+    }
+    ascii |= set;
+    pos++;
+    return true;
+  }
+
+  bool literal_escape(unsigned char &out) {
+    if (pos >= pattern.size()) return fail("trailing backslash");
+    const unsigned char c = pattern[pos++];
+    switch (c) {
+    case 'n': out = '\n'; return true;
+    case 't': out = '\t'; return true;
+    case 'r': out = '\r'; return true;
+    case 'f': out = '\f'; return true;
+    case 'v': out = '\v'; return true;
+    case 'x': {
+      auto hex = [](char h) {
+        if (h >= '0' && h <= '9') return h - '0';
+        if ((h | 0x20) >= 'a' && (h | 0x20) <= 'f') return (h | 0x20) - 'a' + 10;
+        return -1;
+      };
+      if (pos + 2 > pattern.size() || hex(pattern[pos]) < 0 || hex(pattern[pos + 1]) < 0) {
+        return fail("\\x needs two hex digits");
+      }
+      out = static_cast<unsigned char>(hex(pattern[pos]) * 16 + hex(pattern[pos + 1]));
+      pos += 2;
+      return true;
+    }
+    default:
+      if (c < 0x80 && (is_ascii_letter(c) || (c >= '0' && c <= '9'))) {
+        return fail(std::string("unsupported escape \\") + static_cast<char>(c));
+      }
+      out = c;
+      return true;
+    }
+  }
+
+  // With `pos` just past the '['.
+  bool character_class(uint32_t &out) {
+    bool negated = false;
+    if (at('^')) {
+      negated = true;
+      pos++;
+    }
+    ByteSet ascii;
+    bool non_ascii = false;
+    std::vector<std::string> characters;
+    bool first = true;
+    while (pos < pattern.size() && (first || !at(']'))) {
+      first = false;
+      unsigned char low;
+      if (at('\\')) {
+        pos++;
+        if (class_escape(ascii, non_ascii)) continue;
+        if (!error.empty() || !literal_escape(low)) return false;
+      } else {
+        low = pattern[pos];
+        size_t length = std::min(utf8_length(low), pattern.size() - pos);
+        if (length > 1) {
+          if (pattern.substr(pos + length, 1) == "-" && pattern.substr(pos + length + 1, 1) != "]" &&
+              pos + length + 1 < pattern.size()) {
+            return fail("ranges of non-ASCII characters are not supported");
+          }
+          characters.emplace_back(pattern.substr(pos, length));
+          pos += length;
+          continue;
+        }
+        pos++;
+      }
+
+      unsigned char high = low;
+      if (at('-') && pos + 1 < pattern.size() && pattern[pos + 1] != ']') {
+        pos++;
+        if (at('\\')) {
+          pos++;
+          if (!literal_escape(high)) return false;
+        } else {
+          high = pattern[pos++];
+          if (high >= 0x80) return fail("ranges of non-ASCII characters are not supported");
+        }
+        if (high < low) return fail("character range is reversed");
+      }
+      ascii |= byte_range(low, high);
+    }
+    if (!at(']')) return fail("missing ']'");
+    pos++;
+
+    if (negated) {
+      if (!characters.empty()) {
+        return fail("non-ASCII characters in negated classes are not supported");
+      }
+      if (ignore_case) {
+        for (unsigned c = 'a'; c <= 'z'; c++) {
+          if (ascii[c] || ascii[c - 32]) {
+            ascii.set(c);
+            ascii.set(c - 32);
+          }
+        }
+      }
+      out = class_node(~ascii & byte_range(0x00, 0x7F), {}, !non_ascii);
+    } else {
+      out = class_node(ascii, characters, non_ascii);
+    }
+    return true;
+  }
+};
+
+// Finds the longest literal every match contains. `exact` is set when the
+// node matches just one string, which is then in `text` and can join its
+// neighbours into a longer run. When ignoring case the literal is folded, and
+// a letter's two cases count as one character.
+void find_required_literal(const std::vector<Node> &nodes, const std::vector<ByteSet> &sets,
+                           bool ignore_case, uint32_t id, bool &exact, std::string &text,
+                           std::string &best) {
+  const Node &node = nodes[id];
+  auto keep_longer = [&best](const std::string &candidate) {
+    if (candidate.size() > best.size()) best = candidate;
+  };
+  exact = false;
+  text.clear();
+  switch (node.kind) {
+  case Node::Kind::Empty:
+  case Node::Kind::Begin:
+  case Node::Kind::End:
+    exact = true;
+    return;
+  case Node::Kind::Set: {
+    const ByteSet &set = sets[node.set];
+    // The lowest member comes first, so an upper case letter is seen
+    // before its lower case.
+    for (unsigned c = 0; c < 256; c++) {
+      if (!set[c]) continue;
+      if (set.count() == 1) {
+        exact = true;
+        text.assign(1, static_cast<char>(c));
+      } else if (ignore_case && set.count() == 2 && c >= 'A' && c <= 'Z' && set[c | 0x20]) {
+        exact = true;
+        text.assign(1, static_cast<char>(c | 0x20));
+      }
+      return;
+    }
+    return;
+  }
+  case Node::Kind::Concat: {
+    std::string run;
+    bool all_exact = true;
+    for (uint32_t child : node.children) {
+      bool child_exact;
+      std::string child_text;
+      std::string child_best;
+      find_required_literal(nodes, sets, ignore_case, child, child_exact, child_text,
+                            child_best);
+      if (child_exact) {
+        run += child_text;
+        continue;
+      }
+      all_exact = false;
+      keep_longer(run);
+      keep_longer(child_best);
+      run.clear();
+    }
+    keep_longer(run);
+    exact = all_exact;
+    if (exact) text = run;
+    return;
+  }
+  case Node::Kind::Alternate:
+    return;
+  case Node::Kind::Repeat: {
+    if (node.min == 0) {
+      exact = node.max == 0;
+      return;
+    }
+    bool child_exact;
+    std::string child_text;
+    std::string child_best;
+    find_required_literal(nodes, sets, ignore_case, node.children.front(), child_exact, child_text,
+                          child_best);
+    if (child_exact && node.min == node.max && child_text.size() * node.min <= 256) {
+      exact = true;
+      for (int i = 0; i < node.min; i++) text += child_text;
+      return;
+    }
+    keep_longer(child_exact ? child_text : child_best);
+    return;
+  }
+  }
+}
+
+} // namespace
+
+struct Regex::State {
+  std::vector<uint32_t> nfa;
+  // A match ended somewhere in the text read so far.
+  bool match = false;
+  // The text matches if it ends here, through a '$'.
+  bool match_at_end = false;
+  // No match can start or continue from here.
+  bool dead = false;
+  std::atomic<int32_t> next[256];
+
+  State() {
+    for (std::atomic<int32_t> &target : next) target.store(-1, std::memory_order_relaxed);
+  }
+};
+
+Regex::~Regex() = default;
+
+std::unique_ptr<Regex> Regex::compile(std::string_view pattern, bool ignore_case,
+                                      std::string *error) {
+  std::unique_ptr<Regex> regex(new Regex());
+  regex->ignore_case = ignore_case;
+
+  Parser parser(pattern, ignore_case, regex->sets);
+  uint32_t root = 0;
+  if (pattern.empty()) {
+    Node empty;
+    parser.nodes.push_back(empty);
+  } else if (!parser.parse(root)) {
+    if (error) *error = parser.error;
+    return nullptr;
+  }
+
+  // Thompson construction: each fragment leaves dangling outputs, filled in
+  // once the next fragment is known.
+  struct Fragment {
+    int32_t start;
+    std::vector<std::pair<int32_t, bool>> holes;
+  };
+  std::vector<Instruction> &program = regex->program;
+  auto emit = [&program](Instruction::Op op, uint32_t set = 0, int32_t out = -1, int32_t out1 = -1) {
+    program.push_back(Instruction{op, set, out, out1});
+    return static_cast<int32_t>(program.size() - 1);
+  };
+  auto patch = [&program](const std::vector<std::pair<int32_t, bool>> &holes, int32_t target) {
+    for (const auto &[pc, second] : holes) {
+      (second ? program[pc].out1 : program[pc].out) = target;
+    }
+  };
+  auto chain = [&](Fragment &first, Fragment next) {
+    if (first.start < 0) {
+      first = std::move(next);
+      return;
+    }
+    patch(first.holes, next.start);
+    first.holes = std::move(next.holes);
+  };
+
+  const std::vector<Node> &nodes = parser.nodes;
+  std::function<Fragment(uint32_t)> build = [&](uint32_t id) -> Fragment {
+    const Node &node = nodes[id];
+    if (program.size() > kMaxProgram) return Fragment{emit(Instruction::Jump), {}};
+    switch (node.kind) {
+    case Node::Kind::Empty: {
+      int32_t pc = emit(Instruction::Jump);
+      return Fragment{pc, {{pc, false}}};
+    }
+    case Node::Kind::Set: {
+      int32_t pc = emit(Instruction::Set, node.set);
+      return Fragment{pc, {{pc, false}}};
+    }
+    case Node::Kind::Begin:
+    case Node::Kind::End: {
+      int32_t pc = emit(node.kind == Node::Kind::Begin ? Instruction::Begin : Instruction::End);
+      return Fragment{pc, {{pc, false}}};
+    }
+    case Node::Kind::Concat: {
+      Fragment result{-1, {}};
+      for (uint32_t child : node.children) chain(result, build(child));
+      if (result.start < 0) {
+        int32_t pc = emit(Instruction::Jump);
+        return Fragment{pc, {{pc, false}}};
+      }
+      return result;
+    }
+    case Node::Kind::Alternate: {
+      Fragment result = build(node.children.back());
+      for (size_t i = node.children.size() - 1; i-- > 0;) {
+        Fragment branch = build(node.children[i]);
+        int32_t pc = emit(Instruction::Split, 0, branch.start, result.start);
+        branch.holes.insert(branch.holes.end(), result.holes.begin(), result.holes.end());
+        result = Fragment{pc, std::move(branch.holes)};
+      }
+      return result;
+    }
+    case Node::Kind::Repeat: {
+      Fragment result{-1, {}};
+      const uint32_t child = node.children.front();
+      for (int i = 0; i < node.min; i++) chain(result, build(child));
+      if (node.max < 0) {
+        Fragment body = build(child);
+        int32_t pc = emit(Instruction::Split, 0, body.start);
+        patch(body.holes, pc);
+        chain(result, Fragment{pc, {{pc, true}}});
+      } else {
+        for (int i = node.min; i < node.max; i++) {
+          Fragment body = build(child);
+          int32_t pc = emit(Instruction::Split, 0, body.start);
+          body.holes.emplace_back(pc, true);
+          chain(result, Fragment{pc, std::move(body.holes)});
+        }
+      }
+      if (result.start < 0) {
+        int32_t pc = emit(Instruction::Jump);
+        return Fragment{pc, {{pc, false}}};
+      }
+      return result;
+    }
+    }
+    return Fragment{-1, {}};
+  };
+
+  Fragment whole = build(root);
+  int32_t match = emit(Instruction::Match);
+  patch(whole.holes, match);
+  regex->start = whole.start;
+  if (program.size() > kMaxProgram) {
+    if (error) *error = "pattern is too large";
+    return nullptr;
+  }
+
+  bool exact;
+  std::string text;
+  find_required_literal(nodes, regex->sets, ignore_case, root, exact, text, regex->literal);
+  if (exact && text.size() > regex->literal.size()) {
+    regex->literal = text;
+  }
+  if (ignore_case && !regex->literal.empty()) {
+    regex->prefilter = std::make_unique<Matcher>(regex->literal);
+  }
+
+  regex->states.reset(new std::unique_ptr<State>[kMaxStates]);
+  std::vector<uint32_t> initial;
+  std::vector<uint8_t> seen(program.size());
+  regex->add_closure(initial, seen, regex->start, true, false);
+  std::sort(initial.begin(), initial.end());
+  regex->initial_state = regex->intern(std::move(initial));
+  return regex;
+}
+
+void Regex::add_closure(std::vector<uint32_t> &out, std::vector<uint8_t> &seen, int32_t pc,
+                        bool at_start, bool at_end) const {
+  std::vector<int32_t> pending{pc};
+  while (!pending.empty()) {
+    pc = pending.back();
+    pending.pop_back();
+    if (pc < 0 || seen[pc]) continue;
+    seen[pc] = 1;
+    const Instruction &instruction = program[pc];
+    switch (instruction.op) {
+    case Instruction::Split:
+      pending.push_back(instruction.out1);
+      pending.push_back(instruction.out);
+      break;
+    case Instruction::Jump:
+      pending.push_back(instruction.out);
+      break;
+    case Instruction::Begin:
+      if (at_start) pending.push_back(instruction.out);
+      break;
+    case Instruction::End:
+      if (at_end) {
+        pending.push_back(instruction.out);
+      } else {
+        out.push_back(static_cast<uint32_t>(pc));
+      }
+      break;
+    case Instruction::Set:
+    case Instruction::Match:
+      out.push_back(static_cast<uint32_t>(pc));
+      break;
+    }
+  }
+}
+
+// Every position may start a match, so the start's closure joins each step.
+std::vector<uint32_t> Regex::step(const std::vector<uint32_t> &set, unsigned char byte) const {
+  std::vector<uint32_t> next;
+  std::vector<uint8_t> seen(program.size());
+  for (uint32_t pc : set) {
+    const Instruction &instruction = program[pc];
+    if (instruction.op == Instruction::Set && sets[instruction.set][byte]) {
+      add_closure(next, seen, instruction.out, false, false);
+    }
+  }
+  add_closure(next, seen, start, false, false);
+  std::sort(next.begin(), next.end());
+  return next;
+}
+
+bool Regex::has_match(const std::vector<uint32_t> &set) const {
+  return std::any_of(set.begin(), set.end(),
+                     [this](uint32_t pc) { return program[pc].op == Instruction::Match; });
+}
+
+bool Regex::accepts_at_end(const std::vector<uint32_t> &set) const {
+  std::vector<uint32_t> reached;
+  std::vector<uint8_t> seen(program.size());
+  for (uint32_t pc : set) {
+    if (program[pc].op == Instruction::End) {
+      add_closure(reached, seen, program[pc].out, false, true);
+    }
+  }
+  return has_match(reached);
+}
+
+int32_t Regex::intern(std::vector<uint32_t> set) const {
+  auto found = state_ids.find(set);
+  if (found != state_ids.end()) return found->second;
+  if (state_count == kMaxStates) return -1;
+
+  auto state = std::make_unique<State>();
+  state->match = has_match(set);
+  state->match_at_end = state->match || accepts_at_end(set);
+  state->dead = set.empty();
+  state->nfa = set;
+  const int32_t id = static_cast<int32_t>(state_count);
+  states[state_count++] = std::move(state);
+  state_ids.emplace(std::move(set), id);
+  return id;
+}
+
+int32_t Regex::next_state(int32_t state, unsigned char byte) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::atomic<int32_t> &target = states[state]->next[byte];
+  int32_t id = target.load(std::memory_order_relaxed);
+  if (id >= 0) return id;
+  id = intern(step(states[state]->nfa, byte));
+  if (id >= 0) {
+    target.store(id, std::memory_order_release);
+  }
+  return id;
+}
+
+bool Regex::simulate(std::vector<uint32_t> set, std::string_view rest) const {
+  for (unsigned char c : rest) {
+    if (has_match(set)) return true;
+    set = step(set, c);
+    if (set.empty()) return false;
+  }
+  return has_match(set) || accepts_at_end(set);
+}
+
+bool Regex::run(std::string_view text) const {
+  int32_t id = initial_state;
+  for (size_t i = 0; i < text.size(); i++) {
+    const State &state = *states[id];
+    if (state.match) return true;
+    if (state.dead) return false;
+    const unsigned char c = static_cast<unsigned char>(text[i]);
+    int32_t next = state.next[c].load(std::memory_order_acquire);
+    if (next < 0) {
+      next = next_state(id, c);
+      if (next < 0) return simulate(state.nfa, text.substr(i));
+    }
+    id = next;
+  }
+  return states[id]->match_at_end;
+}
+
+bool Regex::matches(std::string_view text) const {
+  if (!literal.empty()) {
+    if (prefilter ? !prefilter->matches(text) : text.find(literal) == std::string_view::npos) {
+      return false;
+    }
+  }
+  if (ignore_case) {
+    for (unsigned char c : text) {
+      if (c >= 0x80) return run(fold_case(text));
+    }
+  }
+  return run(text);
+}
+
+uint32_t Regex::count_lines(std::string_view text) const {
+  if (literal.find('\n') != std::string::npos) return 0;
+  uint32_t found = 0;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    if (!literal.empty() && !prefilter) {
+      size_t hit = text.find(literal, pos);
+      if (hit == std::string_view::npos) break;
+      size_t newline = text.rfind('\n', hit);
+      if (newline != std::string_view::npos && newline >= pos) {
+        pos = newline + 1;
+      }
+    }
+    size_t end = text.find('\n', pos);
+    if (end == std::string_view::npos) end = text.size();
+    if (matches(text.substr(pos, end - pos))) found++;
+    pos = end + 1;
+  }
+  return found;
+}
+
+} // namespace orion
@@ -0,0 +1,118 @@
+#include "result_sort.hpp"
+#include "dir_reader.hpp"
+#include "matcher.hpp"
+#include "task_queue.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace orion {
+
+namespace {
+
+// Below this many results per thread, starting threads costs more than the
+// sort saves.
+constexpr size_t kMinSlice = 16384;
+
+// Extracted once per result; `text` is the folded name or the path.
+struct Keyed {
+  int64_t number;
+  std::string_view text;
+  std::string_view path;
+  uint32_t index;
+};
+
+std::string_view basename_of(std::string_view path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+} // namespace
+
+std::vector<uint32_t> sort_order(const std::vector<SortItem> &items, SortKey key,
+                                 bool descending, unsigned thread_count) {
+  const size_t count = items.size();
+  const unsigned threads = static_cast<unsigned>(
+      std::max<size_t>(1, std::min<size_t>(resolve_thread_count(thread_count), count / kMinSlice)));
+  auto slice_begin = [&](size_t slice) { return count * slice / threads; };
+
+  auto less = [descending](const Keyed &a, const Keyed &b) {
+    if (a.number != b.number) return descending ? a.number > b.number : a.number < b.number;
+    if (a.text != b.text) return descending ? a.text > b.text : a.text < b.text;
+    if (a.path != b.path) return a.path < b.path;
+    return a.index < b.index;
+  };
+
+  std::vector<Keyed> keys(count);
+  std::vector<std::string> folded_names(key == SortKey::Name ? count : 0);
+  run_on_threads(threads, [&](unsigned worker) {
+    const size_t begin = slice_begin(worker);
+    const size_t end = slice_begin(worker + 1);
+    for (size_t i = begin; i < end; i++) {
+      Keyed &keyed = keys[i];
+      keyed.index = static_cast<uint32_t>(i);
+      keyed.path = items[i].path;
+      keyed.number = 0;
+      switch (key) {
+      case SortKey::Name:
+        folded_names[i] = fold_case(basename_of(keyed.path));
+        keyed.text = folded_names[i];
+        break;
+      case SortKey::Path:
+        keyed.text = keyed.path;
+        break;
+      case SortKey::Size:
+      case SortKey::ModifiedTime: {
+        EntryType type;
+        EntryMetadata metadata;
+        if (stat_entry(AT_FDCWD, keyed.path.data(), type, &metadata)) {
+          keyed.number =
+              key == SortKey::Size ? static_cast<int64_t>(metadata.size) : metadata.mtime_ns;
+        }
+        break;
+      }
+      case SortKey::Matches:
+        keyed.number = items[i].content_matches;
+        break;
+      }
+    }
+    std::sort(keys.begin() + begin, keys.begin() + end, less);
+  });
+
+  // Each round merges neighbouring runs into `merged`, one pair per thread.
+  std::vector<size_t> bounds;
+  for (unsigned slice = 0; slice <= threads; slice++) {
+    bounds.push_back(slice_begin(slice));
+  }
+  std::vector<Keyed> merged(threads > 1 ? count : 0);
+  while (bounds.size() > 2) {
+    const size_t runs = bounds.size() - 1;
+    const size_t pairs = (runs + 1) / 2;
+    const unsigned workers = static_cast<unsigned>(std::min<size_t>(threads, pairs));
+    run_on_threads(workers, [&](unsigned worker) {
+      for (size_t pair = worker; pair < pairs; pair += workers) {
+        size_t low = bounds[2 * pair];
+        size_t middle = bounds[std::min(2 * pair + 1, runs)];
+        size_t high = bounds[std::min(2 * pair + 2, runs)];
+        std::merge(keys.begin() + low, keys.begin() + middle, keys.begin() + middle,
+                   keys.begin() + high, merged.begin() + low, less);
+      }
+    });
+    keys.swap(merged);
+
+    std::vector<size_t> next_bounds;
+    for (size_t pair = 0; pair < pairs; pair++) {
+      next_bounds.push_back(bounds[2 * pair]);
+    }
+    next_bounds.push_back(count);
+    bounds.swap(next_bounds);
+  }
+
+  std::vector<uint32_t> order(count);
+  for (size_t i = 0; i < count; i++) {
+    order[i] = keys[i].index;
+  }
+  return order;
+}
+
+} // namespace orion
@@ -0,0 +1,213 @@
+#include "search_engine.hpp"
+#include "content_cache.hpp"
+#include "content_scanner.hpp"
+#include "dir_reader.hpp"
+#include "ignore_rules.hpp"
+#include "matcher.hpp"
+#include "query_plan.hpp"
+#include "search_output.hpp"
+#include "task_queue.hpp"
+#include "walker.hpp"
+
+#include <algorithm>
+
+namespace orion {
+
+namespace {
+
+constexpr uint64_t kFlushCheckInterval = 256;
+constexpr size_t kMinFilterSlice = 16384;
+
+} // namespace
+
+bool SearchQuery::refines(const SearchQuery &previous) const {
+  if (fuzzy || previous.fuzzy || content != previous.content ||
+      content_regex != previous.content_regex) {
+    return false;
+  }
+  if (ignore != previous.ignore &&
+      (!ignore || !previous.ignore || *ignore != *previous.ignore)) {
+    return false;
+  }
+  for (const QueryTerm &term : previous.terms) {
+    auto same = [&term](const QueryTerm &other) {
+      return other.negated == term.negated && other.source == term.source;
+    };
+    if (std::none_of(terms.begin(), terms.end(), same)) return false;
+  }
+  return fold_case(text).find(fold_case(previous.text)) != std::string::npos;
+}
+
+SearchEngine::SearchEngine(unsigned thread_count) : threads(thread_count) {}
+
+std::vector<std::string> SearchEngine::search(const SearchQuery &query,
+                                              const std::string &directory,
+                                              const ProgressCallback &progress) {
+  std::vector<std::string> results;
+  search(
+      query, directory,
+      [&results](const std::vector<SearchHit> &batch) {
+        for (const SearchHit &hit : batch) {
+          results.push_back(hit.path);
+        }
+      },
+      progress);
+  return results;
+}
+
+void SearchEngine::search(const SearchQuery &query, const std::string &directory,
+                          const ResultCallback &on_results, const ProgressCallback &progress,
+                          const std::atomic<bool> *cancel, SearchProgress *live) {
+  const auto started = ResultBatcher::Clock::now();
+  ParallelWalker walker(threads);
+  walker.set_trace(live ? live->trace : nullptr);
+  walker.set_ignore(query.ignore.get());
+  const Matcher matcher(query.text);
+  const FuzzyMatcher fuzzy(query.text);
+  const QueryPlan plan(query);
+  const ContentScanner scanner(query.content, query.content_regex, query.cache);
+  const bool scan_contents = !query.content.empty();
+  auto cancelled = [cancel] { return cancel && cancel->load(std::memory_order_relaxed); };
+
+  const std::string root = normalize_directory(directory);
+  const size_t relative_offset = root == "/" ? 1 : root.size() + 1;
+
+  struct WorkerState {
+    uint64_t entries = 0;
+    uint64_t unreported_files = 0;
+    std::string scratch;
+    std::vector<char> contents;
+    uint64_t files_read = 0;
+    uint64_t bytes_read = 0;
+    uint64_t cache_hits = 0;
+    uint64_t read_ns = 0;
+  };
+  std::vector<WorkerState> workers(walker.thread_count());
+  ResultBatcher batcher(walker.thread_count(), query, on_results, cancel, live);
+  ProgressReporter reporter(progress, live);
+
+  // Shared state is only touched every kFlushCheckInterval entries per
+  // worker, so progress costs nothing on the per-entry path.
+  auto report_directories = [&] {
+    uint64_t done = walker.directories_done();
+    uint64_t pending = walker.directories_pending();
+    reporter.set_directories(done, pending);
+    reporter.report(static_cast<double>(done) / (static_cast<double>(done + pending) + 1.0));
+  };
+
+  walker.walk(root, [&](unsigned worker, const DirEntry &entry) {
+    WorkerState &state = workers[worker];
+    if (++state.entries % kFlushCheckInterval == 0) {
+      batcher.tick(worker);
+      if (reporter) {
+        reporter.add_files(state.unreported_files);
+        state.unreported_files = 0;
+        report_directories();
+      }
+    }
+
+    if (entry.type == EntryType::Directory) return;
+    state.unreported_files++;
+    if (!plan.matches_name(entry.name)) return;
+
+    std::string &path = state.scratch;
+    path.assign(entry.dir_path);
+    if (path.back() != '/') {
+      path += '/';
+    }
+    path.append(entry.name);
+
+    std::string_view relative = std::string_view(path).substr(std::min(relative_offset, path.size()));
+    int32_t score = 0;
+    if (query.fuzzy ? !fuzzy.score(relative, score) : !matcher.matches(relative)) return;
+    if (!plan.matches_path(relative)) return;
+    if (plan.needs_metadata()) {
+      EntryMetadata metadata;
+      if (!entry.metadata(metadata) || !plan.matches_metadata(metadata)) return;
+    }
+    if (!scan_contents) {
+      batcher.add(worker, path, 0, score);
+      return;
+    }
+
+    // Files are read by the worker that listed them, so the walker's work
+    // stealing spreads the reading too.
+    if (entry.type != EntryType::File || batcher.stopped()) return;
+    auto read_begin = ResultBatcher::Clock::now();
+    uint32_t found =
+        scanner.scan(entry.dir_fd, entry.name.data(), state.contents, &state.bytes_read,
+                     &state.cache_hits);
+    state.read_ns += elapsed_ns(read_begin, ResultBatcher::Clock::now());
+    state.files_read++;
+    if (found) {
+      batcher.add(worker, path, found, score);
+    }
+    batcher.tick(worker);
+  }, batcher.stop_signal());
+
+  batcher.flush_all();
+  for (WorkerState &state : workers) {
+    reporter.add_files(state.unreported_files);
+  }
+  reporter.set_directories(walker.directories_done(), walker.directories_pending());
+  if (query.cache) {
+    query.cache->flush();
+  }
+
+  if (live) {
+    const WalkStats &walk = walker.stats();
+    SearchStats &stats = live->stats;
+    stats = SearchStats();
+    stats.directories_opened = walk.directories_opened;
+    stats.entries_read = walk.entries_read;
+    stats.stat_calls = walk.stat_calls;
+    stats.directories_skipped = walk.directories_skipped;
+    stats.open_ns = walk.open_ns;
+    stats.enumerate_ns = walk.enumerate_ns;
+    stats.stat_ns = walk.stat_ns;
+    stats.idle_ns = walk.idle_ns;
+    for (const WorkerState &state : workers) {
+      stats.files_read += state.files_read;
+      stats.bytes_read += state.bytes_read;
+      stats.cache_hits += state.cache_hits;
+      stats.read_ns += state.read_ns;
+    }
+    finish_stats(stats, *live, batcher, started, walk.visit_ns);
+  }
+
+  if (reporter && !cancelled()) {
+    reporter.report(1.0);
+  }
+}
+
+std::vector<uint8_t> SearchEngine::filter(const SearchQuery &query, const std::string &directory,
+                                          const std::vector<std::string_view> &paths) const {
+  const Matcher matcher(query.text);
+  const QueryPlan plan(query);
+  const std::string root = normalize_directory(directory);
+  const size_t relative_offset = root == "/" ? 1 : root.size() + 1;
+
+  // Same rules as the walk: the text against the path below the root and
+  // the plan from the name to the metadata.
+  std::vector<uint8_t> keep(paths.size());
+  const size_t count = paths.size();
+  const unsigned workers = static_cast<unsigned>(std::max<size_t>(
+      1, std::min<size_t>(resolve_thread_count(threads), count / kMinFilterSlice)));
+  run_on_threads(workers, [&](unsigned worker) {
+    for (size_t i = count * worker / workers; i < count * (worker + 1) / workers; i++) {
+      std::string_view path = paths[i];
+      std::string_view name = path.substr(path.rfind('/') + 1);
+      std::string_view relative = path.substr(std::min(relative_offset, path.size()));
+      if (!plan.matches_name(name) || !matcher.matches(relative) || !plan.matches_path(relative)) {
+        continue;
+      }
+      EntryMetadata metadata;
+      EntryType type;
+      keep[i] = !plan.needs_metadata() ||
+                (stat_entry(AT_FDCWD, path.data(), type, &metadata) && plan.matches_metadata(metadata));
+    }
+  });
+  return keep;
+}
+
+} // namespace orion
@@ -0,0 +1,27 @@
+#include "search_session.hpp"
+
+namespace orion {
+
+SearchSession::SearchSession(Job job, CompletionCallback on_complete) {
+  runner = std::thread([this, job = std::move(job), on_complete = std::move(on_complete)]() {
+    job(&cancel_flag);
+    finished_flag.store(true, std::memory_order_release);
+    if (on_complete) {
+      on_complete(cancelled());
+    }
+  });
+}
+
+SearchSession::~SearchSession() {
+  cancel();
+  wait();
+}
+
+void SearchSession::wait() {
+  std::lock_guard<std::mutex> lock(join_mutex);
+  if (runner.joinable()) {
+    runner.join();
+  }
+}
+
+} // namespace orion
@@ -0,0 +1,82 @@
+#include "search_stats.hpp"
+
+#include <cstdio>
+
+namespace orion {
+
+namespace {
+
+void write_json_string(FILE *out, std::string_view text) {
+  fputc('"', out);
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      fputc('\\', out);
+      fputc(c, out);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+double microseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+} // namespace
+
+bool TraceRecorder::write(const std::string &path, const SearchStats &stats) const {
+  FILE *out = fopen(path.c_str(), "w");
+  if (!out) return false;
+
+  fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"orion\"}}");
+  for (size_t worker = 0; worker < spans.size(); worker++) {
+    fprintf(out,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,"
+            "\"args\":{\"name\":\"worker %zu\"}}",
+            worker, worker);
+    for (const Span &span : spans[worker]) {
+      fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"search\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,"
+                   "\"ts\":%.3f,\"dur\":%.3f",
+              span.name, worker, microseconds(span.begin - origin),
+              microseconds(span.end - span.begin));
+      if (!span.detail.empty()) {
+        fprintf(out, ",\"args\":{\"path\":");
+        write_json_string(out, span.detail);
+        fputc('}', out);
+      }
+      fputc('}', out);
+    }
+  }
+
+  fprintf(out,
+          ",\n{\"name\":\"stats\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{"
+          "\"directories_opened\":%llu,\"entries_read\":%llu,\"stat_calls\":%llu,"
+          "\"directories_skipped\":%llu,\"files_read\":%llu,\"bytes_read\":%llu,"
+          "\"cache_hits\":%llu,\"matches\":%llu}}",
+          static_cast<double>(stats.wall_ns) / 1000.0,
+          static_cast<unsigned long long>(stats.directories_opened),
+          static_cast<unsigned long long>(stats.entries_read),
+          static_cast<unsigned long long>(stats.stat_calls),
+          static_cast<unsigned long long>(stats.directories_skipped),
+          static_cast<unsigned long long>(stats.files_read),
+          static_cast<unsigned long long>(stats.bytes_read),
+          static_cast<unsigned long long>(stats.cache_hits),
+          static_cast<unsigned long long>(stats.matches));
+  fprintf(out,
+          ",\n{\"name\":\"phases_ms\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{"
+          "\"open\":%.3f,\"enumerate\":%.3f,\"stat\":%.3f,\"match\":%.3f,\"read\":%.3f,"
+          "\"deliver\":%.3f,\"idle\":%.3f,\"first_result\":%.3f,\"wall\":%.3f}}\n]}\n",
+          static_cast<double>(stats.wall_ns) / 1000.0, stats.open_ns / 1e6,
+          stats.enumerate_ns / 1e6, stats.stat_ns / 1e6, stats.match_ns / 1e6,
+          stats.read_ns / 1e6, stats.deliver_ns / 1e6, stats.idle_ns / 1e6,
+          stats.first_result_ns / 1e6, stats.wall_ns / 1e6);
+
+  bool ok = !ferror(out);
+  return fclose(out) == 0 && ok;
+}
+
+} // namespace orion
@@ -0,0 +1,113 @@
+#include "trigram_index.hpp"
+#include "file_index.hpp"
+
+#include <algorithm>
+
+namespace orion {
+
+namespace {
+
+constexpr unsigned kMinBucketBits = 12;
+constexpr unsigned kMaxBucketBits = 22;
+
+unsigned char fold_byte(char c) {
+  auto byte = static_cast<unsigned char>(c);
+  return (byte >= 'A' && byte <= 'Z') ? static_cast<unsigned char>(byte + ('a' - 'A')) : byte;
+}
+
+uint32_t bucket_of(const unsigned char *trigram, unsigned bits) {
+  uint32_t key = uint32_t(trigram[0]) | uint32_t(trigram[1]) << 8 | uint32_t(trigram[2]) << 16;
+  return (key * 0x9e3779b1u) >> (32 - bits);
+}
+
+// Calls fn(bucket) once for every distinct trigram bucket of `name`; stamps
+// remember which buckets were already seen for the current `stamp`.
+template <typename Fn>
+void for_each_bucket(std::string_view name, unsigned bits, std::vector<uint32_t> &stamps,
+                     uint32_t stamp, Fn &&fn) {
+  if (name.size() < 3) return;
+  unsigned char folded[3] = {fold_byte(name[0]), fold_byte(name[1]), 0};
+  for (size_t i = 2; i < name.size(); i++) {
+    folded[2] = fold_byte(name[i]);
+    uint32_t bucket = bucket_of(folded, bits);
+    if (stamps[bucket] != stamp) {
+      stamps[bucket] = stamp;
+      fn(bucket);
+    }
+    folded[0] = folded[1];
+    folded[1] = folded[2];
+  }
+}
+
+} // namespace
+
+TrigramIndex::TrigramIndex(const FileIndex &index) {
+  // Roughly one bucket per entry keeps collisions between distinct trigrams
+  // rare without making the table dominate small indexes.
+  bucket_bits = kMinBucketBits;
+  while (bucket_bits < kMaxBucketBits && (size_t(1) << bucket_bits) < index.size()) {
+    bucket_bits++;
+  }
+  const size_t bucket_count = size_t(1) << bucket_bits;
+
+  // Counting pass, then a fill pass. Nodes are visited in order, so every
+  // posting list comes out sorted. Stamps skip repeated trigrams in a name.
+  std::vector<uint32_t> stamps(bucket_count, 0);
+  offsets.assign(bucket_count + 1, 0);
+  for (uint32_t id = 1; id < index.size(); id++) {
+    for_each_bucket(index.name(id), bucket_bits, stamps, id,
+                    [&](uint32_t bucket) { offsets[bucket + 1]++; });
+  }
+  for (size_t bucket = 0; bucket < bucket_count; bucket++) {
+    offsets[bucket + 1] += offsets[bucket];
+  }
+
+  postings.resize(offsets[bucket_count]);
+  std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+  std::fill(stamps.begin(), stamps.end(), 0);
+  for (uint32_t id = 1; id < index.size(); id++) {
+    for_each_bucket(index.name(id), bucket_bits, stamps, id,
+                    [&](uint32_t bucket) { postings[cursor[bucket]++] = id; });
+  }
+}
+
+bool TrigramIndex::candidates(std::string_view folded_needle, std::vector<uint32_t> &result) const {
+  result.clear();
+  if (folded_needle.size() < 3) return false;
+  for (char c : folded_needle) {
+    if (static_cast<unsigned char>(c) >= 0x80) return false;
+  }
+
+  std::vector<uint32_t> buckets;
+  const auto *bytes = reinterpret_cast<const unsigned char *>(folded_needle.data());
+  for (size_t i = 0; i + 3 <= folded_needle.size(); i++) {
+    buckets.push_back(bucket_of(bytes + i, bucket_bits));
+  }
+  std::sort(buckets.begin(), buckets.end());
+  buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+  // Intersect starting from the shortest list so the working set only
+  // shrinks; the longer lists are probed by binary search.
+  auto length = [this](uint32_t bucket) { return offsets[bucket + 1] - offsets[bucket]; };
+  std::sort(buckets.begin(), buckets.end(),
+            [&](uint32_t a, uint32_t b) { return length(a) < length(b); });
+
+  const uint32_t *first = postings.data() + offsets[buckets[0]];
+  result.assign(first, first + length(buckets[0]));
+  for (size_t i = 1; i < buckets.size() && !result.empty(); i++) {
+    const uint32_t *begin = postings.data() + offsets[buckets[i]];
+    const uint32_t *end = begin + length(buckets[i]);
+    size_t kept = 0;
+    for (uint32_t id : result) {
+      begin = std::lower_bound(begin, end, id);
+      if (begin == end) break;
+      if (*begin == id) {
+        result[kept++] = id;
+      }
+    }
+    result.resize(kept);
+  }
+  return true;
+}
+
+} // namespace orion
@@ -0,0 +1,218 @@
+#include "walker.hpp"
+#include "dir_reader.hpp"
+#include "ignore_rules.hpp"
+#include "search_stats.hpp"
+#include "task_queue.hpp"
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace orion {
+
+namespace {
+
+struct DirTask {
+  std::shared_ptr<DirFd> parent;
+  std::string path;
+  size_t name_offset = 0;
+  // Rules for the directory's entries, not counting its own ignore files.
+  std::shared_ptr<const IgnoreRules> ignore;
+};
+
+// An entry held back until the rest of its directory has been read.
+struct HeldEntry {
+  size_t name_offset;
+  size_t length;
+  EntryType type;
+};
+
+bool is_ignore_file(const char *name) {
+  for (const char *file_name : IgnoreRules::kFileNames) {
+    if (strcmp(name, file_name) == 0) return true;
+  }
+  return false;
+}
+
+} // namespace
+
+std::string normalize_directory(std::string path) {
+  while (path.size() > 1 && path.back() == '/') {
+    path.pop_back();
+  }
+  return path;
+}
+
+ParallelWalker::ParallelWalker(unsigned thread_count)
+    : threads(resolve_thread_count(thread_count)) {}
+
+bool DirEntry::metadata(EntryMetadata &out) const {
+  // The walker's names point into the getdents buffer and are NUL-terminated.
+  EntryType stat_type;
+  return stat_entry(dir_fd, name.data(), stat_type, &out);
+}
+
+bool ParallelWalker::walk(const std::string &root, const Visitor &visitor,
+                          const std::atomic<bool> *cancel) {
+  dirs_done = 0;
+  dirs_pending = 0;
+  walk_stats = WalkStats();
+
+  std::string root_path = normalize_directory(root);
+
+  struct stat st;
+  if (stat(root_path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    return false;
+  }
+
+  auto cancelled = [cancel] { return cancel && cancel->load(std::memory_order_relaxed); };
+
+  TaskQueue<DirTask> queue(threads);
+  std::vector<DirTask> initial(1);
+  initial[0].path = root_path;
+  const size_t relative_offset = root_path == "/" ? 1 : root_path.size() + 1;
+  const bool read_ignore_files = ignore && ignore->ignore_files;
+  if (ignore) {
+    auto excludes = std::make_shared<IgnoreRules>(std::string(), nullptr);
+    for (const std::string &pattern : ignore->excludes) {
+      excludes->add(pattern);
+    }
+    if (!excludes->empty()) {
+      initial[0].ignore = std::move(excludes);
+    }
+  }
+  dirs_pending = 1;
+  queue.push(0, initial);
+
+  if (trace) {
+    trace->prepare(threads);
+  }
+  std::mutex stats_mutex;
+
+  run_on_threads(threads, [&](unsigned worker) {
+    using Clock = std::chrono::steady_clock;
+    std::vector<char> buffer;
+    std::vector<HeldEntry> held;
+    std::string held_names;
+    std::string relative;
+    WalkStats local;
+    queue.run(worker, [&](unsigned worker, DirTask &task, std::vector<DirTask> &children) {
+      if (!cancelled()) {
+        auto begin = Clock::now();
+        int fd = open_directory(task.parent.get(), task.path.c_str() + task.name_offset,
+                                task.path.c_str());
+        auto opened = Clock::now();
+        local.open_ns += elapsed_ns(begin, opened);
+        if (fd >= 0) {
+          local.directories_opened++;
+          auto dir = std::make_shared<DirFd>(fd);
+          uint64_t enumerate_ns = 0;
+          uint64_t stat_ns = 0;
+          const std::string_view task_relative =
+              std::string_view(task.path).substr(std::min(relative_offset, task.path.size()));
+          std::shared_ptr<const IgnoreRules> rules = task.ignore;
+
+          auto visit = [&](const char *name, size_t length, EntryType type) {
+            if (type == EntryType::Unknown) {
+              auto stat_begin = Clock::now();
+              bool found = stat_entry(fd, name, type);
+              stat_ns += elapsed_ns(stat_begin, Clock::now());
+              local.stat_calls++;
+              if (!found) return;
+            }
+
+            if (rules) {
+              relative.assign(task_relative);
+              if (!relative.empty()) {
+                relative += '/';
+              }
+              relative.append(name, length);
+              if (rules->ignored(relative, type == EntryType::Directory)) {
+                if (type == EntryType::Directory) {
+                  local.directories_skipped++;
+                }
+                return;
+              }
+            }
+
+            visitor(worker, DirEntry{task.path, std::string_view(name, length), type, fd});
+
+            if (type == EntryType::Directory) {
+              DirTask child;
+              child.parent = dir;
+              child.path.reserve(task.path.size() + 1 + length);
+              child.path = task.path;
+              if (child.path.back() != '/') {
+                child.path += '/';
+              }
+              child.name_offset = child.path.size();
+              child.path.append(name, length);
+              child.ignore = rules;
+              children.push_back(std::move(child));
+            }
+          };
+
+          if (!read_ignore_files) {
+            read_entries(fd, buffer, cancel, &enumerate_ns,
+                         [&](const char *name, size_t length, EntryType type) {
+              local.entries_read++;
+              visit(name, length, type);
+            });
+          } else {
+            // A directory's ignore files apply to its own entries, so the
+            // listing is held until it is known whether there are any. Names
+            // keep their NUL for DirEntry::metadata().
+            held.clear();
+            held_names.clear();
+            bool has_ignore_file = false;
+            read_entries(fd, buffer, cancel, &enumerate_ns,
+                         [&](const char *name, size_t length, EntryType type) {
+              local.entries_read++;
+              held.push_back(HeldEntry{held_names.size(), length, type});
+              held_names.append(name, length + 1);
+              has_ignore_file = has_ignore_file || is_ignore_file(name);
+            });
+            if (has_ignore_file) {
+              auto own = std::make_shared<IgnoreRules>(std::string(task_relative), rules);
+              for (const char *file_name : IgnoreRules::kFileNames) {
+                own->add_file(fd, file_name);
+              }
+              if (!own->empty()) {
+                rules = std::move(own);
+              }
+            }
+            for (const HeldEntry &entry : held) {
+              visit(held_names.data() + entry.name_offset, entry.length, entry.type);
+            }
+          }
+          auto end = Clock::now();
+          local.enumerate_ns += enumerate_ns;
+          local.stat_ns += stat_ns;
+          local.visit_ns += elapsed_ns(opened, end) - std::min(elapsed_ns(opened, end),
+                                                               enumerate_ns + stat_ns);
+          if (trace) {
+            trace->add(worker, "directory", begin, end, task.path);
+          }
+        }
+      }
+
+      dirs_pending.fetch_add(children.size(), std::memory_order_relaxed);
+      dirs_pending.fetch_sub(1, std::memory_order_relaxed);
+      dirs_done.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    walk_stats.directories_opened += local.directories_opened;
+    walk_stats.entries_read += local.entries_read;
+    walk_stats.stat_calls += local.stat_calls;
+    walk_stats.directories_skipped += local.directories_skipped;
+    walk_stats.open_ns += local.open_ns;
+    walk_stats.enumerate_ns += local.enumerate_ns;
+    walk_stats.stat_ns += local.stat_ns;
+    walk_stats.visit_ns += local.visit_ns;
+  });
+  walk_stats.idle_ns = queue.idle_nanoseconds();
+  return true;
+}
+
+} // namespace orion
@@ -0,0 +1,53 @@
+#include "regex.hpp"
+
+#include <cstdio>
+
+namespace {
+
+struct Case {
+  const char *pattern;
+  bool ignore_case;
+  const char *text;
+  bool matches;
+};
+
+// A two-member class is one character only when it holds a letter's two
+// cases and case is ignored; otherwise its literal must not be required.
+const Case kCases[] = {
+    {"[ab]x", false, "xbx", true},
+    {"[ab]x", false, "ax", true},
+    {"[ab]x", false, "cx", false},
+    {"[ab]x", true, "XBX", true},
+    {"[ab]x", true, "CX", false},
+    {"[Hh]ello", false, "say Hello", true},
+    {"[Hh]ello", false, "say hello", true},
+    {"[Hh]ello", false, "say HELLO", false},
+    {"[Hh]ello", true, "say HELLO", true},
+    {"[Hh]ello", true, "say jello", false},
+    {"x[ab]", false, "xb", true},
+    {"x[ab]", false, "xc", false},
+    {"x[ab]", true, "XB", true},
+    {"x[ab]", true, "XC", false},
+};
+
+} // namespace
+
+int main() {
+  int failed = 0;
+  for (const Case &test : kCases) {
+    auto regex = orion::Regex::compile(test.pattern, test.ignore_case);
+    if (!regex) {
+      fprintf(stderr, "%s: does not compile\n", test.pattern);
+      failed++;
+      continue;
+    }
+    const bool matches = regex->matches(test.text);
+    uint32_t lines = regex->count_lines(test.text);
+    if (matches != test.matches || lines != (test.matches ? 1u : 0u)) {
+      fprintf(stderr, "%s (ignore case %d) against \"%s\": got %d, %u lines\n", test.pattern,
+              test.ignore_case, test.text, matches, lines);
+      failed++;
+    }
+  }
+  return failed == 0 ? 0 : 1;
+}
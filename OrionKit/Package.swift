@@ -15,7 +15,11 @@ let package = Package(
     targets: [
         .target(
             name: "OrionKit",
-            dependencies: ["COrionKit"]
+            dependencies: ["COrionKit", "Utilities"]
+        ),
+        .target(
+            name: "Utilities",
+            dependencies: []
         ),
         .target(
             name: "COrionKit",
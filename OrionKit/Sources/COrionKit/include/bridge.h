@@ -7,10 +7,20 @@
 extern "C" {
 #endif
 
+// `path` is NUL-terminated; `length` excludes the terminator. `match_count`
+// is the number of content matches, 0 for name-only searches. `score` ranks
+// fuzzy results (higher is better) and is 0 otherwise.
 typedef struct {
     const char* path;
+    int32_t length;
+    int32_t match_count;
+    int32_t score;
 } orion_search_result_t;
 
+// Returned by orion_search_files as a single allocation: this header, then
+// the `results` table, then one arena holding every path back to back.
+// orion_free_search_results releases all of it at once. NULL if that
+// allocation fails.
 typedef struct {
     orion_search_result_t* results;
     int32_t count;
@@ -18,12 +28,184 @@ typedef struct {
 
 typedef void (*orion_progress_callback)(double progress, void* user_data);
 
+// A snapshot of a running search's counters. `estimate` is the fraction of
+// directories (or index entries) visited, not of results found.
+typedef struct {
+    int64_t files_seen;
+    int64_t directories_done;
+    int64_t directories_pending;
+    int64_t matches;
+    double estimate;
+    int32_t finished;
+    // Set once max_results or time_limit_ms stopped the search early.
+    int32_t truncated;
+} orion_search_progress_t;
+
+// Where a finished search spent its time, in nanoseconds. Durations are
+// summed over worker threads, so together they can exceed `wall_ns`.
+typedef struct {
+    int64_t directories_opened;
+    int64_t entries_read;
+    int64_t stat_calls;
+    // Left out by ignore rules without being opened.
+    int64_t directories_skipped;
+    int64_t files_read;
+    int64_t bytes_read;
+    // Files the content cache answered for without reading them.
+    int64_t cache_hits;
+    int64_t matches;
+    int64_t open_ns;
+    int64_t enumerate_ns;
+    int64_t stat_ns;
+    int64_t match_ns;
+    int64_t read_ns;
+    int64_t deliver_ns;
+    int64_t idle_ns;
+    int64_t first_result_ns;
+    int64_t wall_ns;
+} orion_search_stats_t;
+
+// Receives results in batches while a search is running. The array and the
+// strings it points to are only valid for the duration of the call. Batches are
+// delivered from worker threads, one at a time.
+typedef void (*orion_results_callback)(const orion_search_result_t* results, int32_t count, void* user_data);
+
+// Called once from the search thread when a search started with
+// orion_search_start finishes or stops after being cancelled.
+typedef void (*orion_completion_callback)(int32_t cancelled, void* user_data);
+
+// Files with identical contents, found by orion_duplicates_start. `files`
+// are sorted by path; their match_count and score are 0.
+typedef struct {
+    int64_t size;
+    const orion_search_result_t* files;
+    int32_t count;
+} orion_duplicate_group_t;
+
+// Receives every group at once when a duplicate search has compared all its
+// candidates, the most reclaimable bytes (size times copies beyond the
+// first) first. The groups and the strings they point to are only valid for
+// the duration of the call.
+typedef void (*orion_duplicates_callback)(const orion_duplicate_group_t* groups, int32_t count, void* user_data);
+
+// Settings for orion_search_start and orion_index_search_start beyond the
+// query string. Passing NULL is the same as a zeroed struct.
+typedef struct {
+    // Literal that the contents of a matching file must contain
+    // (case-sensitive, binary files are skipped), or NULL to match names only.
+    const char* content;
+    // File to write a Chrome trace-event timeline of the search to, or NULL.
+    const char* trace_path;
+    // Non-zero to match the query text as a subsequence. Only the best
+    // `rank_limit` results (1000 if 0) are delivered, best first, when the
+    // search finishes.
+    int32_t fuzzy;
+    int32_t rank_limit;
+    // Stop every worker once this many results have been delivered, or once
+    // this many milliseconds have passed; 0 means no limit.
+    int32_t max_results;
+    int32_t time_limit_ms;
+    // Non-zero to match `content` as a regular expression; the result's
+    // match_count then counts matching lines.
+    int32_t content_regex;
+    // Non-zero to leave out what gitignore-style rules exclude: the patterns
+    // of .gitignore and .orionignore files (unless `no_ignore_files` is set)
+    // and `excludes`, newline-separated, or the default list (.git,
+    // node_modules, ...) when it is NULL. Excluded directories are not opened.
+    int32_t ignore;
+    int32_t no_ignore_files;
+    const char* excludes;
+    // File of the persistent content cache, e.g. "content-cache" in the
+    // settings directory, or NULL to read every file. It remembers content
+    // hashes and which files are binary per device, inode, size and mtime,
+    // so unchanged files are not read again. Opened (and compacted) on first
+    // use and kept open by the process.
+    const char* cache_path;
+} orion_search_options_t;
+
+// Keys for orion_sort_order.
+enum {
+    ORION_SORT_NAME = 0,
+    ORION_SORT_PATH = 1,
+    ORION_SORT_SIZE = 2,
+    ORION_SORT_MODIFIED = 3,
+    ORION_SORT_MATCHES = 4,
+};
+
+typedef struct orion_search_handle orion_search_handle_t;
+typedef struct orion_index orion_index_t;
+
 orion_search_results_t* orion_search_files(const char* query, const char* directory, orion_progress_callback progress_cb, void* user_data);
+void orion_search_files_streaming(const char* query, const char* directory, orion_results_callback results_cb, orion_progress_callback progress_cb, void* user_data);
 void orion_free_search_results(orion_search_results_t* results);
+// Writes to `order` the indices of `results` sorted by `key` (an
+// ORION_SORT_* value), ties broken by path. Sizes and modification times are
+// read once per result on all cores, so sorting a large result set stats
+// each file once. `order` must hold `count` entries.
+void orion_sort_order(const orion_search_result_t* results, int32_t count, int32_t key, int32_t descending, int32_t* order);
+// Non-zero if, in the same directory, every result of `query` is also a
+// result of `previous`, so the complete previous results can be narrowed with
+// orion_filter_results instead of searching again.
+int32_t orion_query_refines(const char* query, const orion_search_options_t* options, const char* previous, const orion_search_options_t* previous_options);
+// Sets keep[i] to 1 if results[i], found by an earlier search of `directory`,
+// matches `query`, and to 0 otherwise. Only size and mtime terms touch the
+// filesystem, with one stat per result.
+void orion_filter_results(const orion_search_result_t* results, int32_t count, const char* query, const orion_search_options_t* options, const char* directory, uint8_t* keep);
+
+// Runs a search in the background. Cancelling stops the walker and the
+// matching workers within one directory read; no results are delivered after
+// the cancellation has been observed. Freeing a handle cancels and waits.
+orion_search_handle_t* orion_search_start(const char* query, const char* directory, const orion_search_options_t* options, orion_results_callback results_cb, orion_progress_callback progress_cb, orion_completion_callback completion_cb, void* user_data);
+void orion_search_cancel(orion_search_handle_t* handle);
+void orion_search_wait(orion_search_handle_t* handle);
+// Reads the counters the workers keep current. Never blocks and allocates
+// nothing, so a UI can poll it once per frame instead of taking a progress
+// callback for every update.
+void orion_search_get_progress(const orion_search_handle_t* handle, orion_search_progress_t* progress);
+// Fills `stats` once the search has finished; before that it is zeroed.
+void orion_search_get_stats(const orion_search_handle_t* handle, orion_search_stats_t* stats);
+void orion_search_free(orion_search_handle_t* handle);
+// Finds files below `directory` with identical contents among those `query`
+// matches (an empty query takes every file), skipping files smaller than
+// `min_size` bytes and empty ones. Files are bucketed by size, then hashed
+// by their first and last blocks, and only those still alike are hashed in
+// full, on all cores. Of `options` only the ignore settings, trace_path and
+// cache_path apply. The handle works like a search's: progress counts files seen and
+// duplicates confirmed, and the stats' files_read and bytes_read cover the
+// hashing. Nothing is delivered once cancelled.
+orion_search_handle_t* orion_duplicates_start(const char* query, const char* directory, const orion_search_options_t* options, int64_t min_size, orion_duplicates_callback duplicates_cb, orion_completion_callback completion_cb, void* user_data);
+
+// Opens the persistent filename index of `root` kept in `index_dir`,
+// memory-mapping the saved copy if one exists. An index that has never been
+// refreshed has no entries and should not be searched.
+orion_index_t* orion_index_open(const char* root, const char* index_dir);
+int64_t orion_index_entry_count(const orion_index_t* index);
+// Bytes held by the current snapshot: entries, names and the trigram table
+// used for substring queries.
+int64_t orion_index_memory_usage(const orion_index_t* index);
+// Rescans only the directories whose mtime changed since the last refresh,
+// saves the new index and swaps it in. Searches already running keep the
+// snapshot they started with.
+orion_search_handle_t* orion_index_refresh_start(orion_index_t* index, orion_completion_callback completion_cb, void* user_data);
+orion_search_handle_t* orion_index_search_start(orion_index_t* index, const char* query, const orion_search_options_t* options, orion_results_callback results_cb, orion_progress_callback progress_cb, orion_completion_callback completion_cb, void* user_data);
+// Keeps the index current from filesystem notifications (inotify on Linux)
+// instead of periodic refreshes. Returns 0 if notifications are unavailable
+// or the index has not been built yet.
+int32_t orion_index_watch_start(orion_index_t* index);
+void orion_index_watch_stop(orion_index_t* index);
+// Handles started from the index stay valid after it is freed.
+void orion_index_free(orion_index_t* index);
 void orion_open_in_finder(const char* path);
 
 #ifdef __cplusplus
 }
+
+#include <string_view>
+
+// Views a result path in place, without copying or measuring it again.
+inline std::string_view orion_result_path(const orion_search_result_t& result) {
+    return std::string_view(result.path, static_cast<size_t>(result.length));
+}
 #endif
 
 #endif // ORIONKIT_BRIDGE_H
@@ -0,0 +1,319 @@
+import Foundation
+import Utilities
+
+/// A file as it was when its contents were read, as in OrionCore's
+/// ContentKey: facts stored under it stay true for as long as a stat
+/// returns it.
+struct ContentKey: Sendable {
+    let device: UInt64
+    let inode: UInt64
+    let size: UInt64
+    let mtimeNs: Int64
+
+    init(_ info: stat) {
+        device = UInt64(truncatingIfNeeded: info.st_dev)
+        inode = UInt64(info.st_ino)
+        size = UInt64(info.st_size)
+        #if os(macOS)
+            let mtime = info.st_mtimespec
+        #else
+            let mtime = info.st_mtim
+        #endif
+        mtimeNs = Int64(mtime.tv_sec) * 1_000_000_000 + Int64(mtime.tv_nsec)
+    }
+}
+
+/// What reading a file's contents found; nil where it is not known.
+struct ContentFacts: Sendable {
+    static let edgeFlag: UInt32 = 1
+    static let fullFlag: UInt32 = 2
+    static let binaryFlag: UInt32 = 4
+
+    /// DuplicateFinder's hashes of the first and last blocks and of the
+    /// whole file.
+    var edgeHash: UInt64?
+    var fullHash: UInt64?
+    var binary = false
+
+    var flags: UInt32 {
+        (edgeHash != nil ? ContentFacts.edgeFlag : 0) | (fullHash != nil ? ContentFacts.fullFlag : 0)
+            | (binary ? ContentFacts.binaryFlag : 0)
+    }
+}
+
+/// Facts about file contents kept across sessions in the append-only log
+/// OrionCore's ContentCache keeps, so the two can share one file. Opening it
+/// folds the log into the latest facts per device and inode and rewrites it
+/// once a quarter of its records are stale or any are damaged. A log that
+/// cannot be read or written only costs the facts it would have kept.
+public final class ContentCache: @unchecked Sendable {
+    public static let fileName = "content-cache"
+    /// Compaction keeps the most recently stored files beyond this many.
+    static let maxEntries = 1 << 20
+    private static let magic = Array("ORIONCC".utf8) + [0]
+    private static let version: UInt32 = 1
+    private static let recordSize = 64
+    private static let appendBatch = 1024
+
+    /// In the orion directory of the user's configuration, next to the
+    /// Linux app's settings.conf.
+    public static var defaultPath: String {
+        let environment = ProcessInfo.processInfo.environment
+        let config =
+            environment["XDG_CONFIG_HOME"].flatMap { $0.isEmpty ? nil : $0 }
+            ?? NSHomeDirectory() + "/.config"
+        return config + "/orion/" + fileName
+    }
+
+    private struct FileID: Hashable {
+        let device: UInt64
+        let inode: UInt64
+    }
+
+    private struct Entry {
+        var size: UInt64
+        var mtimeNs: Int64
+        var facts: ContentFacts
+        /// Order of the last store, for compaction to keep the newest.
+        var sequence: UInt64
+    }
+
+    private let path: String
+    private let lock = NSLock()
+    private var entries: [FileID: Entry] = [:]
+    private var sequence: UInt64 = 0
+    private var pending: [UInt8] = []
+    private var pendingCount = 0
+    private var logFD: Int32 = -1
+
+    /// Loads and compacts the log at `path`, creating it and its directory
+    /// if needed.
+    public init(path: String = ContentCache.defaultPath) {
+        self.path = path
+        loadAndCompact()
+    }
+
+    deinit {
+        flush()
+        if logFD >= 0 { close(logFD) }
+    }
+
+    /// Nil unless `key` matches the file's last stored size and mtime.
+    func lookup(_ key: ContentKey) -> ContentFacts? {
+        lock.lock()
+        defer { lock.unlock() }
+        guard let entry = entries[FileID(device: key.device, inode: key.inode)],
+            entry.size == key.size, entry.mtimeNs == key.mtimeNs
+        else {
+            return nil
+        }
+        return entry.facts
+    }
+
+    /// Adds `facts` to what is known about the file; facts stored under an
+    /// older size or mtime are dropped.
+    func store(_ key: ContentKey, _ facts: ContentFacts) {
+        lock.lock()
+        defer { lock.unlock() }
+        let id = FileID(device: key.device, inode: key.inode)
+        guard let entry = merge(id, key.size, key.mtimeNs, facts) else { return }
+        pending.append(contentsOf: ContentCache.encode(id, entry))
+        pendingCount += 1
+        if pendingCount >= ContentCache.appendBatch { appendPending() }
+    }
+
+    /// Appends the facts stored since the last flush.
+    public func flush() {
+        lock.lock()
+        defer { lock.unlock() }
+        appendPending()
+    }
+
+    /// The merged entry, or nil if `facts` added nothing.
+    private func merge(_ id: FileID, _ size: UInt64, _ mtimeNs: Int64, _ facts: ContentFacts)
+        -> Entry?
+    {
+        var changed = false
+        var entry: Entry
+        if let known = entries[id], known.size == size, known.mtimeNs == mtimeNs {
+            entry = known
+        } else {
+            entry = Entry(size: size, mtimeNs: mtimeNs, facts: ContentFacts(), sequence: 0)
+            changed = true
+        }
+        if let hash = facts.edgeHash, entry.facts.edgeHash != hash {
+            entry.facts.edgeHash = hash
+            changed = true
+        }
+        if let hash = facts.fullHash, entry.facts.fullHash != hash {
+            entry.facts.fullHash = hash
+            changed = true
+        }
+        if facts.binary && !entry.facts.binary {
+            entry.facts.binary = true
+            changed = true
+        }
+        guard changed else { return nil }
+        entry.sequence = sequence
+        sequence += 1
+        entries[id] = entry
+        return entry
+    }
+
+    private static func header() -> [UInt8] {
+        var bytes = magic
+        withUnsafeBytes(of: version.littleEndian) { bytes.append(contentsOf: $0) }
+        withUnsafeBytes(of: UInt32(recordSize).littleEndian) { bytes.append(contentsOf: $0) }
+        return bytes
+    }
+
+    private static func encode(_ id: FileID, _ entry: Entry) -> [UInt8] {
+        var bytes: [UInt8] = []
+        bytes.reserveCapacity(recordSize)
+        let words = [
+            id.device, id.inode, entry.size, UInt64(bitPattern: entry.mtimeNs),
+            entry.facts.edgeHash ?? 0, entry.facts.fullHash ?? 0,
+        ]
+        for word in words {
+            withUnsafeBytes(of: word.littleEndian) { bytes.append(contentsOf: $0) }
+        }
+        withUnsafeBytes(of: entry.facts.flags.littleEndian) { bytes.append(contentsOf: $0) }
+        bytes.append(contentsOf: [0, 0, 0, 0])
+        let check = XXHash64.hash(Data(bytes))
+        withUnsafeBytes(of: check.littleEndian) { bytes.append(contentsOf: $0) }
+        return bytes
+    }
+
+    /// Merges the record at `offset`; false if its check does not match.
+    private func decode(_ bytes: UnsafeRawBufferPointer, at offset: Int) -> Bool {
+        func word(_ index: Int) -> UInt64 {
+            let at = offset + index * 8
+            return UInt64(littleEndian: bytes.loadUnaligned(fromByteOffset: at, as: UInt64.self))
+        }
+        var check = XXHash64()
+        check.update(UnsafeRawBufferPointer(rebasing: bytes[offset..<(offset + 56)]))
+        guard check.digest() == word(7) else { return false }
+        let flags = UInt32(
+            littleEndian: bytes.loadUnaligned(fromByteOffset: offset + 48, as: UInt32.self))
+        var facts = ContentFacts()
+        facts.edgeHash = flags & ContentFacts.edgeFlag != 0 ? word(4) : nil
+        facts.fullHash = flags & ContentFacts.fullFlag != 0 ? word(5) : nil
+        facts.binary = flags & ContentFacts.binaryFlag != 0
+        _ = merge(FileID(device: word(0), inode: word(1)), word(2), Int64(bitPattern: word(3)), facts)
+        return true
+    }
+
+    /// The log, opened and locked, or -1. Reopens it if another process
+    /// compacted it into a new file after it was opened.
+    private func lockLog(_ fd: Int32) -> Int32 {
+        var fd = fd
+        for _ in 0..<3 {
+            if fd < 0 {
+                fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0o644)
+                if fd < 0 { return -1 }
+            }
+            var opened = stat()
+            var current = stat()
+            if flock(fd, LOCK_EX) == 0 && fstat(fd, &opened) == 0 && stat(path, &current) == 0
+                && opened.st_dev == current.st_dev && opened.st_ino == current.st_ino
+            {
+                return fd
+            }
+            close(fd)
+            fd = -1
+        }
+        return -1
+    }
+
+    private static func writeAll(_ fd: Int32, _ bytes: [UInt8]) -> Bool {
+        bytes.withUnsafeBytes { buffer in
+            var offset = 0
+            while offset < buffer.count {
+                let written = write(fd, buffer.baseAddress! + offset, buffer.count - offset)
+                if written <= 0 { return false }
+                offset += written
+            }
+            return true
+        }
+    }
+
+    /// Called with `lock` held.
+    private func appendPending() {
+        guard pendingCount > 0 else { return }
+        defer {
+            pending.removeAll(keepingCapacity: true)
+            pendingCount = 0
+        }
+        logFD = lockLog(logFD)
+        guard logFD >= 0 else { return }
+        defer { flock(logFD, LOCK_UN) }
+        var info = stat()
+        guard fstat(logFD, &info) == 0,
+            info.st_size > 0 || ContentCache.writeAll(logFD, ContentCache.header())
+        else {
+            return
+        }
+        _ = ContentCache.writeAll(logFD, pending)
+    }
+
+    private func loadAndCompact() {
+        try? FileManager.default.createDirectory(
+            atPath: (path as NSString).deletingLastPathComponent, withIntermediateDirectories: true)
+        let fd = lockLog(-1)
+        guard fd >= 0 else { return }
+        defer { close(fd) }
+
+        // Anything but a whole number of valid records under a matching
+        // header is rewritten, which also realigns the log after a torn
+        // append.
+        let handle = FileHandle(fileDescriptor: fd, closeOnDealloc: false)
+        let data = (try? handle.readToEnd()) ?? Data()
+        let header = ContentCache.header()
+        var damaged = false
+        var records = 0
+        if !data.isEmpty {
+            damaged = data.count < header.count || !data.prefix(header.count).elementsEqual(header)
+            if !damaged {
+                damaged = (data.count - header.count) % ContentCache.recordSize != 0
+                data.withUnsafeBytes { bytes in
+                    var offset = header.count
+                    while offset + ContentCache.recordSize <= bytes.count {
+                        if decode(bytes, at: offset) {
+                            records += 1
+                        } else {
+                            damaged = true
+                        }
+                        offset += ContentCache.recordSize
+                    }
+                }
+            }
+        }
+
+        // Every change to a file adds a record; once a quarter of them are
+        // stale the log is rewritten with one record per live entry, oldest
+        // first.
+        let live = entries.count
+        guard damaged || records - live > live / 4 || live > ContentCache.maxEntries else {
+            return
+        }
+        var kept = entries.sorted { $0.value.sequence < $1.value.sequence }
+        if kept.count > ContentCache.maxEntries {
+            for (id, _) in kept.prefix(kept.count - ContentCache.maxEntries) {
+                entries[id] = nil
+            }
+            kept.removeFirst(kept.count - ContentCache.maxEntries)
+        }
+        var bytes = header
+        bytes.reserveCapacity(header.count + kept.count * ContentCache.recordSize)
+        for (id, entry) in kept {
+            bytes.append(contentsOf: ContentCache.encode(id, entry))
+        }
+        let temp = path + ".tmp.\(getpid())"
+        guard FileManager.default.createFile(atPath: temp, contents: Data(bytes)),
+            rename(temp, path) == 0
+        else {
+            unlink(temp)
+            return
+        }
+    }
+}
@@ -0,0 +1,244 @@
+import Foundation
+import Utilities
+
+/// Files with identical contents, paths sorted.
+public struct DuplicateGroup {
+    public let size: Int64
+    public let paths: [String]
+
+    /// What deleting all but one copy would free.
+    public var reclaimable: Int64 { size * Int64(paths.count - 1) }
+}
+
+private struct Candidate: Sendable {
+    let path: String
+    let size: Int64
+    let key: ContentKey
+}
+
+private struct FileID: Hashable {
+    let device: UInt64
+    let inode: UInt64
+}
+
+private struct Key: Hashable {
+    let size: Int64
+    let hash: UInt64
+}
+
+/// Finds files with identical contents in the stages OrionCore's
+/// DuplicateFinder uses: files are bucketed by size, files sharing a size
+/// are keyed by a hash of their first and last blocks, and only those still
+/// alike are hashed in full with XXHash64. Hashing runs on one task per
+/// core, largest files first, and skips files whose hashes a ContentCache
+/// kept from an earlier search. Hard links to one file count once and empty
+/// files are never reported.
+public final class DuplicateFinder {
+    static let edgeBlock = 4096
+    static let readChunk = 1 << 20
+
+    public init() {}
+
+    /// The files compared are those `query` matches, as FileSearcher would
+    /// list them. Groups come back with the most reclaimable bytes first.
+    public func find(
+        query: String, in directory: String, ignore: IgnoreSettings? = IgnoreSettings(),
+        minSize: Int64 = 1, cache: ContentCache? = nil,
+        progress: @escaping FileSearcher.ProgressCallback
+    ) async throws -> [DuplicateGroup] {
+        let matches = try await FileSearcher().search(query: query, in: directory, ignore: ignore) {
+            update in
+            progress(SearchProgress(progress: update.progress * 0.5, status: update.status))
+        }
+
+        // Stage 1: sizes seen once, and further links to a file already
+        // listed, drop out without reading anything.
+        var bySize: [Int64: [Candidate]] = [:]
+        var seen = Set<FileID>()
+        for result in matches.sorted(by: { $0.path < $1.path }) {
+            var info = stat()
+            guard lstat(result.path, &info) == 0, (info.st_mode & S_IFMT) == S_IFREG,
+                Int64(info.st_size) >= max(minSize, 1),
+                seen.insert(
+                    FileID(
+                        device: UInt64(truncatingIfNeeded: info.st_dev),
+                        inode: UInt64(info.st_ino))
+                ).inserted
+            else {
+                continue
+            }
+            bySize[Int64(info.st_size), default: []].append(
+                Candidate(path: result.path, size: Int64(info.st_size), key: ContentKey(info)))
+        }
+        let sameSize = bySize.values.filter { $0.count > 1 }.flatMap { $0 }
+            .sorted { $0.size > $1.size }
+
+        // Stage 2: the edges. Small files are read whole here and need no
+        // third stage.
+        var groups: [DuplicateGroup] = []
+        var full: [Candidate] = []
+        let edges = try await alike(
+            sameSize, by: DuplicateFinder.cached(DuplicateFinder.edgeHash, in: cache, full: false)
+        ) { done in
+            progress(SearchProgress(
+                progress: 0.5 + 0.1 * Double(done) / Double(sameSize.count),
+                status: "Comparing \(sameSize.count) files of equal size"))
+        }
+        for files in edges {
+            if files[0].size <= 2 * Int64(DuplicateFinder.edgeBlock) {
+                groups.append(
+                    DuplicateGroup(size: files[0].size, paths: files.map(\.path).sorted()))
+            } else {
+                full.append(contentsOf: files)
+            }
+        }
+
+        // Stage 3: whole contents.
+        full.sort { $0.size > $1.size }
+        let contents = try await alike(
+            full, by: DuplicateFinder.cached(DuplicateFinder.contentHash, in: cache, full: true)
+        ) { done in
+            progress(SearchProgress(
+                progress: 0.6 + 0.4 * Double(done) / Double(full.count),
+                status: "Hashing \(full.count) candidate duplicates"))
+        }
+        cache?.flush()
+        for files in contents {
+            groups.append(DuplicateGroup(size: files[0].size, paths: files.map(\.path).sorted()))
+        }
+
+        groups.sort {
+            $0.reclaimable != $1.reclaimable
+                ? $0.reclaimable > $1.reclaimable : $0.paths[0] < $1.paths[0]
+        }
+        let reclaimable = groups.reduce(Int64(0)) { $0 + $1.reclaimable }
+        progress(SearchProgress(
+            progress: 1.0,
+            status: "\(groups.count) groups of identical files, "
+                + ByteCountFormatter.string(fromByteCount: reclaimable, countStyle: .file)
+                + " reclaimable"))
+        return groups
+    }
+
+    /// Hashes `files` with at most one task per core, starting them in order,
+    /// and returns the sets of two or more with equal sizes and hashes. Files
+    /// that cannot be read drop out. `report` gets the number hashed so far.
+    private func alike(
+        _ files: [Candidate], by hash: @escaping @Sendable (Candidate) -> UInt64?,
+        report: (Int) -> Void
+    ) async throws -> [[Candidate]] {
+        var keys = [UInt64?](repeating: nil, count: files.count)
+        let width = max(ProcessInfo.processInfo.activeProcessorCount, 1)
+        let run: @Sendable (Int) throws -> (Int, UInt64?) = { index in
+            try Task.checkCancellation()
+            return (index, hash(files[index]))
+        }
+        try await withThrowingTaskGroup(of: (Int, UInt64?).self) { tasks in
+            var next = 0
+            while next < min(width, files.count) {
+                let index = next
+                tasks.addTask { try run(index) }
+                next += 1
+            }
+            var done = 0
+            for try await (index, key) in tasks {
+                keys[index] = key
+                done += 1
+                report(done)
+                if next < files.count {
+                    let index = next
+                    tasks.addTask { try run(index) }
+                    next += 1
+                }
+            }
+        }
+
+        var sets: [Key: [Candidate]] = [:]
+        for (file, key) in zip(files, keys) {
+            if let key = key {
+                sets[Key(size: file.size, hash: key), default: []].append(file)
+            }
+        }
+        return sets.values.filter { $0.count > 1 }
+    }
+
+    /// `hash`, or the one `cache` kept for the file if it is unchanged since;
+    /// new hashes are stored.
+    private static func cached(
+        _ hash: @escaping @Sendable (String, Int64) -> UInt64?, in cache: ContentCache?, full: Bool
+    ) -> @Sendable (Candidate) -> UInt64? {
+        return { file in
+            if let known = cache?.lookup(file.key),
+                let value = full ? known.fullHash : known.edgeHash
+            {
+                return value
+            }
+            guard let value = hash(file.path, file.size) else { return nil }
+            var facts = ContentFacts()
+            if full {
+                facts.fullHash = value
+            } else {
+                facts.edgeHash = value
+            }
+            cache?.store(file.key, facts)
+            return value
+        }
+    }
+
+    /// The first and last edgeBlock bytes, or the whole file when it is no
+    /// larger than both.
+    private static func edgeHash(_ path: String, _ size: Int64) -> UInt64? {
+        guard let handle = FileHandle(forReadingAtPath: path) else { return nil }
+        defer { try? handle.close() }
+        let block = Int64(edgeBlock)
+        var hasher = XXHash64()
+        do {
+            if size <= 2 * block {
+                guard let data = try handle.read(upToCount: Int(size)), data.count == Int(size)
+                else {
+                    return nil
+                }
+                hasher.update(data)
+            } else {
+                guard let head = try handle.read(upToCount: edgeBlock), head.count == edgeBlock
+                else {
+                    return nil
+                }
+                try handle.seek(toOffset: UInt64(size - block))
+                guard let tail = try handle.read(upToCount: edgeBlock), tail.count == edgeBlock
+                else {
+                    return nil
+                }
+                hasher.update(head)
+                hasher.update(tail)
+            }
+        } catch {
+            return nil
+        }
+        return hasher.digest()
+    }
+
+    /// Nil when the file changed size since it was listed, or the search was
+    /// cancelled.
+    private static func contentHash(_ path: String, _ size: Int64) -> UInt64? {
+        guard let handle = FileHandle(forReadingAtPath: path) else { return nil }
+        defer { try? handle.close() }
+        var hasher = XXHash64()
+        var total: Int64 = 0
+        while !Task.isCancelled {
+            let read: Data?
+            do {
+                read = try handle.read(upToCount: readChunk)
+            } catch {
+                return nil
+            }
+            guard let chunk = read, !chunk.isEmpty else {
+                return total == size ? hasher.digest() : nil
+            }
+            hasher.update(chunk)
+            total += Int64(chunk.count)
+            if total > size { return nil }
+        }
+        return nil
+    }
+}
@@ -7,14 +7,57 @@ import Foundation
 public struct SearchProgress {
     public let progress: Double
     public let status: String
+    /// Set on the final report when `maxResults` or `timeLimit` ended the
+    /// search before the whole tree was visited.
+    public var truncated: Bool = false
+}
+
+/// Case-insensitive substring matcher with the same rules as OrionCore's
+/// Matcher. The needle is folded once; ASCII needles are compared bytewise
+/// against the UTF-8 of each path instead of going through a locale-aware
+/// comparison.
+struct PathMatcher {
+    private let needle: [UInt8]
+    private let foldedNeedle: String
+    private let isASCII: Bool
+
+    init(_ query: String) {
+        foldedNeedle = query.lowercased()
+        needle = Array(foldedNeedle.utf8)
+        isASCII = needle.allSatisfy { $0 < 0x80 }
+    }
+
+    static func fold(_ byte: UInt8) -> UInt8 {
+        return byte >= 65 && byte <= 90 ? byte + 32 : byte
+    }
+
+    func matches(_ path: String) -> Bool {
+        if needle.isEmpty { return true }
+        if !isASCII { return path.lowercased().contains(foldedNeedle) }
+
+        var path = path
+        return path.withUTF8 { haystack in
+            guard haystack.count >= needle.count else { return false }
+            let first = needle[0]
+            for start in 0...(haystack.count - needle.count)
+            where PathMatcher.fold(haystack[start]) == first {
+                var offset = 1
+                while offset < needle.count
+                    && PathMatcher.fold(haystack[start + offset]) == needle[offset]
+                {
+                    offset += 1
+                }
+                if offset == needle.count { return true }
+            }
+            return false
+        }
+    }
 }
 
 public class FileSearcher {
     public typealias ProgressCallback = (SearchProgress) -> Void
     private var currentTask: Task<[SearchResult], Error>?
 
-    private let concurrentTasks = max(1, ProcessInfo.processInfo.processorCount - 1)
-
     public init() {}
 
     public func cancelSearch() {
@@ -22,97 +65,166 @@ public class FileSearcher {
         currentTask = nil
     }
 
-    public func search(query: String, in directory: String, progress: @escaping ProgressCallback)
+    /// Stops every pending directory task once `maxResults` matches have been
+    /// collected (0 for no limit) or `timeLimit` has passed, and returns what
+    /// was found so far. Leaves out what `ignore` excludes; nil searches
+    /// everything.
+    public func search(
+        query: String, in directory: String, maxResults: Int = 0,
+        timeLimit: TimeInterval? = nil, ignore: IgnoreSettings? = IgnoreSettings(),
+        progress: @escaping ProgressCallback
+    )
         async throws -> [SearchResult]
     {
         cancelSearch()
 
+        let directory = directory.count > 1 && directory.hasSuffix("/")
+            ? String(directory.dropLast()) : directory
+
         let task = Task<[SearchResult], Error> {
-            var results: [SearchResult] = []
             let fileManager = FileManager.default
-
-            guard let countEnumerator = fileManager.enumerator(atPath: directory) else {
+            var isRoot: ObjCBool = false
+            guard fileManager.fileExists(atPath: directory, isDirectory: &isRoot),
+                isRoot.boolValue
+            else {
                 throw NSError(
                     domain: "FileSearcher", code: 1,
                     userInfo: [NSLocalizedDescriptionKey: "Could not access directory"])
             }
 
-            var paths: [String] = []
-            var filesCounted: Double = 0
-            let chunkSize: Double = 1000
-            
-            while let path = countEnumerator.nextObject() as? String {
-                paths.append(path)
-                filesCounted += 1
-                if filesCounted.truncatingRemainder(dividingBy: chunkSize) == 0 {
-                    progress(SearchProgress(
-                        progress: 0.5 * (filesCounted / (filesCounted + chunkSize)),
-                        status: "Parsing files..."
-                    ))
-                }
+            let parsed = SearchQuery.parse(query)
+            let matcher = PathMatcher(parsed.text)
+            let plan = QueryPlan(parsed)
+            let excludes = ignore.map {
+                IgnoreRules(base: "", parent: nil, text: $0.excludes.joined(separator: "\n"))
             }
+            let rootRules = excludes?.isEmpty == false ? excludes : nil
+            let readIgnoreFiles = ignore?.ignoreFiles ?? false
+
+            // Reads one directory and matches its files right away. Returns the
+            // matches, the relative paths of its subdirectories with the rules
+            // for their entries, and the numbers of files looked at and of
+            // directories left out. The entry types come back with the listing
+            // (getattrlistbulk on Darwin, d_type elsewhere), so no entry is
+            // stat'ed on its own. Sizes and dates are only requested when a size
+            // or mtime term needs them.
+            var typeKeys: Set<URLResourceKey> = [.isDirectoryKey, .isSymbolicLinkKey]
+            if plan.needsMetadata {
+                typeKeys.formUnion([.fileSizeKey, .contentModificationDateKey])
+            }
+            typealias Scanned = ([SearchResult], [(String, IgnoreRules?)], Int, Int)
+            @Sendable func scan(_ relative: String, _ inherited: IgnoreRules?) throws -> Scanned {
+                try Task.checkCancellation()
+                let absolute = relative.isEmpty ? directory : directory + "/" + relative
+                guard
+                    let entries = try? fileManager.contentsOfDirectory(
+                        at: URL(fileURLWithPath: absolute, isDirectory: true),
+                        includingPropertiesForKeys: Array(typeKeys))
+                else {
+                    return ([], [], 0, 0)
+                }
 
-            let totalFiles = Double(paths.count)
-            let components = query.components(separatedBy: " extension:")
-            let searchQuery = components[0]
-            let fileExtension =
-                components.count > 1 ? components[1].trimmingCharacters(in: .whitespaces) : nil
-
-            let chunkCount = concurrentTasks
-            let pathChunks = stride(from: 0, to: paths.count, by: max(1, paths.count / chunkCount))
-                .map { start in
-                    let end = min(start + (paths.count / chunkCount), paths.count)
-                    return Array(paths[start..<end])
+                // A directory's own ignore files apply to its entries.
+                var rules = inherited
+                if readIgnoreFiles {
+                    let text = IgnoreSettings.fileNames
+                        .filter { name in entries.contains { $0.lastPathComponent == name } }
+                        .compactMap { try? String(contentsOfFile: absolute + "/" + $0, encoding: .utf8) }
+                        .joined(separator: "\n")
+                    let own = IgnoreRules(base: relative, parent: rules, text: text)
+                    if !own.isEmpty { rules = own }
                 }
 
-            var processed = 0
-
-            try await withThrowingTaskGroup(of: [SearchResult].self) { group in
-                for chunk in pathChunks {
-                    group.addTask {
-                        var chunkResults: [SearchResult] = []
-                        
-                        for path in chunk {
-                            try Task.checkCancellation()
-                            
-                            let fullPath = (directory as NSString).appendingPathComponent(path)
-                            var isDirectory: ObjCBool = false
-                            
-                            if fileManager.fileExists(atPath: fullPath, isDirectory: &isDirectory)
-                                && !isDirectory.boolValue
-                            {
-                                if let ext = fileExtension {
-                                    let pathExt = (path as NSString).pathExtension.lowercased()
-                                    let searchExt =
-                                        ext.hasPrefix(".")
-                                        ? String(ext.dropFirst()).lowercased() : ext.lowercased()
-                                    
-                                    if pathExt != searchExt {
-                                        continue
-                                    }
-                                }
-                                
-                                if path.localizedCaseInsensitiveContains(searchQuery) {
-                                    chunkResults.append(SearchResult(path: fullPath))
-                                }
-                            }
+                var matches: [SearchResult] = []
+                var subdirectories: [(String, IgnoreRules?)] = []
+                var files = 0
+                var skipped = 0
+                for entry in entries {
+                    guard let values = try? entry.resourceValues(forKeys: typeKeys) else {
+                        continue
+                    }
+                    let name = entry.lastPathComponent
+                    let path = relative.isEmpty ? name : relative + "/" + name
+
+                    let isDirectory = values.isDirectory == true && values.isSymbolicLink != true
+                    if let rules = rules, rules.ignored(path, directory: isDirectory) {
+                        if isDirectory { skipped += 1 }
+                        continue
+                    }
+                    if isDirectory {
+                        subdirectories.append((path, rules))
+                        continue
+                    }
+                    files += 1
+                    guard plan.matchesName(name), matcher.matches(path), plan.matchesPath(path)
+                    else {
+                        continue
+                    }
+                    if plan.needsMetadata {
+                        let modified = values.contentModificationDate?.timeIntervalSince1970 ?? 0
+                        guard
+                            plan.matchesMetadata(
+                                size: Int64(values.fileSize ?? 0), modifiedNs: Int64(modified * 1e9))
+                        else {
+                            continue
                         }
-                        
-                        return chunkResults
                     }
+                    matches.append(SearchResult(path: entry.path))
                 }
-                
-                for try await chunkResults in group {
-                    results.append(contentsOf: chunkResults)
-                    processed += chunkResults.count
-                    progress(SearchProgress(
-                        progress: 0.5 + 0.5 * (Double(processed) / totalFiles),
-                        status: "Searching files..."
-                    ))
+                return (matches, subdirectories, files, skipped)
+            }
+
+            // Every directory is its own child task, so the runtime's thread pool
+            // balances skewed trees instead of fixed chunks of a flat path list.
+            // Progress counts directories and files visited, never results, and
+            // is reported at most once per display frame.
+            let reportInterval: TimeInterval = 1.0 / 60.0
+            var results: [SearchResult] = []
+            var done = 0
+            var pending = 1
+            var filesSeen = 0
+            var directoriesSkipped = 0
+            var lastReport = Date.distantPast
+            var truncated = false
+            let deadline = timeLimit.map { Date().addingTimeInterval($0) }
+            try await withThrowingTaskGroup(of: Scanned.self) { group in
+                group.addTask { try scan("", rootRules) }
+                for try await (matches, subdirectories, files, skipped) in group {
+                    results.append(contentsOf: matches)
+                    if maxResults > 0 && results.count >= maxResults {
+                        results.removeSubrange(maxResults...)
+                        truncated = true
+                    } else if let deadline = deadline, Date() >= deadline {
+                        truncated = true
+                    }
+                    if truncated {
+                        group.cancelAll()
+                        break
+                    }
+                    for (subdirectory, rules) in subdirectories {
+                        group.addTask { try scan(subdirectory, rules) }
+                    }
+                    done += 1
+                    pending += subdirectories.count - 1
+                    filesSeen += files
+                    directoriesSkipped += skipped
+                    let now = Date()
+                    if now.timeIntervalSince(lastReport) >= reportInterval {
+                        lastReport = now
+                        progress(SearchProgress(
+                            progress: Double(done) / Double(done + pending + 1),
+                            status: "\(filesSeen) files, \(results.count) matches, "
+                                + "\(pending) folders pending"
+                        ))
+                    }
                 }
             }
 
-            progress(SearchProgress(progress: 1.0, status: "Search complete"))
+            var status = truncated ? "Showing the first \(results.count) matches" : "Search complete"
+            if directoriesSkipped > 0 {
+                status += ", \(directoriesSkipped) folders skipped"
+            }
+            progress(SearchProgress(progress: 1.0, status: status, truncated: truncated))
             return results
         }
 
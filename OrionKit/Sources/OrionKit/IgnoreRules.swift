@@ -0,0 +1,208 @@
+import Foundation
+
+/// What a search leaves out, as in OrionCore's IgnoreSettings. Excluded
+/// directories are never listed, so their subtrees cost nothing.
+public struct IgnoreSettings: Equatable {
+    /// Version control metadata and dependency or build caches.
+    public static let defaultExcludes = [
+        ".git/", ".hg/", ".svn/", "node_modules/", ".build/", "__pycache__/",
+    ]
+    static let fileNames = [".gitignore", ".orionignore"]
+
+    /// Honour .gitignore and .orionignore files found along the walk.
+    public var ignoreFiles = true
+    /// Gitignore patterns for the whole tree; ignore files take precedence.
+    public var excludes = IgnoreSettings.defaultExcludes
+
+    public init(ignoreFiles: Bool = true, excludes: [String] = IgnoreSettings.defaultExcludes) {
+        self.ignoreFiles = ignoreFiles
+        self.excludes = excludes
+    }
+}
+
+/// The patterns of one ignore file chained to those of the directories above,
+/// with OrionCore's IgnoreRules semantics: gitignore syntax, the last
+/// matching pattern wins, case-sensitive.
+final class IgnoreRules: Sendable {
+    private enum Kind { case literal, suffix, glob }
+
+    private struct Rule: Sendable {
+        var kind = Kind.glob
+        var negated = false
+        var directoryOnly = false
+        var anchored = false
+        var pattern: [UInt8] = []
+
+        func matches(_ text: ArraySlice<UInt8>) -> Bool {
+            switch kind {
+            case .literal:
+                return text.elementsEqual(pattern)
+            case .suffix:
+                return text.count >= pattern.count && text.suffix(pattern.count).elementsEqual(pattern)
+            case .glob:
+                return ignoreGlobMatches(pattern[...], text)
+            }
+        }
+    }
+
+    /// The directory the patterns apply to, relative to the search root.
+    private let base: String
+    private let parent: IgnoreRules?
+    private let rules: [Rule]
+
+    var isEmpty: Bool { rules.isEmpty }
+
+    init(base: String, parent: IgnoreRules?, text: String) {
+        self.base = base
+        self.parent = parent
+        rules = text.split(whereSeparator: \.isNewline).compactMap(IgnoreRules.parse)
+    }
+
+    private static func parse(_ text: Substring) -> Rule? {
+        var line = Array(text.utf8)[...]
+        while line.last == UInt8(ascii: " ")
+            && !(line.count >= 2 && line[line.endIndex - 2] == UInt8(ascii: "\\"))
+        {
+            line = line.dropLast()
+        }
+        guard let first = line.first, first != UInt8(ascii: "#") else { return nil }
+
+        var rule = Rule()
+        if first == UInt8(ascii: "!") {
+            rule.negated = true
+            line = line.dropFirst()
+        } else if first == UInt8(ascii: "\\") && line.count >= 2
+            && (line[line.startIndex + 1] == UInt8(ascii: "!")
+                || line[line.startIndex + 1] == UInt8(ascii: "#"))
+        {
+            line = line.dropFirst()
+        }
+        if line.last == UInt8(ascii: "/") {
+            rule.directoryOnly = true
+            line = line.dropLast()
+        }
+        // "**/name" is the same as "name": any depth.
+        if line.count > 3 && line.starts(with: Array("**/".utf8))
+            && !line.dropFirst(3).contains(UInt8(ascii: "/"))
+        {
+            line = line.dropFirst(3)
+        }
+        rule.anchored = line.contains(UInt8(ascii: "/"))
+        if line.first == UInt8(ascii: "/") { line = line.dropFirst() }
+        guard !line.isEmpty else { return nil }
+
+        if !hasWildcard(line) {
+            rule.kind = .literal
+        } else if !rule.anchored && line.first == UInt8(ascii: "*") && !hasWildcard(line.dropFirst()) {
+            rule.kind = .suffix
+            line = line.dropFirst()
+        }
+        rule.pattern = Array(line)
+        return rule
+    }
+
+    /// `relative` is the entry's path below the search root, inside `base`.
+    func ignored(_ relative: String, directory: Bool) -> Bool {
+        let path = Array(relative.utf8)
+        var level: IgnoreRules? = self
+        while let rules = level {
+            let local = path.dropFirst(rules.base.isEmpty ? 0 : rules.base.utf8.count + 1)
+            let name = local.lastIndex(of: UInt8(ascii: "/")).map { local[($0 + 1)...] } ?? local
+            for rule in rules.rules.reversed() where !rule.directoryOnly || directory {
+                if rule.matches(rule.anchored ? local : name) { return !rule.negated }
+            }
+            level = rules.parent
+        }
+        return false
+    }
+}
+
+private func hasWildcard(_ text: ArraySlice<UInt8>) -> Bool {
+    text.contains { $0 == UInt8(ascii: "*") || $0 == UInt8(ascii: "?") || $0 == UInt8(ascii: "[")
+        || $0 == UInt8(ascii: "\\") }
+}
+
+/// '*' and '?' stop at '/', "**/" spans whole directories and a trailing
+/// "**" everything left.
+private func ignoreGlobMatches(_ pattern: ArraySlice<UInt8>, _ text: ArraySlice<UInt8>) -> Bool {
+    let slash = UInt8(ascii: "/")
+    var p = pattern.startIndex
+    var t = text.startIndex
+    while p < pattern.endIndex {
+        let c = pattern[p]
+        if c == UInt8(ascii: "*") {
+            let stars = p
+            while p < pattern.endIndex && pattern[p] == UInt8(ascii: "*") { p += 1 }
+            if p - stars >= 2 && (stars == pattern.startIndex || pattern[stars - 1] == slash) {
+                if p == pattern.endIndex { return true }
+                if pattern[p] == slash {
+                    let rest = pattern[(p + 1)...]
+                    if ignoreGlobMatches(rest, text[t...]) { return true }
+                    for k in t..<text.endIndex where text[k] == slash {
+                        if ignoreGlobMatches(rest, text[(k + 1)...]) { return true }
+                    }
+                    return false
+                }
+            }
+            let rest = pattern[p...]
+            var k = t
+            while true {
+                if ignoreGlobMatches(rest, text[k...]) { return true }
+                if k >= text.endIndex || text[k] == slash { return false }
+                k += 1
+            }
+        }
+        guard t < text.endIndex else { return false }
+        if c == UInt8(ascii: "?") {
+            if text[t] == slash { return false }
+            p += 1
+            t += 1
+            continue
+        }
+        if c == UInt8(ascii: "["), let set = classMatches(pattern, p, text[t]) {
+            guard set.inClass else { return false }
+            p = set.next
+            t += 1
+            continue
+        }
+        let literal = c == UInt8(ascii: "\\") && p + 1 < pattern.endIndex ? p + 1 : p
+        if pattern[literal] != text[t] { return false }
+        p = literal + 1
+        t += 1
+    }
+    return t == text.endIndex
+}
+
+/// Matches `c` against the class opening at pattern[start]; nil if the class
+/// is never closed.
+private func classMatches(_ pattern: ArraySlice<UInt8>, _ start: Int, _ c: UInt8) -> (
+    inClass: Bool, next: Int
+)? {
+    var i = start + 1
+    var invert = false
+    if i < pattern.endIndex && (pattern[i] == UInt8(ascii: "!") || pattern[i] == UInt8(ascii: "^")) {
+        invert = true
+        i += 1
+    }
+    var found = false
+    var first = true
+    while i < pattern.endIndex && (pattern[i] != UInt8(ascii: "]") || first) {
+        first = false
+        var low = pattern[i]
+        if low == UInt8(ascii: "\\") && i + 1 < pattern.endIndex {
+            i += 1
+            low = pattern[i]
+        }
+        if i + 2 < pattern.endIndex && pattern[i + 1] == UInt8(ascii: "-")
+            && pattern[i + 2] != UInt8(ascii: "]")
+        {
+            found = found || (c >= low && c <= pattern[i + 2])
+            i += 3
+        } else {
+            found = found || c == low
+            i += 1
+        }
+    }
+    guard i < pattern.endIndex else { return nil }
+    return (found != invert && c != UInt8(ascii: "/"), i + 1)
+}
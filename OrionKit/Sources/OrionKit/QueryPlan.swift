@@ -0,0 +1,394 @@
+import Foundation
+
+/// One filter of a query, as in OrionCore's QueryTerm. Terms are ANDed; a
+/// negated term excludes what it matches. Sizes are in bytes and times in
+/// nanoseconds since the epoch, both as an inclusive `min...max`.
+struct QueryTerm {
+    enum Kind { case text, glob, regex, extensions, size, modifiedTime }
+    enum Scope { case path, name }
+
+    var kind: Kind = .text
+    var scope: Scope = .path
+    var negated = false
+    var pattern = ""
+    var regex: NSRegularExpression? = nil
+    /// Lowercased, without the leading dot.
+    var extensions: [String] = []
+    var min = Int64.min
+    var max = Int64.max
+}
+
+/// The query language of OrionCore's SearchQuery::parse, e.g.
+/// "report -draft ext:pdf,doc size:>1m mtime:<7d". `text` is the first
+/// plain word; every other filter is in `terms`.
+struct SearchQuery {
+    var text = ""
+    var terms: [QueryTerm] = []
+
+    static func parse(_ query: String, now: Date = Date()) -> SearchQuery {
+        var result = SearchQuery()
+        let nowNs = Int64(now.timeIntervalSince1970 * 1e9)
+        for token in tokenize(query) {
+            var term = QueryTerm()
+            var text = Substring(token.text)
+            if !token.literal && text.count > 1 && (text.first == "-" || text.first == "!") {
+                term.negated = true
+                text = text.dropFirst()
+            }
+
+            let colon = token.literal ? nil : text.firstIndex(of: ":")
+            let key = colon.map { text[..<$0].lowercased() } ?? ""
+            let value = colon.map { text[text.index(after: $0)...] } ?? text
+            var parsed = true
+            switch key {
+            case "ext", "extension":
+                term.kind = .extensions
+                term.extensions = value.split(separator: ",")
+                    .map { String($0.drop(while: { $0 == "." })).lowercased() }
+                    .filter { !$0.isEmpty }
+                if term.extensions.isEmpty { continue }
+            case "name", "path":
+                if value.isEmpty { continue }
+                term.kind = isGlob(value) ? .glob : .text
+                term.scope = key == "name" ? .name : .path
+                term.pattern = String(value)
+            case "regex", "re":
+                term.kind = .regex
+                term.pattern = String(value)
+                term.regex = try? NSRegularExpression(
+                    pattern: term.pattern, options: [.caseInsensitive])
+                parsed = term.regex != nil
+            case "size":
+                term.kind = .size
+                parsed = parseRange(value, point: parseSize, lower: &term.min, upper: &term.max)
+            case "mtime", "modified":
+                term.kind = .modifiedTime
+                var instant = false
+                parsed = parseRange(
+                    value, point: { parseTime($0, nowNs: nowNs, instant: &instant) },
+                    lower: &term.min, upper: &term.max)
+                // A bare age means "within the last ...".
+                if parsed && instant && value.first != "<" && value.first != ">"
+                    && !value.contains("..")
+                {
+                    term.max = .max
+                }
+            default:
+                parsed = false
+            }
+
+            if !parsed {
+                term.kind = .text
+                term.scope = .path
+                term.regex = nil
+                term.pattern = String(text)
+                if !token.literal && isGlob(text) {
+                    term.kind = .glob
+                    if !text.contains("/") { term.scope = .name }
+                }
+            }
+
+            if term.kind == .text && term.scope == .path && !term.negated && result.text.isEmpty {
+                result.text = term.pattern
+                continue
+            }
+            result.terms.append(term)
+        }
+        return result
+    }
+}
+
+/// The terms of a query grouped by what they need, as in OrionCore's
+/// QueryPlan: the name, then the path below the root, then the metadata.
+/// The query text is left to PathMatcher.
+struct QueryPlan {
+    private struct Check {
+        let term: QueryTerm
+        let matcher: PathMatcher
+        let glob: [UInt8]
+
+        func test(_ text: String) -> Bool {
+            switch term.kind {
+            case .text:
+                return matcher.matches(text)
+            case .glob:
+                return globMatches(glob, text)
+            case .regex:
+                let range = NSRange(text.startIndex..., in: text)
+                return term.regex?.firstMatch(in: text, range: range) != nil
+            case .extensions:
+                guard let dot = text.lastIndex(of: "."), dot != text.startIndex else {
+                    return false
+                }
+                return term.extensions.contains(text[text.index(after: dot)...].lowercased())
+            case .size, .modifiedTime:
+                return true
+            }
+        }
+    }
+
+    private var nameChecks: [Check] = []
+    private var pathChecks: [Check] = []
+    private var metadataChecks: [Check] = []
+
+    init(_ query: SearchQuery) {
+        for term in query.terms {
+            let check = Check(
+                term: term, matcher: PathMatcher(term.kind == .text ? term.pattern : ""),
+                glob: term.kind == .glob ? Array(term.pattern.lowercased().utf8) : [])
+            switch term.kind {
+            case .extensions:
+                nameChecks.insert(check, at: 0)
+            case .text, .glob, .regex:
+                if term.scope == .name {
+                    nameChecks.append(check)
+                } else {
+                    pathChecks.append(check)
+                }
+            case .size, .modifiedTime:
+                metadataChecks.append(check)
+            }
+        }
+    }
+
+    var needsMetadata: Bool { !metadataChecks.isEmpty }
+
+    func matchesName(_ name: String) -> Bool {
+        nameChecks.allSatisfy { $0.test(name) != $0.term.negated }
+    }
+
+    func matchesPath(_ relative: String) -> Bool {
+        pathChecks.allSatisfy { $0.test(relative) != $0.term.negated }
+    }
+
+    func matchesMetadata(size: Int64, modifiedNs: Int64) -> Bool {
+        metadataChecks.allSatisfy { check in
+            let value = check.term.kind == .size ? size : modifiedNs
+            return (value >= check.term.min && value <= check.term.max) != check.term.negated
+        }
+    }
+}
+
+private func tokenize(_ query: String) -> [(text: String, literal: Bool)] {
+    var tokens: [(text: String, literal: Bool)] = []
+    var current = ""
+    var literal = false
+    var inToken = false
+    var quoted = false
+    var escaped = false
+    for c in query {
+        if quoted && escaped {
+            escaped = false
+            if c == "\"" || c == "\\" {
+                current.append(c)
+                continue
+            }
+            current.append("\\")
+        }
+        if quoted && c == "\\" {
+            escaped = true
+            continue
+        }
+        if c == "\"" {
+            if !inToken {
+                inToken = true
+                literal = true
+            }
+            quoted.toggle()
+            continue
+        }
+        if !quoted && (c == " " || c == "\t") {
+            if inToken && !current.isEmpty { tokens.append((current, literal)) }
+            current = ""
+            literal = false
+            inToken = false
+            continue
+        }
+        inToken = true
+        current.append(c)
+    }
+    if escaped { current.append("\\") }
+    if inToken && !current.isEmpty { tokens.append((current, literal)) }
+    return tokens
+}
+
+private func isGlob(_ text: Substring) -> Bool {
+    text.contains { $0 == "*" || $0 == "?" || $0 == "[" }
+}
+
+/// "10", "1.5m", "2gb" as the half-open range of that one byte count.
+private func parseSize(_ value: Substring) -> (Int64, Int64)? {
+    let digits = value.prefix { $0.isASCII && ($0.isNumber || $0 == ".") }
+    guard !digits.isEmpty, let number = Double(digits) else { return nil }
+    let factor: Double
+    switch value.dropFirst(digits.count).lowercased() {
+    case "", "b": factor = 1
+    case "k", "kb": factor = 1024
+    case "m", "mb": factor = 1024 * 1024
+    case "g", "gb": factor = 1024 * 1024 * 1024
+    case "t", "tb": factor = 1024 * 1024 * 1024 * 1024
+    default: return nil
+    }
+    let bytes = number * factor
+    guard bytes >= 0, bytes < 9e18 else { return nil }
+    let begin = Int64(bytes.rounded())
+    return (begin, begin + 1)
+}
+
+/// "2024-01-31" is that day in local time; "7d" (or s, m, h, w, y) is the
+/// instant that long before now, and sets `instant`.
+private func parseTime(_ value: Substring, nowNs: Int64, instant: inout Bool) -> (Int64, Int64)? {
+    let parts = value.split(separator: "-", omittingEmptySubsequences: false)
+    if parts.count == 3, let year = Int(parts[0]), let month = Int(parts[1]),
+        let day = Int(parts[2])
+    {
+        let calendar = Calendar.current
+        guard
+            let first = calendar.date(from: DateComponents(year: year, month: month, day: day)),
+            let next = calendar.date(byAdding: .day, value: 1, to: first)
+        else { return nil }
+        instant = false
+        return (Int64(first.timeIntervalSince1970 * 1e9), Int64(next.timeIntervalSince1970 * 1e9))
+    }
+
+    guard value.count >= 2, let unit = value.last, let count = Int64(value.dropLast()) else {
+        return nil
+    }
+    let seconds: Int64
+    switch unit {
+    case "s": seconds = 1
+    case "m": seconds = 60
+    case "h": seconds = 3600
+    case "d": seconds = 86400
+    case "w": seconds = 7 * 86400
+    case "y": seconds = 365 * 86400
+    default: return nil
+    }
+    guard count >= 0, count <= Int64.max / 1_000_000_000 / seconds else { return nil }
+    let begin = nowNs - count * seconds * 1_000_000_000
+    instant = true
+    return (begin, begin + 1)
+}
+
+/// Turns "<X", "<=X", ">X", ">=X", "A..B" or "X" into an inclusive range, with
+/// `point` parsing each X into the half-open span it stands for.
+private func parseRange(
+    _ value: Substring, point: (Substring) -> (Int64, Int64)?, lower: inout Int64,
+    upper: inout Int64
+) -> Bool {
+    if value.hasPrefix(">=") {
+        guard let span = point(value.dropFirst(2)) else { return false }
+        lower = span.0
+    } else if value.hasPrefix(">") {
+        guard let span = point(value.dropFirst()) else { return false }
+        lower = span.1
+    } else if value.hasPrefix("<=") {
+        guard let span = point(value.dropFirst(2)) else { return false }
+        upper = span.1 - 1
+    } else if value.hasPrefix("<") {
+        guard let span = point(value.dropFirst()) else { return false }
+        upper = span.0 - 1
+    } else if let dots = value.range(of: "..") {
+        let low = value[..<dots.lowerBound]
+        let high = value[dots.upperBound...]
+        if low.isEmpty && high.isEmpty { return false }
+        if !low.isEmpty {
+            guard let span = point(low) else { return false }
+            lower = span.0
+        }
+        if !high.isEmpty {
+            guard let span = point(high) else { return false }
+            upper = span.1 - 1
+        }
+    } else {
+        guard let span = point(value) else { return false }
+        lower = span.0
+        upper = span.1 - 1
+    }
+    return true
+}
+
+/// Same rules as OrionCore's glob_matches; `pattern` is the lowercased UTF-8
+/// of the glob.
+func globMatches(_ pattern: [UInt8], _ text: String) -> Bool {
+    var text = text
+    if !text.utf8.allSatisfy({ $0 < 0x80 }) { text = text.lowercased() }
+    return text.withUTF8 { globMatch(pattern, $0) }
+}
+
+private func globMatch(_ pattern: [UInt8], _ text: UnsafeBufferPointer<UInt8>) -> Bool {
+    var p = 0
+    var t = 0
+    var star: Int? = nil
+    var starText = 0
+    while t < text.count {
+        if p < pattern.count {
+            let c = PathMatcher.fold(text[t])
+            switch pattern[p] {
+            case UInt8(ascii: "*"):
+                p += 1
+                star = p
+                starText = t
+                continue
+            case UInt8(ascii: "?"):
+                p += 1
+                t += 1
+                while t < text.count && text[t] & 0xC0 == 0x80 { t += 1 }
+                continue
+            case UInt8(ascii: "["):
+                if let set = setMatches(pattern, p, c) {
+                    if set.inSet {
+                        p = set.next
+                        t += 1
+                        continue
+                    }
+                } else if c == UInt8(ascii: "[") {
+                    p += 1
+                    t += 1
+                    continue
+                }
+            default:
+                let literal = pattern[p] == UInt8(ascii: "\\") && p + 1 < pattern.count ? p + 1 : p
+                if pattern[literal] == c {
+                    p = literal + 1
+                    t += 1
+                    continue
+                }
+            }
+        }
+        guard let restart = star else { return false }
+        p = restart
+        starText += 1
+        t = starText
+    }
+    while p < pattern.count && pattern[p] == UInt8(ascii: "*") { p += 1 }
+    return p == pattern.count
+}
+
+/// Matches `c` against the set opening at pattern[start]; nil if the set is
+/// never closed.
+private func setMatches(_ pattern: [UInt8], _ start: Int, _ c: UInt8) -> (inSet: Bool, next: Int)? {
+    var i = start + 1
+    var invert = false
+    if i < pattern.count && (pattern[i] == UInt8(ascii: "!") || pattern[i] == UInt8(ascii: "^")) {
+        invert = true
+        i += 1
+    }
+    var found = false
+    var first = true
+    while i < pattern.count && (pattern[i] != UInt8(ascii: "]") || first) {
+        first = false
+        let low = pattern[i]
+        if i + 2 < pattern.count && pattern[i + 1] == UInt8(ascii: "-")
+            && pattern[i + 2] != UInt8(ascii: "]")
+        {
+            found = found || (c >= low && c <= pattern[i + 2])
+            i += 3
+        } else {
+            found = found || c == low
+            i += 1
+        }
+    }
+    guard i < pattern.count else { return nil }
+    return (found != invert, i + 1)
+}
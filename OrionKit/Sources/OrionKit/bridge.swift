@@ -6,6 +6,9 @@ import Foundation
 #else
     public struct CSearchResult {
         public let path: UnsafePointer<CChar>
+        public let length: Int32
+        public let match_count: Int32
+        public let score: Int32
     }
 
     public struct CSearchResults {
@@ -54,32 +57,47 @@ public func orion_search_files(
 
     semaphore.wait()
 
-    guard let results = searchResults else {
-        let results = UnsafeMutablePointer<orion_search_results_t>.allocate(capacity: 1)
-        results.pointee.results = nil
-        results.pointee.count = 0
-        return results
-    }
+    return makeResults(searchResults ?? [])
+}
+
+/// Lays the results out like OrionCore does: one malloc holding the header,
+/// the result table and an arena of NUL-terminated paths, so
+/// orion_free_search_results is a single free. Nil if that allocation fails.
+private func makeResults(_ results: [SearchResult]) -> UnsafeMutablePointer<orion_search_results_t>? {
+    let alignment = MemoryLayout<orion_search_result_t>.alignment
+    let tableOffset =
+        (MemoryLayout<orion_search_results_t>.stride + alignment - 1) / alignment * alignment
+    let arenaOffset = tableOffset + MemoryLayout<orion_search_result_t>.stride * results.count
+    let arenaSize = results.reduce(0) { $0 + $1.path.utf8.count + 1 }
+
+    guard let block = malloc(max(arenaOffset + arenaSize, 1)) else { return nil }
+    let header = block.bindMemory(to: orion_search_results_t.self, capacity: 1)
+    let table = (block + tableOffset).bindMemory(
+        to: orion_search_result_t.self, capacity: results.count)
+    var cursor = (block + arenaOffset).bindMemory(to: CChar.self, capacity: arenaSize)
 
-    let cResults = UnsafeMutablePointer<orion_search_result_t>.allocate(capacity: results.count)
     for (i, result) in results.enumerated() {
-        let cPath = strdup(result.path)
-        cResults[i] = orion_search_result_t(path: cPath)
+        var path = result.path
+        let length = path.withUTF8 { bytes -> Int in
+            if let base = bytes.baseAddress {
+                memcpy(cursor, base, bytes.count)
+            }
+            return bytes.count
+        }
+        cursor[length] = 0
+        table[i] = orion_search_result_t(
+            path: cursor, length: Int32(length), match_count: 0, score: 0)
+        cursor += length + 1
     }
 
-    let finalResults = UnsafeMutablePointer<orion_search_results_t>.allocate(capacity: 1)
-    finalResults.pointee.results = cResults
-    finalResults.pointee.count = Int32(results.count)
-    return finalResults
+    header.pointee.results = results.isEmpty ? nil : table
+    header.pointee.count = Int32(results.count)
+    return header
 }
 
 @_cdecl("orion_free_search_results")
 public func orion_free_search_results(_ results: UnsafeMutablePointer<orion_search_results_t>) {
-    for i in 0..<Int(results.pointee.count) {
-        free(UnsafeMutablePointer(mutating: results.pointee.results[i].path))
-    }
-    results.pointee.results.deallocate()
-    results.deallocate()
+    free(results)
 }
 
 @_cdecl("orion_open_in_finder")
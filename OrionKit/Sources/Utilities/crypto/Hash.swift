@@ -1,5 +1,113 @@
 import Foundation
 
-public func hash(into hasher: inout Hasher) {
-    hasher.combine(id)
+/// 64-bit xxHash (XXH64) of a byte stream fed in pieces of any size; the
+/// same digest as OrionCore's ContentHash. Fast and well distributed, but
+/// not meant to resist anyone crafting collisions.
+public struct XXHash64 {
+    private static let prime1: UInt64 = 0x9E37_79B1_85EB_CA87
+    private static let prime2: UInt64 = 0xC2B2_AE3D_27D4_EB4F
+    private static let prime3: UInt64 = 0x1656_67B1_9E37_79F9
+    private static let prime4: UInt64 = 0x85EB_CA77_C2B2_AE63
+    private static let prime5: UInt64 = 0x27D4_EB2F_1656_67C5
+
+    private var lanes: [UInt64]
+    private let seed: UInt64
+    private var total: UInt64 = 0
+    private var pending: [UInt8] = []
+
+    public init(seed: UInt64 = 0) {
+        self.seed = seed
+        lanes = [
+            seed &+ XXHash64.prime1 &+ XXHash64.prime2, seed &+ XXHash64.prime2, seed,
+            seed &- XXHash64.prime1,
+        ]
+    }
+
+    public static func hash(_ data: Data, seed: UInt64 = 0) -> UInt64 {
+        var hasher = XXHash64(seed: seed)
+        hasher.update(data)
+        return hasher.digest()
+    }
+
+    public mutating func update(_ data: Data) {
+        data.withUnsafeBytes { update($0) }
+    }
+
+    public mutating func update(_ bytes: UnsafeRawBufferPointer) {
+        total &+= UInt64(bytes.count)
+        var offset = 0
+        if !pending.isEmpty {
+            let fill = min(32 - pending.count, bytes.count)
+            pending.append(contentsOf: bytes[0..<fill])
+            offset = fill
+            guard pending.count == 32 else { return }
+            pending.withUnsafeBytes { consume($0, at: 0) }
+            pending.removeAll(keepingCapacity: true)
+        }
+        while bytes.count - offset >= 32 {
+            consume(bytes, at: offset)
+            offset += 32
+        }
+        pending.append(contentsOf: bytes[offset...])
+    }
+
+    public func digest() -> UInt64 {
+        var hash: UInt64
+        if total >= 32 {
+            hash = rotate(lanes[0], 1) &+ rotate(lanes[1], 7) &+ rotate(lanes[2], 12)
+                &+ rotate(lanes[3], 18)
+            for lane in lanes {
+                hash ^= XXHash64.accumulate(0, lane)
+                hash = hash &* XXHash64.prime1 &+ XXHash64.prime4
+            }
+        } else {
+            hash = seed &+ XXHash64.prime5
+        }
+        hash &+= total
+
+        pending.withUnsafeBytes { tail in
+            var offset = 0
+            while tail.count - offset >= 8 {
+                hash ^= XXHash64.accumulate(0, load64(tail, offset))
+                hash = rotate(hash, 27) &* XXHash64.prime1 &+ XXHash64.prime4
+                offset += 8
+            }
+            if tail.count - offset >= 4 {
+                let word = UInt32(
+                    littleEndian: tail.loadUnaligned(fromByteOffset: offset, as: UInt32.self))
+                hash ^= UInt64(word) &* XXHash64.prime1
+                hash = rotate(hash, 23) &* XXHash64.prime2 &+ XXHash64.prime3
+                offset += 4
+            }
+            while offset < tail.count {
+                hash ^= UInt64(tail[offset]) &* XXHash64.prime5
+                hash = rotate(hash, 11) &* XXHash64.prime1
+                offset += 1
+            }
+        }
+        hash ^= hash >> 33
+        hash = hash &* XXHash64.prime2
+        hash ^= hash >> 29
+        hash = hash &* XXHash64.prime3
+        hash ^= hash >> 32
+        return hash
+    }
+
+    private mutating func consume(_ bytes: UnsafeRawBufferPointer, at offset: Int) {
+        for lane in 0..<4 {
+            lanes[lane] = XXHash64.accumulate(lanes[lane], load64(bytes, offset + lane * 8))
+        }
+    }
+
+    private static func accumulate(_ lane: UInt64, _ input: UInt64) -> UInt64 {
+        rotate(lane &+ input &* prime2, 31) &* prime1
+    }
+}
+
+private func rotate(_ value: UInt64, _ bits: UInt64) -> UInt64 {
+    (value << bits) | (value >> (64 - bits))
+}
+
+private func load64(_ bytes: UnsafeRawBufferPointer, _ offset: Int) -> UInt64 {
+    UInt64(littleEndian: bytes.loadUnaligned(fromByteOffset: offset, as: UInt64.self))
 }
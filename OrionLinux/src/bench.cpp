@@ -0,0 +1,371 @@
+#include "bridge.h"
+#include "search_engine.hpp"
+#include "walker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <getopt.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct TreeSpec {
+  unsigned depth = 4;
+  unsigned fanout = 6;
+  unsigned files = 20;
+  unsigned min_name = 6;
+  unsigned max_name = 16;
+  // Extension and weight pairs, e.g. "c:4,h:3,txt:2,md:1".
+  std::string extensions = "c:4,h:3,txt:2,md:1";
+  uint64_t seed = 1;
+};
+
+struct TreeStats {
+  uint64_t files = 0;
+  uint64_t directories = 0;
+};
+
+// splitmix64, so a seed yields the same tree with every standard library.
+struct Random {
+  uint64_t state;
+  uint64_t next() {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+  unsigned below(unsigned bound) { return static_cast<unsigned>(next() % bound); }
+};
+
+struct Extension {
+  std::string name;
+  unsigned weight;
+};
+
+std::vector<Extension> parse_extensions(const std::string &spec) {
+  std::vector<Extension> extensions;
+  size_t start = 0;
+  while (start < spec.size()) {
+    size_t end = spec.find(',', start);
+    if (end == std::string::npos) end = spec.size();
+    std::string item = spec.substr(start, end - start);
+    size_t colon = item.find(':');
+    Extension extension{item.substr(0, colon), 1};
+    if (colon != std::string::npos) {
+      extension.weight =
+          static_cast<unsigned>(std::max(1L, strtol(item.c_str() + colon + 1, nullptr, 10)));
+    }
+    if (!extension.name.empty()) {
+      extensions.push_back(extension);
+    }
+    start = end + 1;
+  }
+  return extensions;
+}
+
+class TreeGenerator {
+public:
+  TreeGenerator(const TreeSpec &spec)
+      : spec(spec), random{spec.seed}, extensions(parse_extensions(spec.extensions)) {
+    for (const Extension &extension : extensions) {
+      total_weight += extension.weight;
+    }
+  }
+
+  bool generate(const std::string &root, TreeStats &stats) {
+    return populate(root, 0, stats);
+  }
+
+private:
+  const TreeSpec &spec;
+  Random random;
+  std::vector<Extension> extensions;
+  unsigned total_weight = 0;
+
+  // Random letters and digits, made unique within the directory by the index.
+  std::string make_name(unsigned index) {
+    static const char kAlphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_-";
+    unsigned length = spec.min_name + random.below(spec.max_name - spec.min_name + 1);
+    std::string name;
+    for (unsigned i = 0; i < length; i++) {
+      name += kAlphabet[random.below(sizeof(kAlphabet) - 1)];
+    }
+    name += '_';
+    name += std::to_string(index);
+    return name;
+  }
+
+  const std::string &pick_extension() {
+    unsigned roll = random.below(total_weight);
+    for (const Extension &extension : extensions) {
+      if (roll < extension.weight) return extension.name;
+      roll -= extension.weight;
+    }
+    return extensions.back().name;
+  }
+
+  bool populate(const std::string &directory, unsigned depth, TreeStats &stats) {
+    for (unsigned i = 0; i < spec.files; i++) {
+      std::string path = directory + "/" + make_name(i);
+      if (!extensions.empty()) {
+        path += "." + pick_extension();
+      }
+      int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+      if (fd < 0) return false;
+      close(fd);
+      stats.files++;
+    }
+    if (depth >= spec.depth) return true;
+    for (unsigned i = 0; i < spec.fanout; i++) {
+      std::string path = directory + "/" + make_name(i);
+      if (mkdir(path.c_str(), 0755) != 0) return false;
+      stats.directories++;
+      if (!populate(path, depth + 1, stats)) return false;
+    }
+    return true;
+  }
+};
+
+// Needs root; without it only warm numbers are reported.
+bool drop_caches() {
+  sync();
+  int fd = open("/proc/sys/vm/drop_caches", O_WRONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  bool dropped = write(fd, "2", 1) == 1;
+  close(fd);
+  return dropped;
+}
+
+struct Result {
+  std::string name;
+  std::vector<double> samples_ms;
+  uint64_t results = 0;
+};
+
+double percentile(std::vector<double> samples, double fraction) {
+  if (samples.empty()) return 0.0;
+  std::sort(samples.begin(), samples.end());
+  size_t rank = static_cast<size_t>(fraction * static_cast<double>(samples.size()) + 0.5);
+  return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+std::string json_string(const std::string &text) {
+  std::string out = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+// Times `run`, which returns the number of results. Warm runs are preceded by
+// one untimed run; cold ones drop the page cache before every run.
+template <typename Run>
+Result measure(const std::string &name, unsigned iterations, bool cold, Run &&run) {
+  Result result{name, {}, 0};
+  if (!cold) {
+    run();
+  }
+  for (unsigned i = 0; i < iterations; i++) {
+    if (cold && !drop_caches()) break;
+    auto started = std::chrono::steady_clock::now();
+    result.results = run();
+    result.samples_ms.push_back(std::chrono::duration<double, std::milli>(
+                                    std::chrono::steady_clock::now() - started)
+                                    .count());
+  }
+  return result;
+}
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "\n"
+          "Generates a synthetic tree, times the engine on it and prints JSON.\n"
+          "\n"
+          "Options:\n"
+          "  --root DIR           generate the tree in DIR (default: a temporary directory)\n"
+          "  --keep               do not delete the generated tree\n"
+          "  --depth N            directory levels below the root (default 4)\n"
+          "  --fanout N           subdirectories per directory (default 6)\n"
+          "  --files N            files per directory (default 20)\n"
+          "  --name-length MIN-MAX  random part of each name (default 6-16)\n"
+          "  --extensions LIST    extension:weight pairs (default c:4,h:3,txt:2,md:1)\n"
+          "  --seed N             generator seed (default 1)\n"
+          "  --query TEXT         name query to time (default \"ab\")\n"
+          "  --iterations N       timed runs per benchmark (default 20)\n"
+          "  --threads N          engine threads (default: all cores)\n",
+          program);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  enum {
+    kRoot = 256, kKeep, kDepth, kFanout, kFiles, kNameLength, kExtensions, kSeed, kQuery,
+    kIterations, kThreads, kHelp
+  };
+  static const option long_options[] = {
+      {"root", required_argument, nullptr, kRoot},
+      {"keep", no_argument, nullptr, kKeep},
+      {"depth", required_argument, nullptr, kDepth},
+      {"fanout", required_argument, nullptr, kFanout},
+      {"files", required_argument, nullptr, kFiles},
+      {"name-length", required_argument, nullptr, kNameLength},
+      {"extensions", required_argument, nullptr, kExtensions},
+      {"seed", required_argument, nullptr, kSeed},
+      {"query", required_argument, nullptr, kQuery},
+      {"iterations", required_argument, nullptr, kIterations},
+      {"threads", required_argument, nullptr, kThreads},
+      {"help", no_argument, nullptr, kHelp},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  TreeSpec spec;
+  std::string root;
+  bool keep = false;
+  std::string query = "ab";
+  unsigned iterations = 20;
+  unsigned threads = 0;
+
+  int option;
+  while ((option = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+    switch (option) {
+    case kRoot: root = optarg; break;
+    case kKeep: keep = true; break;
+    case kDepth: spec.depth = static_cast<unsigned>(atoi(optarg)); break;
+    case kFanout: spec.fanout = static_cast<unsigned>(atoi(optarg)); break;
+    case kFiles: spec.files = static_cast<unsigned>(atoi(optarg)); break;
+    case kNameLength:
+      if (sscanf(optarg, "%u-%u", &spec.min_name, &spec.max_name) != 2 ||
+          spec.min_name > spec.max_name) {
+        fprintf(stderr, "Invalid name length: %s\n", optarg);
+        return 2;
+      }
+      break;
+    case kExtensions: spec.extensions = optarg; break;
+    case kSeed: spec.seed = strtoull(optarg, nullptr, 10); break;
+    case kQuery: query = optarg; break;
+    case kIterations: iterations = static_cast<unsigned>(std::max(1, atoi(optarg))); break;
+    case kThreads: threads = static_cast<unsigned>(atoi(optarg)); break;
+    case kHelp: print_usage(argv[0]); return 0;
+    default: print_usage(argv[0]); return 2;
+    }
+  }
+
+  if (root.empty()) {
+    char pattern[] = "/tmp/orion-bench-XXXXXX";
+    if (!mkdtemp(pattern)) {
+      perror("mkdtemp");
+      return 1;
+    }
+    root = pattern;
+  } else if (mkdir(root.c_str(), 0755) != 0) {
+    fprintf(stderr, "Could not create %s; it must not exist yet\n", root.c_str());
+    return 2;
+  }
+
+  TreeStats tree;
+  auto generate_started = std::chrono::steady_clock::now();
+  if (!TreeGenerator(spec).generate(root, tree)) {
+    perror("generate");
+    return 1;
+  }
+  double generate_ms = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - generate_started)
+                           .count();
+  const std::vector<Extension> extensions = parse_extensions(spec.extensions);
+  const std::string extension = extensions.empty() ? std::string() : extensions.front().name;
+
+  auto walk = [&] {
+    orion::ParallelWalker walker(threads);
+    std::atomic<uint64_t> seen{0};
+    walker.walk(root, [&](unsigned, const orion::DirEntry &) {
+      seen.fetch_add(1, std::memory_order_relaxed);
+    });
+    return seen.load();
+  };
+  auto search = [&](const std::string &text) {
+    return [&, text] {
+      orion::SearchEngine engine(threads);
+      uint64_t found = 0;
+      engine.search(orion::SearchQuery::parse(text), root,
+                    [&](const std::vector<orion::SearchHit> &batch) { found += batch.size(); });
+      return found;
+    };
+  };
+  auto marshal = [&] {
+    orion_search_results_t *results = orion_search_files(query.c_str(), root.c_str(), nullptr,
+                                                         nullptr);
+    if (!results) return uint64_t(0);
+    uint64_t found = static_cast<uint64_t>(results->count);
+    orion_free_search_results(results);
+    return found;
+  };
+
+  std::vector<Result> results;
+  results.push_back(measure("walk_cold", std::min(iterations, 3u), true, walk));
+  results.push_back(measure("walk_warm", iterations, false, walk));
+  results.push_back(measure("name_match", iterations, false, search(query)));
+  // The query as a regex runs behind the same literal prefilter; a class-only
+  // pattern has no literal and runs the DFA over every path.
+  results.push_back(measure("regex_literal", iterations, false, search("regex:" + query)));
+  results.push_back(measure("regex_class", iterations, false, search("regex:[0-9]{2}[a-f][_-]")));
+  if (!extension.empty()) {
+    results.push_back(
+        measure("extension_filter", iterations, false, search(" extension:" + extension)));
+  }
+  results.push_back(measure("marshal_orion_search_files", iterations, false, marshal));
+
+  printf("{\n");
+  printf("  \"engine\": \"OrionCore\",\n");
+  printf("  \"threads\": %u,\n", orion::ParallelWalker(threads).thread_count());
+  printf("  \"tree\": {\"depth\": %u, \"fanout\": %u, \"files_per_directory\": %u, "
+         "\"name_length\": [%u, %u], \"extensions\": %s, \"seed\": %llu, \"files\": %llu, "
+         "\"directories\": %llu, \"generate_ms\": %.1f},\n",
+         spec.depth, spec.fanout, spec.files, spec.min_name, spec.max_name,
+         json_string(spec.extensions).c_str(), static_cast<unsigned long long>(spec.seed),
+         static_cast<unsigned long long>(tree.files),
+         static_cast<unsigned long long>(tree.directories), generate_ms);
+  printf("  \"query\": %s,\n", json_string(query).c_str());
+  printf("  \"benchmarks\": [");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &result = results[i];
+    printf("%s\n    {\"name\": %s, ", i ? "," : "", json_string(result.name).c_str());
+    if (result.samples_ms.empty()) {
+      // Cold runs need permission to drop the page cache.
+      printf("\"skipped\": true}");
+      continue;
+    }
+    double p50 = percentile(result.samples_ms, 0.50);
+    printf("\"iterations\": %zu, \"results\": %llu, \"p50_ms\": %.3f, \"p99_ms\": %.3f, "
+           "\"files_per_second\": %.0f}",
+           result.samples_ms.size(), static_cast<unsigned long long>(result.results), p50,
+           percentile(result.samples_ms, 0.99),
+           p50 > 0 ? static_cast<double>(tree.files) * 1000.0 / p50 : 0.0);
+  }
+  printf("\n  ]\n}\n");
+
+  if (!keep) {
+    std::error_code error;
+    std::filesystem::remove_all(root, error);
+  }
+  return 0;
+}
@@ -0,0 +1,292 @@
+#include "content_cache.hpp"
+#include "duplicate_finder.hpp"
+#include "ignore_rules.hpp"
+#include "regex.hpp"
+#include "search_engine.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <string>
+#include <sys/stat.h>
+
+namespace {
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options] <directory> <query>\n"
+          "\n"
+          "The query uses the GUI's syntax: whitespace-separated terms that must all\n"
+          "match, each negated by a leading '-'. Options go before <directory>, so a\n"
+          "query such as '-*.o' is never taken for one; when an argument starting\n"
+          "with '-' comes first, put '--' before it.\n"
+          "  word, \"two words\"      the path below <directory> contains it\n"
+          "  *.c, src/*/t?.py        glob over the name, or the path if it has a '/'\n"
+          "  name:X, path:X          X against just the name or the path\n"
+          "  ext:c,h                 any of the extensions\n"
+          "  size:>10k, size:1m..2g  size in bytes (k, m, g, t units)\n"
+          "  mtime:>2024-01-31       modified after that day\n"
+          "  mtime:2h, mtime:<7d     modified within 2 hours / over 7 days ago\n"
+          "  regex:PATTERN           regular expression over the path, ignoring case\n"
+          "\n"
+          "Paths excluded by .gitignore and .orionignore files, and .git, .hg, .svn,\n"
+          "node_modules, .build and __pycache__ directories, are left out.\n"
+          "\n"
+          "Options:\n"
+          "  -0, --null            separate results with NUL instead of newline\n"
+          "  -c, --content TEXT    only list files whose contents contain TEXT\n"
+          "  -D, --duplicates      list files with identical contents among the\n"
+          "                        matches, one group per paragraph, and the bytes\n"
+          "                        that deleting the extra copies would free\n"
+          "  -E, --regex           match the content TEXT as a regular expression\n"
+          "  -x, --exclude PATTERN also leave out paths matching this gitignore\n"
+          "                        pattern\n"
+          "  -f, --fuzzy           rank paths by fuzzy match, best first (top 1000,\n"
+          "                        or top N with --limit)\n"
+          "  -j, --threads N       number of worker threads (default: all cores)\n"
+          "  -n, --limit N         stop after N results\n"
+          "  -t, --time-limit MS   stop after MS milliseconds\n"
+          "  -u, --no-ignore       search ignored files and directories too\n"
+          "      --no-cache        read every file instead of reusing what earlier runs\n"
+          "                        learned about unchanged ones\n"
+          "  -s, --stats           print timing and counters to stderr\n"
+          "      --trace FILE      write a Chrome trace-event timeline to FILE\n"
+          "  -h, --help            show this help\n",
+          program);
+}
+
+bool parse_count(const char *text, unsigned long long &value) {
+  char *end = nullptr;
+  value = strtoull(text, &end, 10);
+  return end != text && *end == '\0';
+}
+
+double ms(uint64_t ns) { return ns / 1e6; }
+
+// Shared with the GUI: next to its settings.conf.
+std::string cache_path() {
+  const char *config = getenv("XDG_CONFIG_HOME");
+  const char *home = getenv("HOME");
+  if (config && *config) return std::string(config) + "/orion/" + orion::ContentCache::kFileName;
+  if (home && *home) {
+    return std::string(home) + "/.config/orion/" + orion::ContentCache::kFileName;
+  }
+  return "";
+}
+
+// Phase times are summed over workers; first result and wall time are not.
+void print_stats(const orion::SearchStats &stats) {
+  fprintf(stderr,
+          "  %llu directories opened, %llu entries read, %llu stat calls, "
+          "%llu directories skipped, %llu files read (%llu bytes), %llu cache hits\n",
+          static_cast<unsigned long long>(stats.directories_opened),
+          static_cast<unsigned long long>(stats.entries_read),
+          static_cast<unsigned long long>(stats.stat_calls),
+          static_cast<unsigned long long>(stats.directories_skipped),
+          static_cast<unsigned long long>(stats.files_read),
+          static_cast<unsigned long long>(stats.bytes_read),
+          static_cast<unsigned long long>(stats.cache_hits));
+  fprintf(stderr,
+          "  open %.1f ms, enumerate %.1f ms, stat %.1f ms, match %.1f ms, read %.1f ms, "
+          "deliver %.1f ms, idle %.1f ms\n",
+          ms(stats.open_ns), ms(stats.enumerate_ns), ms(stats.stat_ns), ms(stats.match_ns),
+          ms(stats.read_ns), ms(stats.deliver_ns), ms(stats.idle_ns));
+  fprintf(stderr, "  first result after %.1f ms, wall %.1f ms\n", ms(stats.first_result_ns),
+          ms(stats.wall_ns));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  static const option long_options[] = {
+      {"null", no_argument, nullptr, '0'},
+      {"content", required_argument, nullptr, 'c'},
+      {"duplicates", no_argument, nullptr, 'D'},
+      {"regex", no_argument, nullptr, 'E'},
+      {"exclude", required_argument, nullptr, 'x'},
+      {"fuzzy", no_argument, nullptr, 'f'},
+      {"threads", required_argument, nullptr, 'j'},
+      {"limit", required_argument, nullptr, 'n'},
+      {"stats", no_argument, nullptr, 's'},
+      {"time-limit", required_argument, nullptr, 't'},
+      {"trace", required_argument, nullptr, 'T'},
+      {"no-ignore", no_argument, nullptr, 'u'},
+      {"no-cache", no_argument, nullptr, 'N'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  char separator = '\n';
+  std::string content;
+  bool content_regex = false;
+  bool duplicates = false;
+  auto ignore = std::make_shared<orion::IgnoreSettings>();
+  bool no_ignore = false;
+  bool no_cache = false;
+  bool fuzzy = false;
+  unsigned long long threads = 0;
+  unsigned long long limit = 0;
+  unsigned long long time_limit = 0;
+  bool stats = false;
+  std::string trace_path;
+
+  int option;
+  while ((option = getopt_long(argc, argv, "+0c:DEx:fj:n:st:uh", long_options, nullptr)) != -1) {
+    switch (option) {
+    case '0':
+      separator = '\0';
+      break;
+    case 'c':
+      content = optarg;
+      break;
+    case 'D':
+      duplicates = true;
+      break;
+    case 'E':
+      content_regex = true;
+      break;
+    case 'x':
+      ignore->excludes.push_back(optarg);
+      break;
+    case 'f':
+      fuzzy = true;
+      break;
+    case 'j':
+      if (!parse_count(optarg, threads)) {
+        fprintf(stderr, "Invalid thread count: %s\n", optarg);
+        return 2;
+      }
+      break;
+    case 'n':
+      if (!parse_count(optarg, limit)) {
+        fprintf(stderr, "Invalid limit: %s\n", optarg);
+        return 2;
+      }
+      break;
+    case 's':
+      stats = true;
+      break;
+    case 't':
+      if (!parse_count(optarg, time_limit)) {
+        fprintf(stderr, "Invalid time limit: %s\n", optarg);
+        return 2;
+      }
+      break;
+    case 'T':
+      trace_path = optarg;
+      break;
+    case 'u':
+      no_ignore = true;
+      break;
+    case 'N':
+      no_cache = true;
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 0;
+    default:
+      print_usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (argc - optind != 2) {
+    print_usage(argv[0]);
+    return 2;
+  }
+  const std::string directory = argv[optind];
+  orion::SearchQuery query = orion::SearchQuery::parse(argv[optind + 1]);
+  query.content = content;
+  query.content_regex = content_regex;
+  query.fuzzy = fuzzy;
+  if (fuzzy && limit) {
+    query.rank_limit = static_cast<size_t>(limit);
+  }
+  query.max_results = static_cast<size_t>(limit);
+  query.time_limit = std::chrono::milliseconds(time_limit);
+  if (!no_ignore) {
+    query.ignore = ignore;
+  }
+  // Name-only searches never read contents, so they skip loading it.
+  if (!no_cache && (duplicates || !content.empty()) && !cache_path().empty()) {
+    query.cache = orion::ContentCache::open(cache_path());
+  }
+
+  std::string error;
+  if (content_regex && !orion::Regex::compile(content, false, &error)) {
+    fprintf(stderr, "Invalid regular expression: %s\n", error.c_str());
+    return 2;
+  }
+
+  struct stat st;
+  if (stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "Could not access directory: %s\n", directory.c_str());
+    return 2;
+  }
+
+  static char output_buffer[1 << 16];
+  setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+  orion::SearchProgress progress;
+  orion::TraceRecorder trace;
+  if (!trace_path.empty()) {
+    progress.trace = &trace;
+  }
+  unsigned long long printed = 0;
+  const auto started = std::chrono::steady_clock::now();
+
+  if (duplicates) {
+    // An empty entry, one extra separator, ends each group.
+    std::vector<orion::DuplicateGroup> groups =
+        orion::DuplicateFinder(static_cast<unsigned>(threads))
+            .find(query, directory, 1, nullptr, &progress);
+    unsigned long long reclaimable = 0;
+    for (const orion::DuplicateGroup &group : groups) {
+      if (printed) {
+        fputc(separator, stdout);
+      }
+      for (const std::string &path : group.paths) {
+        fwrite(path.c_str(), 1, path.size(), stdout);
+        fputc(separator, stdout);
+        printed++;
+      }
+      reclaimable += group.reclaimable();
+    }
+    fflush(stdout);
+    fprintf(stderr, "%zu groups of identical files, %llu bytes reclaimable\n", groups.size(),
+            reclaimable);
+  } else {
+    // Batches are never delivered concurrently, so printing needs no lock.
+    orion::SearchEngine engine(static_cast<unsigned>(threads));
+    engine.search(
+        query, directory,
+        [&](const std::vector<orion::SearchHit> &batch) {
+          for (const orion::SearchHit &hit : batch) {
+            fwrite(hit.path.c_str(), 1, hit.path.size(), stdout);
+            fputc(separator, stdout);
+            printed++;
+          }
+        },
+        nullptr, nullptr, &progress);
+    fflush(stdout);
+  }
+
+  if (stats) {
+    double elapsed_ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - started)
+                            .count();
+    unsigned long long files = progress.files_seen.load();
+    fprintf(stderr,
+            "%llu results%s, %llu files, %llu directories in %.1f ms (%.0f files/s)\n", printed,
+            progress.truncated.load() ? " (truncated)" : "",
+            files, static_cast<unsigned long long>(progress.directories_done.load()), elapsed_ms,
+            elapsed_ms > 0 ? files * 1000.0 / elapsed_ms : 0.0);
+    print_stats(progress.stats);
+  }
+  if (!trace_path.empty() && !trace.write(trace_path, progress.stats)) {
+    fprintf(stderr, "Could not write trace: %s\n", trace_path.c_str());
+  }
+  return printed > 0 ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+#include "result_model.hpp"
+
+#include <cstring>
+#include <sys/stat.h>
+
+namespace {
+
+// Size and modification time of a row, read the first time a cell needs them.
+struct RowMetadata {
+  bool loaded = false;
+  int64_t size = 0;
+  int64_t mtime = 0;
+};
+
+struct ResultRows {
+  // Shared with the models filtered from this one.
+  std::vector<std::shared_ptr<const ResultBatch>> batches;
+  std::vector<const char *> paths;
+  std::vector<uint32_t> match_counts;
+  std::vector<RowMetadata> metadata;
+};
+
+const RowMetadata &metadata_of(ResultRows &rows, size_t row) {
+  RowMetadata &metadata = rows.metadata[row];
+  if (!metadata.loaded) {
+    struct stat st;
+    if (lstat(rows.paths[row], &st) == 0) {
+      metadata.size = st.st_size;
+      metadata.mtime = st.st_mtime;
+    }
+    metadata.loaded = true;
+  }
+  return metadata;
+}
+
+std::vector<orion_search_result_t> result_table(const ResultRows &rows) {
+  std::vector<orion_search_result_t> results(rows.paths.size());
+  for (size_t row = 0; row < results.size(); row++) {
+    results[row].path = rows.paths[row];
+    results[row].length = static_cast<int32_t>(strlen(rows.paths[row]));
+    results[row].match_count = static_cast<int32_t>(rows.match_counts[row]);
+  }
+  return results;
+}
+
+} // namespace
+
+struct _OrionResultModel {
+  GObject parent_instance;
+  ResultRows *rows;
+  gint stamp;
+};
+
+static void orion_result_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(OrionResultModel, orion_result_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL,
+                                              orion_result_model_tree_model_init))
+
+static gboolean set_iter(OrionResultModel *model, GtkTreeIter *iter, gint row) {
+  if (row < 0 || static_cast<size_t>(row) >= model->rows->paths.size()) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  iter->stamp = model->stamp;
+  iter->user_data = GINT_TO_POINTER(row);
+  return TRUE;
+}
+
+static gint row_of(GtkTreeIter *iter) { return GPOINTER_TO_INT(iter->user_data); }
+
+static GtkTreeModelFlags get_flags(GtkTreeModel *) {
+  // Not ITERS_PERSIST: sorting moves rows and changes the stamp.
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint get_n_columns(GtkTreeModel *) { return RESULT_COLUMN_COUNT; }
+
+static GType get_column_type(GtkTreeModel *, gint column) {
+  return column == RESULT_COLUMN_MATCHES ? G_TYPE_UINT : G_TYPE_STRING;
+}
+
+static gboolean get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path) {
+  if (gtk_tree_path_get_depth(path) != 1) return FALSE;
+  return set_iter(ORION_RESULT_MODEL(tree_model), iter, gtk_tree_path_get_indices(path)[0]);
+}
+
+static GtkTreePath *get_path(GtkTreeModel *, GtkTreeIter *iter) {
+  return gtk_tree_path_new_from_indices(row_of(iter), -1);
+}
+
+static void get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value) {
+  OrionResultModel *model = ORION_RESULT_MODEL(tree_model);
+  ResultRows &rows = *model->rows;
+  const gint row = row_of(iter);
+  if (column == RESULT_COLUMN_MATCHES) {
+    g_value_init(value, G_TYPE_UINT);
+    g_value_set_uint(value, rows.match_counts[row]);
+    return;
+  }
+  g_value_init(value, G_TYPE_STRING);
+  switch (column) {
+  case RESULT_COLUMN_NAME: {
+    // The batch buffers live as long as the model, so the view can borrow them.
+    const char *slash = strrchr(rows.paths[row], '/');
+    g_value_set_static_string(value, slash ? slash + 1 : rows.paths[row]);
+    break;
+  }
+  case RESULT_COLUMN_SIZE:
+    g_value_take_string(value, g_format_size(metadata_of(rows, row).size));
+    break;
+  case RESULT_COLUMN_MODIFIED: {
+    GDateTime *time = g_date_time_new_from_unix_local(metadata_of(rows, row).mtime);
+    g_value_take_string(value, time ? g_date_time_format(time, "%Y-%m-%d %H:%M") : nullptr);
+    if (time) g_date_time_unref(time);
+    break;
+  }
+  default:
+    g_value_set_static_string(value, rows.paths[row]);
+  }
+}
+
+static gboolean iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+  return set_iter(ORION_RESULT_MODEL(tree_model), iter, row_of(iter) + 1);
+}
+
+static gboolean iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+  return set_iter(ORION_RESULT_MODEL(tree_model), iter, row_of(iter) - 1);
+}
+
+static gboolean iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent) {
+  if (parent) return FALSE;
+  return set_iter(ORION_RESULT_MODEL(tree_model), iter, 0);
+}
+
+static gboolean iter_has_child(GtkTreeModel *, GtkTreeIter *) { return FALSE; }
+
+static gint iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+  if (iter) return 0;
+  return static_cast<gint>(ORION_RESULT_MODEL(tree_model)->rows->paths.size());
+}
+
+static gboolean iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent,
+                               gint n) {
+  if (parent) return FALSE;
+  return set_iter(ORION_RESULT_MODEL(tree_model), iter, n);
+}
+
+static gboolean iter_parent(GtkTreeModel *, GtkTreeIter *, GtkTreeIter *) { return FALSE; }
+
+static void orion_result_model_tree_model_init(GtkTreeModelIface *iface) {
+  iface->get_flags = get_flags;
+  iface->get_n_columns = get_n_columns;
+  iface->get_column_type = get_column_type;
+  iface->get_iter = get_iter;
+  iface->get_path = get_path;
+  iface->get_value = get_value;
+  iface->iter_next = iter_next;
+  iface->iter_previous = iter_previous;
+  iface->iter_children = iter_children;
+  iface->iter_has_child = iter_has_child;
+  iface->iter_n_children = iter_n_children;
+  iface->iter_nth_child = iter_nth_child;
+  iface->iter_parent = iter_parent;
+}
+
+static void orion_result_model_finalize(GObject *object) {
+  delete ORION_RESULT_MODEL(object)->rows;
+  G_OBJECT_CLASS(orion_result_model_parent_class)->finalize(object);
+}
+
+static void orion_result_model_class_init(OrionResultModelClass *klass) {
+  G_OBJECT_CLASS(klass)->finalize = orion_result_model_finalize;
+}
+
+static void orion_result_model_init(OrionResultModel *model) {
+  model->rows = new ResultRows;
+  model->stamp = static_cast<gint>(g_random_int());
+}
+
+OrionResultModel *orion_result_model_new(void) {
+  return ORION_RESULT_MODEL(g_object_new(ORION_TYPE_RESULT_MODEL, NULL));
+}
+
+void orion_result_model_append(OrionResultModel *model, std::unique_ptr<ResultBatch> batch) {
+  if (!batch || batch->size() == 0) return;
+
+  ResultRows &rows = *model->rows;
+  const size_t first = rows.paths.size();
+  for (uint32_t offset : batch->offsets) {
+    rows.paths.push_back(batch->paths.data() + offset);
+  }
+  rows.match_counts.insert(rows.match_counts.end(), batch->match_counts.begin(),
+                           batch->match_counts.end());
+  rows.metadata.resize(rows.paths.size());
+  rows.batches.push_back(std::move(batch));
+
+  // The view still has to hear about every row, but nothing is copied and
+  // one path is reused for the whole batch.
+  GtkTreePath *path = gtk_tree_path_new_from_indices(static_cast<gint>(first), -1);
+  GtkTreeIter iter;
+  for (size_t row = first; row < rows.paths.size(); row++) {
+    set_iter(model, &iter, static_cast<gint>(row));
+    gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+    gtk_tree_path_next(path);
+  }
+  gtk_tree_path_free(path);
+}
+
+size_t orion_result_model_size(OrionResultModel *model) { return model->rows->paths.size(); }
+
+void orion_result_model_sort(OrionResultModel *model, int32_t key, bool descending) {
+  ResultRows &rows = *model->rows;
+  const size_t count = rows.paths.size();
+  if (count < 2) return;
+
+  std::vector<orion_search_result_t> results = result_table(rows);
+  std::vector<gint> order(count);
+  orion_sort_order(results.data(), static_cast<int32_t>(count), key, descending ? 1 : 0,
+                   order.data());
+
+  ResultRows sorted;
+  sorted.paths.reserve(count);
+  sorted.match_counts.reserve(count);
+  sorted.metadata.reserve(count);
+  for (gint row : order) {
+    sorted.paths.push_back(rows.paths[row]);
+    sorted.match_counts.push_back(rows.match_counts[row]);
+    sorted.metadata.push_back(rows.metadata[row]);
+  }
+  rows.paths.swap(sorted.paths);
+  rows.match_counts.swap(sorted.match_counts);
+  rows.metadata.swap(sorted.metadata);
+
+  // Rows are addressed by position, so iterators from before are stale.
+  model->stamp++;
+  GtkTreePath *root = gtk_tree_path_new();
+  gtk_tree_model_rows_reordered(GTK_TREE_MODEL(model), root, nullptr, order.data());
+  gtk_tree_path_free(root);
+}
+
+OrionResultModel *orion_result_model_filter(OrionResultModel *model, const char *query,
+                                            const orion_search_options_t *options,
+                                            const char *directory) {
+  const ResultRows &rows = *model->rows;
+  std::vector<orion_search_result_t> results = result_table(rows);
+  std::vector<uint8_t> keep(results.size());
+  orion_filter_results(results.data(), static_cast<int32_t>(results.size()), query, options,
+                       directory, keep.data());
+
+  OrionResultModel *filtered = orion_result_model_new();
+  ResultRows &kept = *filtered->rows;
+  kept.batches = rows.batches;
+  for (size_t row = 0; row < keep.size(); row++) {
+    if (!keep[row]) continue;
+    kept.paths.push_back(rows.paths[row]);
+    kept.match_counts.push_back(rows.match_counts[row]);
+    kept.metadata.push_back(rows.metadata[row]);
+  }
+  return filtered;
+}
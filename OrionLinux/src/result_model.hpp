@@ -0,0 +1,57 @@
+#pragma once
+
+#include "bridge.h"
+#include <cstdint>
+#include <gtk/gtk.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Paths of one engine batch, copied once into a single buffer. The model
+// keeps the batch alive and hands its strings to the view without copying.
+struct ResultBatch {
+  std::string paths;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> match_counts;
+
+  void add(std::string_view path, uint32_t match_count = 0) {
+    offsets.push_back(static_cast<uint32_t>(paths.size()));
+    match_counts.push_back(match_count);
+    paths.append(path);
+    paths.push_back('\0');
+  }
+  size_t size() const { return offsets.size(); }
+};
+
+enum ResultColumn {
+  RESULT_COLUMN_NAME,
+  RESULT_COLUMN_PATH,
+  RESULT_COLUMN_SIZE,
+  RESULT_COLUMN_MODIFIED,
+  RESULT_COLUMN_MATCHES,
+  RESULT_COLUMN_COUNT
+};
+
+// A list-only GtkTreeModel over ResultBatch buffers. Rows are only turned
+// into GValues when the view asks for a visible cell; size and modification
+// time are stat'ed then too, once per row.
+G_BEGIN_DECLS
+
+#define ORION_TYPE_RESULT_MODEL (orion_result_model_get_type())
+G_DECLARE_FINAL_TYPE(OrionResultModel, orion_result_model, ORION, RESULT_MODEL, GObject)
+
+OrionResultModel *orion_result_model_new(void);
+
+G_END_DECLS
+
+void orion_result_model_append(OrionResultModel *model, std::unique_ptr<ResultBatch> batch);
+size_t orion_result_model_size(OrionResultModel *model);
+// Reorders the rows with the engine's parallel sort. `key` is an ORION_SORT_*
+// value.
+void orion_result_model_sort(OrionResultModel *model, int32_t key, bool descending);
+// A new model with the rows of `model` that still match `query` under
+// `directory`, in the same order. The paths are shared, not copied.
+OrionResultModel *orion_result_model_filter(OrionResultModel *model, const char *query,
+                                            const orion_search_options_t *options,
+                                            const char *directory);
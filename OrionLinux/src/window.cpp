@@ -1,17 +1,29 @@
 #include "window.hpp"
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
-
-MainWindow::MainWindow() : is_searching(false), should_cancel(false) {
+#include <sys/stat.h>
+
+MainWindow::MainWindow()
+    : sorted_column(nullptr), sort_descending(false), result_model(nullptr), is_searching(false),
+      search_handle(nullptr), progress_tick(0), search_generation(0), last_complete(false),
+      live_timer(0), index(nullptr),
+      refresh_handle(nullptr), index_refreshing(false), index_generation(0),
+      index_watching(false) {
   setup_ui();
-  load_theme_preference();
+  load_preferences();
 }
 
 MainWindow::~MainWindow() {
-  cancel_search();
-  if (search_thread && search_thread->joinable()) {
-    search_thread->join();
+  if (live_timer) {
+    g_source_remove(live_timer);
+  }
+  stop_search();
+  stop_refresh();
+  if (index) {
+    orion_index_free(index);
   }
 }
 
@@ -72,7 +84,34 @@ void MainWindow::setup_ui() {
   search_entry = gtk_entry_new();
   gtk_entry_set_placeholder_text(GTK_ENTRY(search_entry),
                                  "Enter search query...");
+  gtk_widget_set_tooltip_text(search_entry,
+                              "Terms that must all match, e.g. report -draft *.pdf "
+                              "size:>1m mtime:<7d name:notes path:src/ ext:c,h");
   gtk_box_pack_start(GTK_BOX(search_box), search_entry, TRUE, TRUE, 0);
+  g_signal_connect(search_entry, "changed", G_CALLBACK(on_query_changed), this);
+  g_signal_connect(extension_entry, "changed", G_CALLBACK(on_query_changed), this);
+
+  // Searches file contents for the query instead of names.
+  content_toggle = gtk_check_button_new_with_label("Contents");
+  gtk_box_pack_start(GTK_BOX(search_box), content_toggle, FALSE, FALSE, 0);
+
+  // Ranks names by how well they fuzzy-match instead of listing every
+  // substring match.
+  fuzzy_toggle = gtk_check_button_new_with_label("Fuzzy");
+  gtk_box_pack_start(GTK_BOX(search_box), fuzzy_toggle, FALSE, FALSE, 0);
+
+  // Takes the query as one regular expression, over paths or contents.
+  regex_toggle = gtk_check_button_new_with_label("Regex");
+  gtk_box_pack_start(GTK_BOX(search_box), regex_toggle, FALSE, FALSE, 0);
+
+  // Lists the files with identical contents among those the query matches,
+  // grouped, instead of the matches themselves.
+  duplicates_toggle = gtk_check_button_new_with_label("Duplicates");
+  gtk_box_pack_start(GTK_BOX(search_box), duplicates_toggle, FALSE, FALSE, 0);
+
+  // Searches while typing; narrowing a finished query filters its results.
+  live_toggle = gtk_check_button_new_with_label("Live");
+  gtk_box_pack_start(GTK_BOX(search_box), live_toggle, FALSE, FALSE, 0);
 
   search_button = gtk_button_new_with_label("Search");
   gtk_box_pack_start(GTK_BOX(search_box), search_button, FALSE, FALSE, 0);
@@ -88,14 +127,15 @@ void MainWindow::setup_ui() {
   progress_bar = gtk_progress_bar_new();
   gtk_box_pack_start(GTK_BOX(content_box), progress_bar, FALSE, FALSE, 0);
 
-  list_store = gtk_list_store_new(1, G_TYPE_STRING);
-  results_list = gtk_tree_view_new_with_model(GTK_TREE_MODEL(list_store));
-  g_object_unref(list_store);
+  results_list = gtk_tree_view_new();
+  reset_results();
 
-  GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
-  GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes(
-      "Path", renderer, "text", 0, NULL);
-  gtk_tree_view_append_column(GTK_TREE_VIEW(results_list), column);
+  add_result_column("Name", RESULT_COLUMN_NAME, ORION_SORT_NAME, 200);
+  add_result_column("Path", RESULT_COLUMN_PATH, ORION_SORT_PATH, 0);
+  add_result_column("Size", RESULT_COLUMN_SIZE, ORION_SORT_SIZE, 90);
+  add_result_column("Modified", RESULT_COLUMN_MODIFIED, ORION_SORT_MODIFIED, 130);
+  matches_column = add_result_column("Matches", RESULT_COLUMN_MATCHES, ORION_SORT_MATCHES, 80);
+  gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(results_list), TRUE);
 
   GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
   gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
@@ -107,6 +147,7 @@ void MainWindow::setup_ui() {
                    this);
 
   gtk_widget_show_all(window);
+  gtk_tree_view_column_set_visible(matches_column, FALSE);
   update_search_controls(false);
 }
 
@@ -114,21 +155,98 @@ void MainWindow::update_search_controls(bool searching) {
   is_searching = searching;
   gtk_widget_set_sensitive(search_button, !searching);
   gtk_widget_set_sensitive(cancel_button, searching);
-  gtk_widget_set_sensitive(search_entry, !searching);
+  // Live queries replace a running search, so typing stays possible.
+  const bool live = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(live_toggle));
+  gtk_widget_set_sensitive(search_entry, !searching || live);
   gtk_widget_set_sensitive(path_entry, !searching);
-  gtk_widget_set_sensitive(extension_entry, !searching);
+  gtk_widget_set_sensitive(extension_entry, !searching || live);
+  gtk_widget_set_sensitive(content_toggle, !searching);
+  gtk_widget_set_sensitive(fuzzy_toggle, !searching);
+  gtk_widget_set_sensitive(regex_toggle, !searching);
+  gtk_widget_set_sensitive(duplicates_toggle, !searching);
+  // Sorting reorders the rows in place, so it waits for the last batch.
+  // Duplicate groups keep the engine's order.
+  for (GtkTreeViewColumn *column : sort_columns) {
+    gtk_tree_view_column_set_clickable(column, !searching && !duplicates);
+  }
 
   if (!searching) {
+    stop_progress();
     gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), 0.0);
   }
 }
 
-void MainWindow::start_search() {
+void MainWindow::show_progress() {
+  if (!search_handle) return;
+
+  orion_search_progress_t progress;
+  orion_search_get_progress(search_handle, &progress);
+  char text[128];
+  snprintf(text, sizeof(text), "%lld files, %lld matches, %lld folders pending",
+           static_cast<long long>(progress.files_seen), static_cast<long long>(progress.matches),
+           static_cast<long long>(progress.directories_pending));
+  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), progress.estimate);
+  gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), text);
+}
+
+void MainWindow::stop_progress() {
+  if (progress_tick) {
+    gtk_widget_remove_tick_callback(progress_bar, progress_tick);
+    progress_tick = 0;
+  }
+}
+
+// In content mode the query is the literal (or pattern) to look for and
+// only the extension filters names. Duplicate searches only compare
+// contents, so for them the query always filters names.
+SearchRequest MainWindow::current_request() const {
   const char *query = gtk_entry_get_text(GTK_ENTRY(search_entry));
-  const char *directory = gtk_entry_get_text(GTK_ENTRY(path_entry));
   const char *extension = gtk_entry_get_text(GTK_ENTRY(extension_entry));
 
-  if (strlen(query) == 0) {
+  const bool regex = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(regex_toggle));
+  SearchRequest request;
+  request.directory = gtk_entry_get_text(GTK_ENTRY(path_entry));
+  request.ignore = ignore_preferences;
+  if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(content_toggle)) &&
+      !gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(duplicates_toggle))) {
+    request.content = query;
+    request.content_regex = regex;
+  } else if (regex) {
+    // One quoted term, so spaces, quotes and backslashes stay part of the
+    // pattern.
+    request.query = "regex:\"";
+    for (const char *c = query; *c; c++) {
+      if (*c == '"' || *c == '\\') {
+        request.query += '\\';
+      }
+      request.query += *c;
+    }
+    request.query += '"';
+  } else {
+    request.query = query;
+    request.fuzzy = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(fuzzy_toggle));
+  }
+
+  // "txt, .cpp" becomes the term "ext:txt,.cpp".
+  std::string extensions;
+  for (const char *c = extension; *c; c++) {
+    if (*c != ' ' && *c != '\t') {
+      extensions += *c;
+    }
+  }
+  if (!extensions.empty()) {
+    request.query += " ext:" + extensions;
+  }
+  return request;
+}
+
+void MainWindow::start_search() {
+  const char *query = gtk_entry_get_text(GTK_ENTRY(search_entry));
+  // With no query every file is compared.
+  const bool find_duplicates =
+      gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(duplicates_toggle));
+
+  if (strlen(query) == 0 && !find_duplicates) {
     GtkWidget *dialog = gtk_message_dialog_new(
         GTK_WINDOW(window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
         "Please enter a search query");
@@ -137,109 +255,401 @@ void MainWindow::start_search() {
     return;
   }
 
-  cancel_search();
-  if (search_thread && search_thread->joinable()) {
-    search_thread->join();
-  }
+  stop_search();
+  last_request = current_request();
+  last_complete = false;
+  const std::string &directory = last_request.directory;
+  open_index(directory);
 
-  should_cancel = false;
+  const bool search_contents = !last_request.content.empty();
+  orion_search_options_t options = last_request.options();
+  options.max_results = kMaxListedResults;
+  // Set to a file name to get a chrome://tracing timeline of each search.
+  options.trace_path = getenv("ORION_TRACE");
+  options.cache_path = cache_path.empty() ? nullptr : cache_path.c_str();
+
+  search_generation++;
   update_search_controls(true);
-  gtk_list_store_clear(list_store);
+  reset_results();
+  gtk_tree_view_column_set_visible(matches_column, search_contents && !find_duplicates);
+  gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar),
+                            find_duplicates ? "Comparing files..." : "Searching...");
+
+  search_context = std::make_unique<SearchContext>(SearchContext{this, search_generation});
+  if (find_duplicates) {
+    search_handle = orion_duplicates_start(last_request.query.c_str(), directory.c_str(),
+                                           &options, 1, duplicates_callback, completion_callback,
+                                           search_context.get());
+  } else if (orion_index_entry_count(index) > 0) {
+    search_handle = orion_index_search_start(index, last_request.query.c_str(), &options,
+                                             results_callback, nullptr, completion_callback,
+                                             search_context.get());
+  } else {
+    search_handle = orion_search_start(last_request.query.c_str(), directory.c_str(), &options,
+                                       results_callback, nullptr, completion_callback,
+                                       search_context.get());
+  }
 
-  search_thread = std::make_unique<std::thread>(
-      [this, query = std::string(query), directory = std::string(directory), extension = std::string(extension)]() {
-        perform_search(query, directory, extension);
-      });
+  // The workers only bump counters; the bar samples them once per frame.
+  progress_tick = gtk_widget_add_tick_callback(progress_bar, on_progress_tick, this, nullptr);
+}
+
+// Filters the current results when the query only got narrower and the last
+// search is complete; anything else needs a new search.
+void MainWindow::live_search() {
+  if (strlen(gtk_entry_get_text(GTK_ENTRY(search_entry))) == 0) return;
+
+  SearchRequest request = current_request();
+  if (!is_searching && last_complete && request.directory == last_request.directory) {
+    orion_search_options_t options = request.options();
+    orion_search_options_t previous = last_request.options();
+    if (orion_query_refines(request.query.c_str(), &options, last_request.query.c_str(),
+                            &previous)) {
+      refine_results(request);
+      return;
+    }
+  }
+  start_search();
+}
+
+void MainWindow::refine_results(const SearchRequest &request) {
+  orion_search_options_t options = request.options();
+  result_model = orion_result_model_filter(result_model, request.query.c_str(), &options,
+                                           request.directory.c_str());
+  gtk_tree_view_set_model(GTK_TREE_VIEW(results_list), GTK_TREE_MODEL(result_model));
+  g_object_unref(result_model);
+  last_request = request;
+
+  char text[64];
+  snprintf(text, sizeof(text), "Filtered: %zu matches", orion_result_model_size(result_model));
+  gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), text);
 }
 
 void MainWindow::cancel_search() {
-  should_cancel = true;
+  if (search_handle) {
+    orion_search_cancel(search_handle);
+  }
+  search_generation++;
   update_search_controls(false);
 }
 
-void MainWindow::update_progress(double progress) {
-  gdk_threads_add_idle(
-      [](gpointer data) -> gboolean {
-        auto params = static_cast<std::pair<MainWindow *, double> *>(data);
-        auto [window, progress] = *params;
+void MainWindow::stop_search() {
+  stop_progress();
+  if (search_handle) {
+    orion_search_free(search_handle);
+    search_handle = nullptr;
+  }
+  search_context.reset();
+}
 
-        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(window->progress_bar),
-                                      progress);
+void MainWindow::open_index(const std::string &directory) {
+  if (index && index_root == directory) {
+    return;
+  }
 
-        delete params;
-        return G_SOURCE_REMOVE;
+  stop_refresh();
+  if (index) {
+    orion_index_free(index);
+  }
+  index_generation++;
+  index_watching = false;
+  std::string index_dir = std::string(g_get_user_config_dir()) + "/orion/index";
+  index = orion_index_open(directory.c_str(), index_dir.c_str());
+  index_root = directory;
+}
+
+void MainWindow::start_refresh() {
+  // Once the index is watched it is kept current without rescanning.
+  if (!index || index_refreshing || index_watching) {
+    return;
+  }
+
+  if (refresh_handle) {
+    orion_search_free(refresh_handle);
+  }
+  struct Refresh {
+    MainWindow *window;
+    unsigned generation;
+    bool cancelled;
+  };
+
+  // Completes on the refresh session's thread; the window is only touched
+  // once the result reaches the GUI thread.
+  index_refreshing = true;
+  refresh_handle = orion_index_refresh_start(
+      index,
+      [](int32_t cancelled, void *user_data) {
+        auto refresh = static_cast<Refresh *>(user_data);
+        refresh->cancelled = cancelled != 0;
+        gdk_threads_add_idle(
+            [](gpointer data) -> gboolean {
+              auto refresh = static_cast<Refresh *>(data);
+              MainWindow *window = refresh->window;
+              if (refresh->generation == window->index_generation) {
+                window->index_refreshing = false;
+                if (!refresh->cancelled) {
+                  window->start_watching();
+                }
+              }
+              delete refresh;
+              return G_SOURCE_REMOVE;
+            },
+            refresh);
       },
-      new std::pair<MainWindow *, double>(this, progress));
+      new Refresh{this, index_generation, false});
 }
 
-static void progress_callback(double progress, void *user_data) {
-  MainWindow *window = static_cast<MainWindow *>(user_data);
-  window->update_progress(progress);
+void MainWindow::start_watching() {
+  if (index && !index_watching) {
+    index_watching = orion_index_watch_start(index) != 0;
+  }
 }
 
-void MainWindow::perform_search(const std::string &query, const std::string &directory, const std::string &extension) {
-    std::string full_query = query;
-    if (!extension.empty()) {
-        std::string ext = extension;
-        if (!ext.empty() && ext[0] != '.') {
-            ext = "." + ext;
+void MainWindow::stop_refresh() {
+  if (refresh_handle) {
+    orion_search_free(refresh_handle);
+    refresh_handle = nullptr;
+  }
+  index_refreshing = false;
+}
+
+void MainWindow::post_results(unsigned generation, std::unique_ptr<ResultBatch> results) {
+  struct Batch {
+    MainWindow *window;
+    unsigned generation;
+    std::unique_ptr<ResultBatch> results;
+  };
+
+  gdk_threads_add_idle(
+      [](gpointer data) -> gboolean {
+        auto batch = static_cast<Batch *>(data);
+        if (batch->generation == batch->window->search_generation) {
+          orion_result_model_append(batch->window->result_model, std::move(batch->results));
         }
-        full_query = query + " extension:" + ext;
-    }
+        delete batch;
+        return G_SOURCE_REMOVE;
+      },
+      new Batch{this, generation, std::move(results)});
+}
 
-    gdk_threads_add_idle(
-        [](gpointer data) -> gboolean {
-            auto window = static_cast<MainWindow *>(data);
-            gtk_progress_bar_set_text(GTK_PROGRESS_BAR(window->progress_bar), "Parsing...");
-            return G_SOURCE_REMOVE;
-        },
-        this);
-
-    orion_search_results_t *results = orion_search_files(
-        full_query.c_str(), directory.c_str(), progress_callback, this);
-
-    if (results && !should_cancel) {
-        std::vector<FileSearchResult> cpp_results;
-        for (int i = 0; i < results->count; i++) {
-            cpp_results.push_back(FileSearchResult{results->results[i].path});
+void MainWindow::post_duplicates(unsigned generation, std::unique_ptr<DuplicateList> list) {
+  struct Duplicates {
+    MainWindow *window;
+    unsigned generation;
+    std::unique_ptr<DuplicateList> list;
+  };
+
+  gdk_threads_add_idle(
+      [](gpointer data) -> gboolean {
+        auto duplicates = static_cast<Duplicates *>(data);
+        if (duplicates->generation == duplicates->window->search_generation) {
+          duplicates->window->show_duplicates(std::move(duplicates->list));
         }
+        delete duplicates;
+        return G_SOURCE_REMOVE;
+      },
+      new Duplicates{this, generation, std::move(list)});
+}
 
-        gdk_threads_add_idle(
-            [](gpointer data) -> gboolean {
-                auto params = static_cast<
-                    std::pair<MainWindow *, std::vector<FileSearchResult>> *>(data);
-                auto [window, results] = *params;
+void MainWindow::finish_search(unsigned generation, bool cancelled) {
+  struct Completion {
+    MainWindow *window;
+    unsigned generation;
+    bool cancelled;
+  };
 
-                gtk_progress_bar_set_text(GTK_PROGRESS_BAR(window->progress_bar), "Search complete");
-                window->update_results(results);
-                window->update_search_controls(false);
+  gdk_threads_add_idle(
+      [](gpointer data) -> gboolean {
+        auto completion = static_cast<Completion *>(data);
+        MainWindow *window = completion->window;
+        if (completion->generation == window->search_generation) {
+          if (!completion->cancelled) {
+            orion_search_stats_t stats = {};
+            orion_search_progress_t progress = {};
+            if (window->search_handle) {
+              orion_search_get_stats(window->search_handle, &stats);
+              orion_search_get_progress(window->search_handle, &progress);
+            }
+            char text[160];
+            int length;
+            if (window->duplicates) {
+              const DuplicateList &list = *window->duplicates;
+              char *reclaimable = g_format_size(static_cast<guint64>(list.reclaimable));
+              length = snprintf(text, sizeof(text),
+                                "%s: %zu groups, %lld files, %s reclaimable in %.0f ms",
+                                list.groups.size() < list.total_groups
+                                    ? "Showing the largest duplicates"
+                                    : "Duplicates",
+                                list.total_groups, static_cast<long long>(list.total_files),
+                                reclaimable, stats.wall_ns / 1e6);
+              g_free(reclaimable);
+            } else {
+              length = snprintf(text, sizeof(text), "%s: %zu matches, %lld files in %.0f ms",
+                                progress.truncated ? "Showing the first results"
+                                                   : "Search complete",
+                                orion_result_model_size(window->result_model),
+                                static_cast<long long>(stats.entries_read), stats.wall_ns / 1e6);
+            }
+            if (stats.directories_skipped > 0 && length > 0 &&
+                static_cast<size_t>(length) < sizeof(text)) {
+              length += snprintf(text + length, sizeof(text) - length, ", %lld folders skipped",
+                                 static_cast<long long>(stats.directories_skipped));
+            }
+            if (stats.cache_hits > 0 && length > 0 && static_cast<size_t>(length) < sizeof(text)) {
+              snprintf(text + length, sizeof(text) - length, ", %lld files known from cache",
+                       static_cast<long long>(stats.cache_hits));
+            }
+            gtk_progress_bar_set_text(GTK_PROGRESS_BAR(window->progress_bar), text);
+            window->last_complete =
+                window->search_handle && !progress.truncated && !window->duplicates;
+            window->start_refresh();
+          }
+          window->update_search_controls(false);
+        }
+        delete completion;
+        return G_SOURCE_REMOVE;
+      },
+      new Completion{this, generation, cancelled});
+}
 
-                delete params;
-                return G_SOURCE_REMOVE;
-            },
-            new std::pair<MainWindow *, std::vector<FileSearchResult>>(
-                this, std::move(cpp_results)));
+void MainWindow::results_callback(const orion_search_result_t *results, int32_t count,
+                                  void *user_data) {
+  auto context = static_cast<SearchContext *>(user_data);
+  auto batch = std::make_unique<ResultBatch>();
+  batch->offsets.reserve(count);
+  for (int32_t i = 0; i < count; i++) {
+    batch->add(orion_result_path(results[i]), static_cast<uint32_t>(results[i].match_count));
+  }
+  context->window->post_results(context->generation, std::move(batch));
+}
 
-        orion_free_search_results(results);
+// Copies the largest groups, up to kMaxListedResults files, and totals all.
+void MainWindow::duplicates_callback(const orion_duplicate_group_t *groups, int32_t count,
+                                     void *user_data) {
+  auto context = static_cast<SearchContext *>(user_data);
+  auto list = std::make_unique<DuplicateList>();
+  list->total_groups = static_cast<size_t>(count);
+  int64_t listed = 0;
+  for (int32_t i = 0; i < count; i++) {
+    const orion_duplicate_group_t &group = groups[i];
+    list->total_files += group.count;
+    list->reclaimable += group.size * (group.count - 1);
+    if (listed >= kMaxListedResults) continue;
+    DuplicateList::Group copy{group.size, {}};
+    for (int32_t file = 0; file < group.count; file++) {
+      copy.paths.emplace_back(orion_result_path(group.files[file]));
     }
+    list->groups.push_back(std::move(copy));
+    listed += group.count;
+  }
+  context->window->post_duplicates(context->generation, std::move(list));
+}
 
-    if (should_cancel) {
-        gdk_threads_add_idle(
-            [](gpointer data) -> gboolean {
-                auto window = static_cast<MainWindow *>(data);
-                window->update_search_controls(false);
-                return G_SOURCE_REMOVE;
-            },
-            this);
+void MainWindow::completion_callback(int32_t cancelled, void *user_data) {
+  auto context = static_cast<SearchContext *>(user_data);
+  context->window->finish_search(context->generation, cancelled != 0);
+}
+
+// Swapping in an empty model is cheaper than deleting rows one by one.
+void MainWindow::reset_results() {
+  duplicates.reset();
+  result_model = orion_result_model_new();
+  gtk_tree_view_set_model(GTK_TREE_VIEW(results_list), GTK_TREE_MODEL(result_model));
+  g_object_unref(result_model);
+  if (sorted_column) {
+    gtk_tree_view_column_set_sort_indicator(sorted_column, FALSE);
+    sorted_column = nullptr;
+  }
+}
+
+// Each group is a row, with what its extra copies take up, over one row per
+// copy. Only a few thousand rows are listed, so a plain tree store will do.
+void MainWindow::show_duplicates(std::unique_ptr<DuplicateList> list) {
+  GtkTreeStore *store = gtk_tree_store_new(RESULT_COLUMN_COUNT, G_TYPE_STRING, G_TYPE_STRING,
+                                           G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT);
+  for (const DuplicateList::Group &group : list->groups) {
+    const guint copies = static_cast<guint>(group.paths.size());
+    char *size = g_format_size(static_cast<guint64>(group.size));
+    char *reclaimable = g_format_size(static_cast<guint64>(group.size) * (copies - 1));
+    char *summary = g_strdup_printf("%u identical files", copies);
+    char *detail = g_strdup_printf("%s reclaimable", reclaimable);
+    GtkTreeIter parent;
+    gtk_tree_store_insert_with_values(store, &parent, nullptr, -1, RESULT_COLUMN_NAME, summary,
+                                      RESULT_COLUMN_PATH, detail, RESULT_COLUMN_SIZE, size,
+                                      RESULT_COLUMN_MATCHES, copies, -1);
+    for (const std::string &path : group.paths) {
+      char *modified = nullptr;
+      struct stat st;
+      if (lstat(path.c_str(), &st) == 0) {
+        if (GDateTime *time = g_date_time_new_from_unix_local(st.st_mtime)) {
+          modified = g_date_time_format(time, "%Y-%m-%d %H:%M");
+          g_date_time_unref(time);
+        }
+      }
+      gtk_tree_store_insert_with_values(
+          store, nullptr, &parent, -1, RESULT_COLUMN_NAME,
+          path.c_str() + path.rfind('/') + 1, RESULT_COLUMN_PATH, path.c_str(),
+          RESULT_COLUMN_SIZE, size, RESULT_COLUMN_MODIFIED, modified, -1);
+      g_free(modified);
     }
+    g_free(size);
+    g_free(reclaimable);
+    g_free(summary);
+    g_free(detail);
+  }
+
+  // The view held the only reference to the result model.
+  gtk_tree_view_set_model(GTK_TREE_VIEW(results_list), GTK_TREE_MODEL(store));
+  g_object_unref(store);
+  result_model = nullptr;
+  gtk_tree_view_expand_all(GTK_TREE_VIEW(results_list));
+  duplicates = std::move(list);
 }
 
-void MainWindow::update_results(const std::vector<FileSearchResult> &results) {
-  GtkTreeIter iter;
-  for (const auto &result : results) {
-    gtk_list_store_append(list_store, &iter);
-    gtk_list_store_set(list_store, &iter, 0, result.path.c_str(), -1);
+// A width of 0 makes the column take up the remaining space.
+GtkTreeViewColumn *MainWindow::add_result_column(const char *title, ResultColumn column,
+                                                 int32_t sort_key, int width) {
+  GtkTreeViewColumn *view_column = gtk_tree_view_column_new_with_attributes(
+      title, gtk_cell_renderer_text_new(), "text", column, NULL);
+  // Fixed-size rows let the view skip measuring every row it is told about.
+  gtk_tree_view_column_set_sizing(view_column, GTK_TREE_VIEW_COLUMN_FIXED);
+  if (width > 0) {
+    gtk_tree_view_column_set_fixed_width(view_column, width);
+    gtk_tree_view_column_set_resizable(view_column, TRUE);
+  } else {
+    gtk_tree_view_column_set_expand(view_column, TRUE);
+  }
+  // Clicks sort through the engine rather than a GtkTreeSortable, which
+  // would compare rows one GValue at a time on the UI thread.
+  g_object_set_data(G_OBJECT(view_column), "orion-sort-key", GINT_TO_POINTER(sort_key));
+  g_signal_connect(view_column, "clicked", G_CALLBACK(on_column_clicked), this);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(results_list), view_column);
+  sort_columns.push_back(view_column);
+  return view_column;
+}
+
+void MainWindow::sort_results(GtkTreeViewColumn *column) {
+  sort_descending = column == sorted_column && !sort_descending;
+  if (sorted_column && sorted_column != column) {
+    gtk_tree_view_column_set_sort_indicator(sorted_column, FALSE);
   }
+  sorted_column = column;
+  gtk_tree_view_column_set_sort_indicator(column, TRUE);
+  gtk_tree_view_column_set_sort_order(column,
+                                      sort_descending ? GTK_SORT_DESCENDING : GTK_SORT_ASCENDING);
+
+  int32_t key = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(column), "orion-sort-key"));
+  orion_result_model_sort(result_model, key, sort_descending);
+}
+
+void MainWindow::on_column_clicked(GtkTreeViewColumn *column, gpointer user_data) {
+  static_cast<MainWindow *>(user_data)->sort_results(column);
+}
+
+gboolean MainWindow::on_progress_tick(GtkWidget *, GdkFrameClock *, gpointer user_data) {
+  auto window = static_cast<MainWindow *>(user_data);
+  window->show_progress();
+  return G_SOURCE_CONTINUE;
 }
 
 void MainWindow::on_search_clicked(GtkButton *button, gpointer user_data) {
@@ -247,6 +657,25 @@ void MainWindow::on_search_clicked(GtkButton *button, gpointer user_data) {
   window->start_search();
 }
 
+void MainWindow::on_query_changed(GtkEditable *, gpointer user_data) {
+  auto window = static_cast<MainWindow *>(user_data);
+  if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(window->live_toggle)) ||
+      gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(window->duplicates_toggle))) {
+    return;
+  }
+  if (window->live_timer) {
+    g_source_remove(window->live_timer);
+  }
+  window->live_timer = g_timeout_add(kLiveSearchDelayMs, on_live_timeout, window);
+}
+
+gboolean MainWindow::on_live_timeout(gpointer user_data) {
+  auto window = static_cast<MainWindow *>(user_data);
+  window->live_timer = 0;
+  window->live_search();
+  return G_SOURCE_REMOVE;
+}
+
 void MainWindow::on_cancel_clicked(GtkButton *button, gpointer user_data) {
   MainWindow *window = static_cast<MainWindow *>(user_data);
   window->cancel_search();
@@ -260,16 +689,26 @@ void MainWindow::on_row_activated(GtkTreeView *tree_view, GtkTreePath *path,
   GtkTreeModel *model = gtk_tree_view_get_model(tree_view);
 
   if (gtk_tree_model_get_iter(model, &iter, path)) {
+    // A duplicate group's row opens or closes the group.
+    if (gtk_tree_model_iter_has_child(model, &iter)) {
+      if (gtk_tree_view_row_expanded(tree_view, path)) {
+        gtk_tree_view_collapse_row(tree_view, path);
+      } else {
+        gtk_tree_view_expand_row(tree_view, path, FALSE);
+      }
+      return;
+    }
     gchar *file_path;
-    gtk_tree_model_get(model, &iter, 0, &file_path, -1);
+    gtk_tree_model_get(model, &iter, RESULT_COLUMN_PATH, &file_path, -1);
     orion_open_in_finder(file_path);
     g_free(file_path);
   }
 }
 
-void MainWindow::load_theme_preference() {
+void MainWindow::load_preferences() {
   std::string config_dir = std::string(g_get_user_config_dir()) + "/orion";
   std::string config_file = config_dir + "/settings.conf";
+  cache_path = config_dir + "/content-cache";
 
   try {
     std::filesystem::create_directories(config_dir);
@@ -281,24 +720,44 @@ void MainWindow::load_theme_preference() {
           bool dark_mode = (line == "dark_mode=1");
           gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(dark_mode_item), dark_mode);
           apply_theme(dark_mode);
-          break;
+        } else if (line.find("ignore=") == 0) {
+          ignore_preferences.enabled = line != "ignore=0";
+        } else if (line.find("ignore_files=") == 0) {
+          ignore_preferences.files = line != "ignore_files=0";
+        } else if (line.find("exclude=") == 0) {
+          ignore_preferences.custom_excludes = true;
+          ignore_preferences.excludes += line.substr(8) + "\n";
         }
       }
     }
   } catch (const std::exception& e) {
-    std::cerr << "Error loading theme preference: " << e.what() << std::endl;
+    std::cerr << "Error loading preferences: " << e.what() << std::endl;
   }
 }
 
+// Rewrites only the dark_mode line; the other settings are edited by hand.
 void MainWindow::save_theme_preference(bool dark_mode) {
   std::string config_dir = std::string(g_get_user_config_dir()) + "/orion";
   std::string config_file = config_dir + "/settings.conf";
 
   try {
     std::filesystem::create_directories(config_dir);
+    std::vector<std::string> lines;
+    std::ifstream existing(config_file);
+    std::string line;
+    while (std::getline(existing, line)) {
+      if (line.find("dark_mode=") != 0) {
+        lines.push_back(line);
+      }
+    }
+    existing.close();
+
     std::ofstream file(config_file);
     if (file.is_open()) {
       file << "dark_mode=" << (dark_mode ? "1" : "0") << std::endl;
+      for (const std::string &kept : lines) {
+        file << kept << std::endl;
+      }
     }
   } catch (const std::exception& e) {
     std::cerr << "Error saving theme preference: " << e.what() << std::endl;
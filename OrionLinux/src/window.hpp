@@ -1,55 +1,166 @@
 #pragma once
 
 #include "bridge.h"
-#include <atomic>
+#include "result_model.hpp"
 #include <gtk/gtk.h>
 #include <memory>
 #include <string>
-#include <thread>
 #include <vector>
 
-struct FileSearchResult {
-  std::string path;
+class MainWindow;
+
+// Passed as user_data to the engine so callbacks from a search that has since
+// been cancelled or replaced can be told apart from the current one.
+struct SearchContext {
+  MainWindow *window;
+  unsigned generation;
+};
+
+// Groups of identical files copied out of the engine's callback, up to
+// MainWindow::kMaxListedResults files. The totals cover every group.
+struct DuplicateList {
+  struct Group {
+    int64_t size;
+    std::vector<std::string> paths;
+  };
+  std::vector<Group> groups;
+  size_t total_groups = 0;
+  int64_t total_files = 0;
+  int64_t reclaimable = 0;
+};
+
+// What searches leave out, from settings.conf:
+//   ignore=0          search everything
+//   ignore_files=0    do not read .gitignore and .orionignore files
+//   exclude=PATTERN   a gitignore pattern for the whole tree, one per line;
+//                     any of these replace the default list (.git,
+//                     node_modules, ...), and a bare "exclude=" clears it
+struct IgnorePreferences {
+  bool enabled = true;
+  bool files = true;
+  bool custom_excludes = false;
+  std::string excludes;
+};
+
+// What a search was started with, kept to tell whether a later query only
+// narrows it down.
+struct SearchRequest {
+  std::string directory;
+  // The query in the engine's syntax, extension included.
+  std::string query;
+  std::string content;
+  bool content_regex = false;
+  bool fuzzy = false;
+  IgnorePreferences ignore;
+
+  orion_search_options_t options() const {
+    orion_search_options_t options = {};
+    options.content = content.empty() ? nullptr : content.c_str();
+    options.content_regex = content_regex ? 1 : 0;
+    options.fuzzy = fuzzy ? 1 : 0;
+    options.ignore = ignore.enabled ? 1 : 0;
+    options.no_ignore_files = ignore.files ? 0 : 1;
+    options.excludes = ignore.custom_excludes ? ignore.excludes.c_str() : nullptr;
+    return options;
+  }
 };
 
 class MainWindow {
 public:
+  // More rows than anyone scrolls through; broad queries stop here instead of
+  // walking the rest of the tree.
+  static constexpr int32_t kMaxListedResults = 10000;
+  // How long typing has to pause before a live query runs.
+  static constexpr guint kLiveSearchDelayMs = 150;
+
   MainWindow();
   ~MainWindow();
 
   GtkWidget *get_widget() { return window; }
-  void update_progress(double progress);
+  void post_results(unsigned generation, std::unique_ptr<ResultBatch> results);
+  void post_duplicates(unsigned generation, std::unique_ptr<DuplicateList> list);
+  void finish_search(unsigned generation, bool cancelled);
 
 private:
   GtkWidget *window;
   GtkWidget *path_entry;
   GtkWidget *search_entry;
   GtkWidget *extension_entry;
+  GtkWidget *content_toggle;
+  GtkWidget *fuzzy_toggle;
+  GtkWidget *regex_toggle;
+  GtkWidget *duplicates_toggle;
+  GtkWidget *live_toggle;
   GtkWidget *search_button;
   GtkWidget *cancel_button;
   GtkWidget *progress_bar;
   GtkWidget *results_list;
+  GtkTreeViewColumn *matches_column;
+  std::vector<GtkTreeViewColumn *> sort_columns;
+  GtkTreeViewColumn *sorted_column;
+  bool sort_descending;
   GtkWidget *dark_mode_item;
-  GtkListStore *list_store;
+  OrionResultModel *result_model;
+  // Set while the view shows duplicate groups instead of result_model.
+  std::unique_ptr<DuplicateList> duplicates;
   bool is_searching;
-  std::atomic<bool> should_cancel;
-  std::unique_ptr<std::thread> search_thread;
+  orion_search_handle_t *search_handle;
+  guint progress_tick;
+  std::unique_ptr<SearchContext> search_context;
+  unsigned search_generation;
+  SearchRequest last_request;
+  // The last search ran to the end, so its results can be filtered.
+  bool last_complete;
+  guint live_timer;
+  orion_index_t *index;
+  std::string index_root;
+  orion_search_handle_t *refresh_handle;
+  bool index_refreshing;
+  unsigned index_generation;
+  bool index_watching;
+  IgnorePreferences ignore_preferences;
+  // The content cache, next to settings.conf.
+  std::string cache_path;
 
   void setup_ui();
   void setup_search_controls();
   void setup_results_list();
 
+  SearchRequest current_request() const;
   void start_search();
+  void live_search();
+  void refine_results(const SearchRequest &request);
   void cancel_search();
-  void perform_search(const std::string &query, const std::string &directory, const std::string &extension);
-  void update_results(const std::vector<FileSearchResult> &results);
+  void stop_search();
+  void open_index(const std::string &directory);
+  void start_refresh();
+  void stop_refresh();
+  void start_watching();
+  void reset_results();
+  void show_duplicates(std::unique_ptr<DuplicateList> list);
+  GtkTreeViewColumn *add_result_column(const char *title, ResultColumn column, int32_t sort_key,
+                                       int width);
+  void sort_results(GtkTreeViewColumn *column);
   void update_search_controls(bool searching);
+  void show_progress();
+  void stop_progress();
 
-  void load_theme_preference();
+  void load_preferences();
   void save_theme_preference(bool dark_mode);
   void apply_theme(bool dark_mode);
 
+  static void on_column_clicked(GtkTreeViewColumn *column, gpointer user_data);
+  static void results_callback(const orion_search_result_t *results, int32_t count,
+                               void *user_data);
+  static void duplicates_callback(const orion_duplicate_group_t *groups, int32_t count,
+                                  void *user_data);
+  static void completion_callback(int32_t cancelled, void *user_data);
+
+  static gboolean on_progress_tick(GtkWidget *widget, GdkFrameClock *frame_clock,
+                                   gpointer user_data);
   static void on_search_clicked(GtkButton *button, gpointer user_data);
+  static void on_query_changed(GtkEditable *editable, gpointer user_data);
+  static gboolean on_live_timeout(gpointer user_data);
   static void on_cancel_clicked(GtkButton *button, gpointer user_data);
   static void on_row_activated(GtkTreeView *tree_view, GtkTreePath *path,
                                GtkTreeViewColumn *column, gpointer user_data);
@@ -1,4 +1,5 @@
 #include "../include/MainWindow.hpp"
+#include "matcher.hpp"
 #include <shobjidl.h> 
 #include <filesystem>
 #include <shlwapi.h>
@@ -22,6 +23,20 @@
 #define IDM_FILE_EXIT 201
 #define IDM_VIEW_DARKMODE 202
 
+namespace {
+
+std::string ToUtf8(const std::wstring& text) {
+    if (text.empty()) return std::string();
+    int size = WideCharToMultiByte(CP_UTF8, 0, text.data(), static_cast<int>(text.size()),
+                                   nullptr, 0, nullptr, nullptr);
+    std::string result(size, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &result[0], size,
+                        nullptr, nullptr);
+    return result;
+}
+
+} // namespace
+
 MainWindow::MainWindow() : 
     m_hwnd(nullptr),
     m_shouldCancel(false),
@@ -511,6 +526,8 @@ void MainWindow::PerformSearch(const std::wstring& query, const std::wstring& di
 
         size_t totalFiles = allFiles.size();
         size_t processedFiles = 0;
+        // Folded once; each file name is only converted to UTF-8.
+        const orion::Matcher matcher(ToUtf8(query));
 
         for (const auto& file : allFiles) {
             if (m_shouldCancel) return;
@@ -527,26 +544,19 @@ void MainWindow::PerformSearch(const std::wstring& query, const std::wstring& di
                     }
                 }
 
-                std::wstring filename = file.filename().wstring();
-                std::wstring lowerFilename;
-                std::wstring lowerQuery;
-                lowerFilename.resize(filename.size());
-                lowerQuery.resize(query.size());
-                std::transform(filename.begin(), filename.end(), lowerFilename.begin(), ::towlower);
-                std::transform(query.begin(), query.end(), lowerQuery.begin(), ::towlower);
-
-                if (lowerFilename.find(lowerQuery) != std::wstring::npos) {
+                if (matcher.matches(ToUtf8(file.filename().wstring()))) {
                     SearchResult result;
                     result.path = file.wstring();
                     result.id = std::to_wstring(results.size());
                     results.push_back(result);
 
-                        SendMessage(m_resultsList, LB_ADDSTRING, 0,
-                                reinterpret_cast<LPARAM>(result.path.c_str()));
-                    }
+                    SendMessage(m_resultsList, LB_ADDSTRING, 0,
+                            reinterpret_cast<LPARAM>(result.path.c_str()));
                 }
             }
-            orion_free_search_results(results);
+            catch (const std::exception&) {
+                // Names that cannot be represented are skipped.
+            }
         }
 
         SetWindowText(m_statusLabel, L"Search complete");